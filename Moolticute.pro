@@ -1,6 +1,7 @@
 TEMPLATE = subdirs
-SUBDIRS = daemon gui
+SUBDIRS = daemon gui dbdiff
 
 daemon.file = daemon.pro
 gui.file = gui.pro
+dbdiff.file = dbdiff.pro
 
@@ -11,6 +11,9 @@ CONFIG -= app_bundle
 
 CONFIG += c++11
 
+# qmake CONFIG+=strip_debug_logs removes debug logs from the binary
+strip_debug_logs: DEFINES += MC_STRIP_DEBUG_LOGS QT_NO_DEBUG_OUTPUT
+
 win32 {
     LIBS += -lsetupapi -luser32
 } else:linux {
@@ -51,18 +54,28 @@ SOURCES += src/main_daemon.cpp \
     src/MPDevice.cpp \
     src/MPManager.cpp \
     src/Common.cpp \
+    src/AsyncLogger.cpp \
+    src/Logging.cpp \
     src/WSServer.cpp \
     src/AppDaemon.cpp \
     src/AsyncJobs.cpp \
     src/MPNode.cpp \
     src/WSServerCon.cpp \
     src/MPDevice_emul.cpp \
+    src/MPDevice_replay.cpp \
+    src/MPTraceFile.cpp \
     src/http-parser/http_parser.c \
     src/HttpClient.cpp \
-    src/HttpServer.cpp
+    src/HttpServer.cpp \
+    src/ServiceMatcher.cpp \
+    src/RandomPool.cpp \
+    src/MPImageFile.cpp \
+    src/MPSnapshot.cpp
 
 HEADERS  += \
     src/Common.h \
+    src/AsyncLogger.h \
+    src/Logging.h \
     src/MPDevice.h \
     src/MPManager.h \
     src/MooltipassCmds.h \
@@ -74,9 +87,15 @@ HEADERS  += \
     src/version.h \
     src/WSServerCon.h \
     src/MPDevice_emul.h \
+    src/MPDevice_replay.h \
+    src/MPTraceFile.h \
     src/http-parser/http_parser.h \
     src/HttpClient.h \
-    src/HttpServer.h
+    src/HttpServer.h \
+    src/ServiceMatcher.h \
+    src/RandomPool.h \
+    src/MPImageFile.h \
+    src/MPSnapshot.h
 
 DISTFILES += \
     src/http-parser/CONTRIBUTIONS \
@@ -0,0 +1,27 @@
+# Offline diff of two database snapshots, no device or daemon needed
+QT       += core network
+QT       -= gui
+
+TEMPLATE = app
+
+TARGET = moolticute-dbdiff
+CONFIG -= app_bundle
+
+CONFIG += c++11 console
+
+SOURCES += src/main_dbdiff.cpp \
+    src/DbDiff.cpp \
+    src/MPSnapshot.cpp \
+    src/MPNode.cpp \
+    src/Common.cpp \
+    src/AsyncLogger.cpp \
+    src/Logging.cpp
+
+HEADERS  += \
+    src/DbDiff.h \
+    src/MPSnapshot.h \
+    src/MPNode.h \
+    src/Common.h \
+    src/AsyncLogger.h \
+    src/Logging.h \
+    src/MooltipassCmds.h
@@ -1,4 +1,4 @@
-QT       += core network websockets gui widgets
+QT       += core network websockets gui widgets concurrent
 
 TEMPLATE = app
 
@@ -6,11 +6,14 @@ TARGET = MoolticuteApp
 
 CONFIG += c++11
 
+# qmake CONFIG+=strip_debug_logs removes debug logs from the binary
+strip_debug_logs: DEFINES += MC_STRIP_DEBUG_LOGS QT_NO_DEBUG_OUTPUT
+
 mac {
     LIBS += -framework ApplicationServices -framework IOKit -framework CoreFoundation -framework Cocoa -framework Foundation
 }
 win32 {
-    LIBS += -luser32
+    LIBS += -luser32 -ladvapi32
 }
 
 include(src/QtAwesome/QtAwesome/QtAwesome.pri)
@@ -18,6 +21,8 @@ include(src/QtAwesome/QtAwesome/QtAwesome.pri)
 SOURCES += src/main_gui.cpp \
     src/MainWindow.cpp \
     src/Common.cpp \
+    src/AsyncLogger.cpp \
+    src/Logging.cpp \
     src/WSClient.cpp \
     src/RotateSpinner.cpp \
     src/CredentialsModel.cpp \
@@ -26,16 +31,22 @@ SOURCES += src/main_gui.cpp \
     src/AutoStartup.cpp \
     src/WindowLog.cpp \
     src/OutputLog.cpp \
+    src/LogBuffer.cpp \
     src/AnsiEscapeCodeHandler.cpp \
     src/PasswordLineEdit.cpp \
     src/CredentialsView.cpp \
     src/CredentialsManagement.cpp \
     src/zxcvbn-c/zxcvbn.c \
+    src/PasswordStrength.cpp \
+    src/PasswordAudit.cpp \
+    src/PasswordGenerator.cpp \
     src/FilesManagement.cpp \
     src/SSHManagement.cpp
 
 HEADERS  += src/MainWindow.h \
     src/Common.h \
+    src/AsyncLogger.h \
+    src/Logging.h \
     src/QtHelper.h \
     src/WSClient.h \
     src/RotateSpinner.h \
@@ -46,12 +57,15 @@ HEADERS  += src/MainWindow.h \
     src/AutoStartup.h \
     src/WindowLog.h \
     src/OutputLog.h \
+    src/LogBuffer.h \
     src/AnsiEscapeCodeHandler.h \
     src/PasswordLineEdit.h \
     src/CredentialsView.h \
     src/CredentialsManagement.h \
-    src/zxcvbn-c/dict-src.h \
     src/zxcvbn-c/zxcvbn.h \
+    src/PasswordStrength.h \
+    src/PasswordAudit.h \
+    src/PasswordGenerator.h \
     src/FilesManagement.h \
     src/SSHManagement.h
 
@@ -63,6 +77,35 @@ mac {
 INCLUDEPATH += src\
     src/zxcvbn-c
 
+# zxcvbn dictionary is not built in the executable. It is generated by dictgen
+# (zxcvbn-c/dict-generate.cpp) in the build dir and memory mapped at runtime.
+# dictgen runs on the build machine, for cross builds set DICTGEN_CXX to a
+# native compiler: qmake DICTGEN_CXX=g++
+DEFINES += USE_DICT_FILE
+INCLUDEPATH += $$OUT_PWD
+isEmpty(DICTGEN_CXX): DICTGEN_CXX = $$QMAKE_CXX
+
+DICTGEN = $$OUT_PWD/dictgen
+win32-msvc* {
+    DICTGEN = $$OUT_PWD/dictgen.exe
+    dictgen.commands = $$DICTGEN_CXX /nologo /EHsc /O2 /Fe$$shell_path($$DICTGEN) $$shell_path($$PWD/src/zxcvbn-c/dict-generate.cpp)
+} else {
+    dictgen.commands = $$DICTGEN_CXX -O2 -std=c++11 -o $$DICTGEN $$PWD/src/zxcvbn-c/dict-generate.cpp
+}
+dictgen.target = $$DICTGEN
+dictgen.depends = $$PWD/src/zxcvbn-c/dict-generate.cpp
+QMAKE_EXTRA_TARGETS += dictgen
+
+ZXCVBN_WORDS = $$files($$PWD/src/zxcvbn-c/words-*.txt)
+zxcvbn_dict.input = ZXCVBN_WORDS
+zxcvbn_dict.output = $$OUT_PWD/dict-crc.h
+zxcvbn_dict.commands = $$shell_path($$DICTGEN) -b -o $$shell_path($$OUT_PWD/zxcvbn.dict) -h $$shell_path($$OUT_PWD/dict-crc.h) ${QMAKE_FILE_IN}
+zxcvbn_dict.depends = $$DICTGEN
+zxcvbn_dict.CONFIG += combine target_predeps no_link
+zxcvbn_dict.variable_out = HEADERS
+QMAKE_EXTRA_COMPILERS += zxcvbn_dict
+QMAKE_CLEAN += $$OUT_PWD/zxcvbn.dict $$DICTGEN
+
 FORMS    += src/MainWindow.ui \
     src/WindowLog.ui \
     src/CredentialsManagement.ui \
@@ -76,6 +119,12 @@ win32 {
     RC_FILE = win/windows_res.rc
 }
 
+mac {
+    zxcvbn_bundle.files = $$OUT_PWD/zxcvbn.dict
+    zxcvbn_bundle.path = Contents/Resources
+    QMAKE_BUNDLE_DATA += zxcvbn_bundle
+}
+
 mac {
     ICON = img/AppIcon.icns
 } else {
@@ -103,5 +152,11 @@ unix {
     ico.path = $$PREFIX/share/icons
     ico.files += $$PWD/linux/moolticute.png
     INSTALLS += ico
+
+    # install zxcvbn dictionary
+    zxcvbn.path = $$PREFIX/share/moolticute
+    zxcvbn.files += $$OUT_PWD/zxcvbn.dict
+    zxcvbn.CONFIG += no_check_exist
+    INSTALLS += zxcvbn
 }
 
@@ -39,6 +39,7 @@ for f in $MXE_BIN/bin/libgcc_s_sjlj-1.dll \
          $MXE_BIN/qt5/plugins/imageformats \
          $MXE_BIN/qt5/plugins/platforms \
          build/release/MoolticuteApp.exe \
+         build/zxcvbn.dict \
          build/release/moolticuted.exe
 do
     cp -R $f $WDIR
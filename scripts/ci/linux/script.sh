@@ -17,7 +17,7 @@ export MXE_BASE=$HOME/mxe
 
 make_version ..
 
-$MXE_BASE/usr/i686-w64-mingw32.shared.posix/qt5/bin/qmake ../Moolticute.pro
+$MXE_BASE/usr/i686-w64-mingw32.shared.posix/qt5/bin/qmake ../Moolticute.pro DICTGEN_CXX=g++
 make
 
 popd
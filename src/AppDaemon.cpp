@@ -20,12 +20,17 @@
 #include "HttpServer.h"
 #include "Common.h"
 #include "version.h"
+#include "RandomPool.h"
+#include "AsyncLogger.h"
 
 #ifdef Q_OS_MAC
 #include "MacUtils.h"
 #endif
 
 bool AppDaemon::emulationMode = false;
+QString AppDaemon::traceFile;
+QString AppDaemon::replayTraceFile;
+double AppDaemon::replayTraceSpeed = 1.0;
 
 AppDaemon::AppDaemon(int &argc, char **argv):
     QAPP(argc, argv),
@@ -100,9 +105,72 @@ bool AppDaemon::initialize()
                                        QCoreApplication::translate("main", "port"));
     parser.addOption(debugHttpServer);
 
+    QCommandLineOption randomPoolWatermarks(QStringList() << "random-pool",
+                                            QCoreApplication::translate("main", "Low and high watermarks in bytes of the device random numbers pool. Random numbers are fetched in background when the pool is under the low watermark, until it reaches the high one."),
+                                            QCoreApplication::translate("main", "low:high"));
+    parser.addOption(randomPoolWatermarks);
+
+    QCommandLineOption logFile(QStringList() << "l" << "log-file",
+                               QCoreApplication::translate("main", "Also write logs to this file. It is rotated when bigger than 10MB and 3 old files are kept."),
+                               QCoreApplication::translate("main", "file"));
+    parser.addOption(logFile);
+
+    QCommandLineOption logRules(QStringList() << "log-rules",
+                                QCoreApplication::translate("main", "Enable or disable log categories, ex: \"mc.node.debug=true;mc.usb.debug=true\". Same syntax as QT_LOGGING_RULES with ';' separated rules."),
+                                QCoreApplication::translate("main", "rules"));
+    parser.addOption(logRules);
+
+    QCommandLineOption recordUsb(QStringList() << "record-usb",
+                                 QCoreApplication::translate("main", "Record the USB packets exchanged with the device to a trace file. "
+                                                                     "Passwords and data node contents are not recorded, but service names, "
+                                                                     "logins and descriptions are."),
+                                 QCoreApplication::translate("main", "file"));
+    parser.addOption(recordUsb);
+
+    QCommandLineOption replay(QStringList() << "replay",
+                              QCoreApplication::translate("main", "Replay a trace file recorded with --record-usb instead of using a device."),
+                              QCoreApplication::translate("main", "file"));
+    parser.addOption(replay);
+
+    QCommandLineOption replaySpeedOption(QStringList() << "replay-speed",
+                                         QCoreApplication::translate("main", "Speed factor of the replay, 1 keeps the recorded timing, 0 replies immediately."),
+                                         QCoreApplication::translate("main", "factor"));
+    parser.addOption(replaySpeedOption);
+
     parser.process(qApp->arguments());
 
-    emulationMode = parser.isSet(emulMode);
+    if (parser.isSet(randomPoolWatermarks))
+    {
+        QStringList l = parser.value(randomPoolWatermarks).split(':');
+        bool okLow = false, okHigh = false;
+        int low = l.value(0).toInt(&okLow);
+        int high = l.value(1).toInt(&okHigh);
+        if (l.size() == 2 && okLow && okHigh)
+            RandomPool::setWatermarks(low, high);
+        else
+            qWarning() << "Invalid random pool watermarks:" << parser.value(randomPoolWatermarks);
+    }
+
+    if (parser.isSet(logFile))
+        AsyncLogger::Instance()->setLogFile(parser.value(logFile));
+
+    if (parser.isSet(logRules))
+        QLoggingCategory::setFilterRules(parser.value(logRules).replace(';', '\n'));
+
+    traceFile = parser.value(recordUsb);
+    replayTraceFile = parser.value(replay);
+    if (parser.isSet(replaySpeedOption))
+    {
+        bool ok = false;
+        double speed = parser.value(replaySpeedOption).toDouble(&ok);
+        if (ok && speed >= 0)
+            replayTraceSpeed = speed;
+        else
+            qWarning() << "Invalid replay speed:" << parser.value(replaySpeedOption);
+    }
+
+    //Replaying a trace uses the emulation code path, no USB device is opened
+    emulationMode = parser.isSet(emulMode) || !replayTraceFile.isEmpty();
 
     if (parser.isSet(debugHttpServer))
     {
@@ -47,6 +47,11 @@ public:
 
     static bool isEmulationMode();
 
+    //USB trace to record, or to replay instead of a device
+    static QString usbTraceFile() { return traceFile; }
+    static QString replayFile() { return replayTraceFile; }
+    static double replaySpeed() { return replayTraceSpeed; }
+
 private:
     WSServer *wsServer;
     HttpServer *httpServer = nullptr;
@@ -58,6 +63,9 @@ private:
     QLocalServer *localLogServer = nullptr;
 
     static bool emulationMode;
+    static QString traceFile;
+    static QString replayTraceFile;
+    static double replayTraceSpeed;
 };
 
 #endif // APPDAEMON_H
@@ -17,6 +17,8 @@
  **
  ******************************************************************************/
 #include "AppGui.h"
+#include "PasswordGenerator.h"
+#include "Logging.h"
 
 #ifdef Q_OS_MAC
 #include "MacUtils.h"
@@ -112,6 +114,17 @@ bool AppGui::initialize()
     wsClient = new WSClient(this);
     connect(wsClient, &WSClient::connectedChanged, this, &AppGui::connectedChanged);
     connect(wsClient, &WSClient::statusChanged, this, &AppGui::updateSystrayTooltip);
+
+    //Device random numbers are mixed in the generated passwords
+    connect(wsClient, &WSClient::randomNumbersReceived, [](const QByteArray &nums)
+    {
+        PasswordGenerator::addDeviceEntropy(nums);
+    });
+    connect(wsClient, &WSClient::statusChanged, [=](Common::MPStatus status)
+    {
+        if (status == Common::Unlocked)
+            wsClient->requestRandomNumbers();
+    });
     connectedChanged();
 
     win = new MainWindow(wsClient);
@@ -119,6 +132,7 @@ bool AppGui::initialize()
     {
         mainWindowHide();
     });
+    connect(win, &MainWindow::logWindowOpenedChanged, this, &AppGui::sendLogSubscription);
 
     autoLaunched ?  mainWindowHide() : mainWindowShow();
 
@@ -384,8 +398,9 @@ void AppGui::searchDaemonTick()
     {
         delete logSocket;
         logSocket = new QLocalSocket(this);
-        logSocket->connectToServer(MOOLTICUTE_DAEMON_LOG_SOCK);
         connect(logSocket, SIGNAL(readyRead()), this, SLOT(daemonLogRead()));
+        connect(logSocket, &QLocalSocket::connected, this, &AppGui::sendLogSubscription);
+        logSocket->connectToServer(MOOLTICUTE_DAEMON_LOG_SOCK);
     }
 }
 
@@ -456,13 +471,28 @@ void AppGui::slotConnectionEstablished()
     });
 }
 
+void AppGui::sendLogSubscription()
+{
+    if (!win || !logSocket || logSocket->state() != QLocalSocket::ConnectedState)
+        return;
+
+    //The log window shows everything, only keep the important
+    //records in the background buffer while it is closed
+    LogSubscription sub;
+    sub.minLevel = win->isLogWindowOpened()?QtDebugMsg:QtInfoMsg;
+    logSocket->write(Logging::encodeSubscription(sub));
+}
+
 void AppGui::daemonLogRead()
 {
-    while (logSocket->canReadLine())
+    //Records are shown without colors, the window formats them from their level
+    QByteArray payload;
+    while (Logging::readFrame(logSocket, payload))
     {
-        QByteArray out = logSocket->readLine();
-        win->daemonLogAppend(out);
-        //qDebug() << QString::fromUtf8(out);
+        LogRecord rec;
+        QByteArray category, file;
+        if (Logging::decodeRecord(payload, rec, category, file))
+            win->daemonLogAppend(rec.type, Logging::formatRecord(rec, false));
     }
 }
 
@@ -0,0 +1,323 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "AsyncLogger.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <stdio.h>
+
+//Records are written at once up to this size
+#define LOG_BATCH_SIZE      (64 * 1024)
+//Max time the writer sleeps if a wake up is missed
+#define LOG_WRITER_TIMEOUT  500
+
+AsyncLogger *AsyncLogger::Instance()
+{
+    //Initialization is thread safe, the first record can come from any thread
+    static AsyncLogger logger;
+    return &logger;
+}
+
+AsyncLogger::AsyncLogger()
+{
+    for (quint32 i = 0;i < RingSize;i++)
+        ring[i].seq.store(i);
+
+    start(QThread::LowPriority);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+}
+
+void AsyncLogger::log(const LogRecord &record)
+{
+    //Writer is stopped, nobody would read the queue
+    if (stopRequested.load())
+    {
+        logNow(Logging::formatRecord(record));
+        return;
+    }
+
+    quint32 pos = enqueuePos.load();
+    Slot *slot;
+    forever
+    {
+        slot = &ring[pos % RingSize];
+        qint32 dif = static_cast<qint32>(slot->seq.loadAcquire() - pos);
+        if (dif == 0)
+        {
+            if (enqueuePos.testAndSetRelaxed(pos, pos + 1))
+                break;
+            pos = enqueuePos.load();
+        }
+        else if (dif < 0)
+        {
+            //Full, the writer can't follow
+            dropped.ref();
+            return;
+        }
+        else
+            pos = enqueuePos.load();
+    }
+
+    slot->record = record;
+    slot->seq.storeRelease(pos + 1);
+
+    if (writerSleeping.testAndSetOrdered(1, 0))
+        wakeUp.release();
+}
+
+void AsyncLogger::logNow(const QByteArray &record)
+{
+    fwrite(record.constData(), 1, record.size(), stdout);
+    fflush(stdout);
+}
+
+bool AsyncLogger::dequeue(LogRecord &record)
+{
+    Slot &slot = ring[dequeuePos % RingSize];
+    if (slot.seq.loadAcquire() != dequeuePos + 1)
+        return false;
+
+    record = slot.record;
+    slot.record = LogRecord();
+    slot.seq.storeRelease(dequeuePos + RingSize);
+    dequeuePos++;
+    return true;
+}
+
+void AsyncLogger::run()
+{
+    QByteArray batch, fileBatch;
+    QVector<LogRecord> clientRecords;
+
+    //Terminal output is colored, the log file only gets plain text
+    auto format = [&](const LogRecord &rec)
+    {
+        batch.append(Logging::formatRecord(rec));
+        if (logFile)
+            fileBatch.append(Logging::formatRecord(rec, false));
+    };
+
+    forever
+    {
+        if (logFileChanged.testAndSetOrdered(1, 0))
+            openLogFile();
+
+        LogRecord record;
+        while (dequeue(record))
+        {
+            format(record);
+            if (forwardToClients.load())
+                clientRecords.append(record);
+            if (batch.size() >= LOG_BATCH_SIZE)
+                flushBatch(batch, fileBatch, clientRecords);
+        }
+
+        int d = dropped.fetchAndStoreOrdered(0);
+        if (d > 0)
+        {
+            LogRecord rec;
+            rec.timestamp = QDateTime::currentMSecsSinceEpoch();
+            rec.type = QtWarningMsg;
+            rec.file = __FILE__;
+            rec.line = __LINE__;
+            rec.message = QByteArray::number(d) + " log messages dropped";
+            format(rec);
+            if (forwardToClients.load())
+                clientRecords.append(rec);
+        }
+
+        flushBatch(batch, fileBatch, clientRecords);
+
+        if (stopRequested.load())
+        {
+            //Last records queued before the stop
+            while (dequeue(record))
+                format(record);
+            clientRecords.clear();
+            flushBatch(batch, fileBatch, clientRecords);
+            return;
+        }
+
+        //Sleep until a new record is queued
+        writerSleeping.fetchAndStoreOrdered(1);
+        if (ring[dequeuePos % RingSize].seq.loadAcquire() != dequeuePos + 1)
+            wakeUp.tryAcquire(1, LOG_WRITER_TIMEOUT);
+        writerSleeping.testAndSetOrdered(1, 0);
+    }
+}
+
+void AsyncLogger::flushBatch(QByteArray &batch, QByteArray &fileBatch, QVector<LogRecord> &records)
+{
+    if (batch.isEmpty())
+        return;
+
+    fwrite(batch.constData(), 1, batch.size(), stdout);
+    fflush(stdout);
+
+    if (logFile && !fileBatch.isEmpty())
+    {
+        logFile->write(fileBatch);
+        logFile->flush();
+        logFileSize += fileBatch.size();
+        if (logFileMaxSize > 0 && logFileSize > logFileMaxSize)
+            rotateLogFile();
+    }
+
+    //Sockets are only used from the main thread
+    if (!records.isEmpty())
+        QMetaObject::invokeMethod(this, "writeToClients", Qt::QueuedConnection, Q_ARG(QVector<LogRecord>, records));
+
+    batch.clear();
+    fileBatch.clear();
+    records.clear();
+}
+
+void AsyncLogger::stop()
+{
+    if (!isRunning())
+        return;
+
+    stopRequested.store(1);
+    wakeUp.release();
+    wait();
+}
+
+void AsyncLogger::setLogServer(QLocalServer *server)
+{
+    qRegisterMetaType<QVector<LogRecord>>("QVector<LogRecord>");
+
+    logServer = server;
+    forwardToClients.store(logServer != nullptr);
+    if (!logServer)
+        return;
+
+    connect(logServer, &QLocalServer::newConnection, this, [=]()
+    {
+        if (!logServer->hasPendingConnections())
+            return;
+
+        QLocalSocket *s = logServer->nextPendingConnection();
+
+        //New clients gets added to the list and all
+        //logs will be forwarded to them until they subscribe
+        logClients.insert(s, LogSubscription());
+
+        connect(s, &QLocalSocket::readyRead, this, [=]()
+        {
+            QByteArray payload;
+            while (Logging::readFrame(s, payload))
+            {
+                LogSubscription sub;
+                if (Logging::decodeSubscription(payload, sub))
+                    logClients[s] = sub;
+            }
+        });
+
+        connect(s, &QLocalSocket::disconnected, this, [=]()
+        {
+            logClients.remove(s);
+            s->deleteLater();
+        });
+    });
+}
+
+void AsyncLogger::writeToClients(const QVector<LogRecord> &records)
+{
+    //A record is only encoded if a client wants it, and only once
+    QVector<QByteArray> frames(records.size());
+
+    for (auto it = logClients.constBegin();it != logClients.constEnd();it++)
+    {
+        QByteArray out;
+        for (int i = 0;i < records.size();i++)
+        {
+            if (!it.value().accepts(records.at(i)))
+                continue;
+            if (frames.at(i).isEmpty())
+                frames[i] = Logging::encodeRecord(records.at(i));
+            out.append(frames.at(i));
+        }
+
+        if (!out.isEmpty())
+            it.key()->write(out);
+    }
+}
+
+void AsyncLogger::setLogFile(const QString &path, qint64 maxSize, int maxFiles)
+{
+    QMutexLocker locker(&fileMutex);
+    logFilePath = path;
+    logFileMaxSize = maxSize;
+    logFileMaxCount = maxFiles;
+    logFileChanged.store(1);
+}
+
+void AsyncLogger::openLogFile()
+{
+    QMutexLocker locker(&fileMutex);
+
+    delete logFile;
+    logFile = nullptr;
+    if (logFilePath.isEmpty())
+        return;
+
+    logFile = new QFile(logFilePath);
+    if (!logFile->open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        logNow("WARNING: Failed to open log file " + logFilePath.toUtf8() + "\n");
+        delete logFile;
+        logFile = nullptr;
+        return;
+    }
+    logFileSize = logFile->size();
+}
+
+void AsyncLogger::rotateLogFile()
+{
+    logFile->close();
+
+    QString path;
+    int count;
+    {
+        QMutexLocker locker(&fileMutex);
+        path = logFilePath;
+        count = logFileMaxCount;
+    }
+
+    //file.N is dropped, file.1 becomes file.2 and so on
+    if (count > 0)
+    {
+        QFile::remove(QStringLiteral("%1.%2").arg(path).arg(count));
+        for (int i = count - 1;i > 0;i--)
+            QFile::rename(QStringLiteral("%1.%2").arg(path).arg(i), QStringLiteral("%1.%2").arg(path).arg(i + 1));
+        QFile::rename(path, path + ".1");
+    }
+    else
+        QFile::remove(path);
+
+    if (!logFile->open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        delete logFile;
+        logFile = nullptr;
+    }
+    logFileSize = 0;
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QtCore>
+#include "Logging.h"
+
+class QLocalServer;
+class QLocalSocket;
+
+//Log records are written to outputs by a background thread.
+//Threads that log only push the record in a lock free ring buffer, they
+//never wait for stdout, the log file or the log clients. Records are
+//formatted as text by the writer thread.
+//If the ring buffer is full, records are dropped and the number of dropped
+//records is written when there is room again.
+class AsyncLogger: public QThread
+{
+    Q_OBJECT
+public:
+    static AsyncLogger *Instance();
+
+    //Queue a record, does not block
+    void log(const LogRecord &record);
+
+    //Write a record directly to stdout, for fatal messages
+    void logNow(const QByteArray &record);
+
+    //Forward log records to the clients of this local server, see the
+    //frames in Logging.h. Clients only get the records matching their subscription.
+    void setLogServer(QLocalServer *server);
+
+    //Also write logs to a file. When the file gets bigger than maxSize it is
+    //renamed to file.1 (file.1 to file.2, ...) and maxFiles of them are kept.
+    void setLogFile(const QString &path, qint64 maxSize = 10 * 1024 * 1024, int maxFiles = 3);
+
+    //Write pending records and stop the writer thread
+    void stop();
+
+protected:
+    void run() override;
+
+private slots:
+    void writeToClients(const QVector<LogRecord> &records);
+
+private:
+    AsyncLogger();
+    ~AsyncLogger();
+
+    bool dequeue(LogRecord &record);
+    void flushBatch(QByteArray &batch, QByteArray &fileBatch, QVector<LogRecord> &records);
+    void openLogFile();
+    void rotateLogFile();
+
+    //Bounded multi producer, single consumer queue
+    static const quint32 RingSize = 4096;
+    struct Slot
+    {
+        QAtomicInteger<quint32> seq;
+        LogRecord record;
+    };
+    Slot ring[RingSize];
+    QAtomicInteger<quint32> enqueuePos;
+    quint32 dequeuePos = 0;
+
+    QAtomicInt dropped;
+    QAtomicInt writerSleeping;
+    QAtomicInt stopRequested;
+    QSemaphore wakeUp;
+
+    //Only used by the writer thread
+    QFile *logFile = nullptr;
+    qint64 logFileSize = 0;
+
+    //Protected by fileMutex, picked up by the writer thread
+    QMutex fileMutex;
+    QString logFilePath;
+    qint64 logFileMaxSize = 0;
+    int logFileMaxCount = 0;
+    QAtomicInt logFileChanged;
+
+    //Only used from the main thread
+    QAtomicInt forwardToClients;
+    QLocalServer *logServer = nullptr;
+    QHash<QLocalSocket *, LogSubscription> logClients;
+};
+
+#endif // ASYNCLOGGER_H
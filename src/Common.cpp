@@ -17,8 +17,8 @@
  **
  ******************************************************************************/
 #include "Common.h"
+#include "AsyncLogger.h"
 #include <QLocalServer>
-#include <QLocalSocket>
 #include <time.h>
 
 #ifndef Q_OS_WIN
@@ -33,34 +33,6 @@
 #include <qt_windows.h>
 #endif
 
-#ifdef Q_OS_WIN_DISABLE_FOR_NOW
-#define COLOR_LIGHTRED
-#define COLOR_RED
-#define COLOR_LIGHTBLUE
-#define COLOR_BLUE
-#define COLOR_GREEN
-#define COLOR_YELLOW
-#define COLOR_ORANGE
-#define COLOR_WHITE
-#define COLOR_LIGHTCYAN
-#define COLOR_CYAN
-#define COLOR_RESET
-#define COLOR_HIGH
-#else
-#define COLOR_LIGHTRED  "\033[31;1m"
-#define COLOR_RED       "\033[31m"
-#define COLOR_LIGHTBLUE "\033[34;1m"
-#define COLOR_BLUE      "\033[34m"
-#define COLOR_GREEN     "\033[32;1m"
-#define COLOR_YELLOW    "\033[33;1m"
-#define COLOR_ORANGE    "\033[0;33m"
-#define COLOR_WHITE     "\033[37;1m"
-#define COLOR_LIGHTCYAN "\033[36;1m"
-#define COLOR_CYAN      "\033[36m"
-#define COLOR_RESET     "\033[0m"
-#define COLOR_HIGH      "\033[1m"
-#endif
-
 QHash<Common::MPStatus, QString> Common::MPStatusUserString = {
     { Common::UnknownStatus, QObject::tr("Unknown status") },
     { Common::NoCardInserted, QObject::tr("No card inserted") },
@@ -100,80 +72,40 @@ Common::MPStatus Common::statusFromString(const QString &st)
     return Common::UnknownStatus;
 }
 
-static QLocalServer *debugLogServer = nullptr;
-static QList<QLocalSocket *> debugLogClients;
 static void _messageOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
-    QString fname = context.file;
-    fname = fname.section('\\', -1, -1);
-
-    QString s;
-    switch (type) {
-    default:
-    case QtDebugMsg:
-    {
-        s = QString(COLOR_CYAN "DEBUG" COLOR_RESET ": %1:%2 - %3\n").arg(fname).arg(context.line).arg(msg);
-        break;
-    }
-    case QtInfoMsg:
-    {
-        s = QString(COLOR_GREEN "INFO" COLOR_RESET ": %1:%2 - %3\n").arg(fname).arg(context.line).arg(msg);
-        break;
-    }
-    case QtWarningMsg:
-    {
-        s = QString(COLOR_YELLOW "WARNING" COLOR_RESET ": %1:%2 - %3\n").arg(fname).arg(context.line).arg(msg);
-        break;
-    }
-    case QtCriticalMsg:
-    {
-        s = QString(COLOR_ORANGE "CRITICAL" COLOR_RESET ": %1:%2 - %3\n").arg(fname).arg(context.line).arg(msg);
-        break;
-    }
-    case QtFatalMsg:
+    LogRecord rec;
+    rec.timestamp = QDateTime::currentMSecsSinceEpoch();
+    rec.type = type;
+    rec.category = context.category;
+    rec.file = context.file;
+    rec.line = context.line;
+    rec.message = msg.toUtf8();
+
+    if (type == QtFatalMsg)
     {
-        s = QString(COLOR_RED "FATAL" COLOR_RESET ": %1:%2 - %3\n").arg(fname).arg(context.line).arg(msg);
-        break;
-    }
+        //Application aborts after that, write everything now
+        AsyncLogger::Instance()->stop();
+        AsyncLogger::Instance()->logNow(Logging::formatRecord(rec));
+        return;
     }
 
-    if (!s.isEmpty())
-    {
-        printf("%s", qPrintable(s));
-        fflush(stdout);
-
-        for (QLocalSocket *sock: debugLogClients)
-        {
-            sock->write(s.toUtf8());
-            sock->flush();
-        }
-    }
+    //Text formatting is done by the logger thread
+    AsyncLogger::Instance()->log(rec);
+}
+
+static void _stopMessageOutput()
+{
+    AsyncLogger::Instance()->stop();
 }
 
 void Common::installMessageOutputHandler(QLocalServer *logServer)
 {
-    debugLogServer = logServer;
-    if (debugLogServer)
-    {
-        QObject::connect(debugLogServer, &QLocalServer::newConnection, []()
-        {
-            if (!debugLogServer->hasPendingConnections())
-                return;
-
-            QLocalSocket *s = debugLogServer->nextPendingConnection();
-
-            //New clients gets added to the list
-            //and logs will be forwarded to them
-            debugLogClients.append(s);
-
-            QObject::connect(s, &QLocalSocket::disconnected, [s]()
-            {
-                debugLogClients.removeAll(s);
-                s->deleteLater();
-            });
-        });
-    }
+    AsyncLogger::Instance()->setLogServer(logServer);
     qInstallMessageHandler(_messageOutput);
+
+    //Pending logs are written before exit
+    qAddPostRoutine(_stopMessageOutput);
 }
 
 QDate Common::bytesToDate(const QByteArray &data)
@@ -317,3 +249,8 @@ void Common::releaseUid(QString uid)
     //delete this id from the list so it could be used again
     commonExistingUid.remove(uid);
 }
+
+QString Common::imagesDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/images";
+}
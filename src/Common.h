@@ -134,6 +134,9 @@ public:
     //release the unique id and remove it from the list
     static void releaseUid(QString uid);
 
+    //Only dir the daemon reads and writes device images from, the GUI copies them in and out
+    static QString imagesDir();
+
     typedef enum
     {
         MP_Classic = 0,
@@ -37,6 +37,7 @@ CredentialsManagement::CredentialsManagement(QWidget *parent) :
     ui->addCredentialButton->setStyleSheet(CSS_BLUE_BUTTON);
     ui->buttonDiscard->setStyleSheet(CSS_GREY_BUTTON);
     ui->buttonSaveChanges->setStyleSheet(CSS_BLUE_BUTTON);
+    ui->buttonAuditPasswords->setStyleSheet(CSS_GREY_BUTTON);
     ui->pushButtonEnterMMM->setIcon(AppGui::qtAwesome()->icon(fa::unlock, whiteButtons));
 
     credModel = new CredentialsModel(this);
@@ -106,6 +107,13 @@ void CredentialsManagement::setWsClient(WSClient *c)
         ui->lineEditFilterCred->clear();
     });
     connect(wsClient, &WSClient::passwordUnlocked, this, &CredentialsManagement::onPasswordUnlocked);
+
+    passwordAudit = new PasswordAudit(wsClient, this);
+    connect(passwordAudit, &PasswordAudit::progressChanged, [=](int total, int current)
+    {
+        ui->buttonAuditPasswords->setText(tr("Auditing %1/%2").arg(current).arg(total));
+    });
+    connect(passwordAudit, &PasswordAudit::finished, this, &CredentialsManagement::onPasswordAuditFinished);
 }
 
 void CredentialsManagement::enableCredentialsManagement(bool enable)
@@ -119,6 +127,13 @@ void CredentialsManagement::enableCredentialsManagement(bool enable)
     {
         ui->stackedWidget->setCurrentWidget(ui->pageLocked);
         disconnect(wsClient, &WSClient::credentialsUpdated, this, &CredentialsManagement::onCredentialUpdated);
+
+        if (passwordAudit->isRunning())
+        {
+            passwordAudit->cancel();
+            ui->buttonAuditPasswords->setText(tr("Audit passwords"));
+            ui->buttonAuditPasswords->setEnabled(true);
+        }
     }
 }
 
@@ -147,6 +162,72 @@ void CredentialsManagement::on_buttonSaveChanges_clicked()
     QMessageBox::information(this, "Moolticute", "Not implemented yet!");
 }
 
+void CredentialsManagement::on_buttonAuditPasswords_clicked()
+{
+    if (!wsClient->get_memMgmtMode() || passwordAudit->isRunning())
+        return;
+
+    QList<PasswordAuditKey> creds;
+    for (int i = 0;i < credModel->rowCount();i++)
+        creds.append(PasswordAuditKey(credModel->at(i).service, credModel->at(i).login));
+
+    if (creds.isEmpty())
+        return;
+
+    auto btn = QMessageBox::question(this,
+                                     tr("Audit Passwords"),
+                                     tr("The %1 passwords will be read from the device to find weak and reused passwords. "
+                                        "Each password has to be approved on the device.\n\n"
+                                        "Passwords are not kept once checked. Do you want to continue ?").arg(creds.size()),
+                                     QMessageBox::Yes | QMessageBox::No,
+                                     QMessageBox::No);
+    if (btn != QMessageBox::Yes)
+        return;
+
+    ui->buttonAuditPasswords->setEnabled(false);
+    passwordAudit->start(creds);
+}
+
+void CredentialsManagement::onPasswordAuditFinished(bool success)
+{
+    ui->buttonAuditPasswords->setText(tr("Audit passwords"));
+    ui->buttonAuditPasswords->setEnabled(true);
+
+    int weak = 0, reused = 0, failed = 0;
+    QStringList details;
+    for (const PasswordAuditEntry &e: passwordAudit->report())
+    {
+        QStringList problems;
+        if (e.failed)
+        {
+            failed++;
+            problems << e.errorString;
+        }
+        if (PasswordAudit::isWeak(e))
+        {
+            weak++;
+            problems << tr("weak password (%1 bit)").arg(QString::number(e.entropy, 'f', 0));
+        }
+        if (e.reuseCount > 0)
+        {
+            reused++;
+            problems << tr("same password as %1 other credential(s)").arg(e.reuseCount);
+        }
+        if (!problems.isEmpty())
+            details << QStringLiteral("%1/%2: %3").arg(e.service, e.login, problems.join(", "));
+    }
+
+    QMessageBox box(this);
+    box.setWindowTitle(tr("Password Audit"));
+    box.setIcon(success && details.isEmpty() ? QMessageBox::Information : QMessageBox::Warning);
+    box.setText(tr("%1 credentials checked: %2 weak, %3 reused, %4 not read.")
+                .arg(passwordAudit->report().size())
+                .arg(weak).arg(reused).arg(failed));
+    if (!details.isEmpty())
+        box.setDetailedText(details.join("\n"));
+    box.exec();
+}
+
 void CredentialsManagement::requestPasswordForSelectedItem()
 {
     if (!wsClient->get_memMgmtMode()) return;
@@ -22,6 +22,7 @@
 #include <QtWidgets>
 #include "WSClient.h"
 #include "CredentialsModel.h"
+#include "PasswordAudit.h"
 
 namespace Ui {
 class CredentialsManagement;
@@ -55,6 +56,8 @@ private slots:
     void on_pushButtonEnterMMM_clicked();
     void on_buttonDiscard_clicked();
     void on_buttonSaveChanges_clicked();
+    void on_buttonAuditPasswords_clicked();
+    void onPasswordAuditFinished(bool success);
 
     void requestPasswordForSelectedItem();
     void on_addCredentialButton_clicked();
@@ -65,6 +68,7 @@ private:
     CredentialsModel *credModel = nullptr;
     CredentialsFilterModel *credFilterModel = nullptr;
     WSClient *wsClient = nullptr;
+    PasswordAudit *passwordAudit = nullptr;
 };
 
 #endif // CREDENTIALSMANAGEMENT_H
@@ -18,16 +18,58 @@
  ******************************************************************************/
 #include "CredentialsModel.h"
 
+//Delay before applying the filter, restarted at each key stroke
+#define FILTER_DELAY    150
+
 CredentialsFilterModel::CredentialsFilterModel(QObject *parent):
     QSortFilterProxyModel(parent)
 {
     setDynamicSortFilter(true);
+
+    filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(FILTER_DELAY);
+    connect(filterTimer, &QTimer::timeout, this, &CredentialsFilterModel::applyFilter);
+}
+
+void CredentialsFilterModel::setSourceModel(QAbstractItemModel *model)
+{
+    QSortFilterProxyModel::setSourceModel(model);
+    matchesValid = false;
+
+    //Rows are not the same anymore, do a full filtering next time
+    auto invalidateMatches = [=]() { matchesValid = false; };
+    connect(model, &QAbstractItemModel::rowsInserted, this, invalidateMatches);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, invalidateMatches);
+    connect(model, &QAbstractItemModel::rowsMoved, this, invalidateMatches);
+    connect(model, &QAbstractItemModel::modelReset, this, invalidateMatches);
+    connect(model, &QAbstractItemModel::layoutChanged, this, invalidateMatches);
 }
 
 void CredentialsFilterModel::setFilter(const QString &filter_str)
 {
-    filter = filter_str.toLower();
-    invalidate();
+    pendingFilter = filter_str.toLower();
+    filterTimer->start();
+}
+
+void CredentialsFilterModel::applyFilter()
+{
+    if (pendingFilter == filter && matchesValid)
+        return;
+
+    //Rows not matching the previous filter can't match a longer one
+    narrowing = matchesValid && pendingFilter.contains(filter);
+    if (narrowing)
+        previousMatches = matches;
+
+    filter = pendingFilter;
+    matches.fill(false, sourceModel() ? sourceModel()->rowCount() : 0);
+
+    invalidateFilter();
+
+    narrowing = false;
+    previousMatches.clear();
+    matchesValid = true;
 }
 
 int CredentialsFilterModel::indexToSource(int idx)
@@ -44,18 +86,23 @@ bool CredentialsFilterModel::filterAcceptsRow(int source_row, const QModelIndex
 {
     Q_UNUSED(source_parent)
 
-    //shortcut
-    if (filter.isEmpty())
-        return true;
+    if (source_row >= matches.size())
+        matches.resize(source_row + 1);
+
+    if (narrowing && (source_row >= previousMatches.size() || !previousMatches.at(source_row)))
+    {
+        matches[source_row] = false;
+        return false;
+    }
 
     CredentialsModel *credModel = qobject_cast<CredentialsModel *>(sourceModel());
 
-    for(int idx : {CredentialsModel::ServiceIdx, CredentialsModel::LoginIdx, CredentialsModel::DescriptionIdx}) {
-        if(credModel->data(credModel->index(source_row, idx)).toString().toLower().contains(filter.toLower()))
-            return true;
-    }
+    //shortcut
+    bool accepted = filter.isEmpty() ||
+                    credModel->at(source_row).searchText.contains(filter);
 
-    return false;
+    matches[source_row] = accepted;
+    return accepted;
 }
 
 bool CredentialsFilterModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
@@ -94,6 +141,7 @@ void CredentialsModel::load(const QJsonArray &json)
             cred.description = cnode["description"].toString();
             cred.createdDate = QDate::fromString(cnode["date_created"].toString(), Qt::ISODate);
             cred.updatedDate = QDate::fromString(cnode["date_last_used"].toString(), Qt::ISODate);
+            updateSearchText(cred);
 
             creds.append(std::move(cred));
         }
@@ -144,25 +192,21 @@ QVariant CredentialsModel::data(const QModelIndex &index, int role) const {
 }
 
 void CredentialsModel::setClearTextPassword(const QString & service, const QString & login, const QString & password) {
-    auto it = std::find_if(std::begin(m_credentials), std::end(m_credentials), [&login, &service](const Credential & c) {
-        return c.login == login && c.service == service;
-    });
-    if(it != std::end(m_credentials)) {
-        const auto idx = it - std::begin(m_credentials);
-        it->password = password;
+    const int idx = m_index.value(CredentialKey(service, login), -1);
+    if(idx >= 0) {
+        m_credentials[idx].password = password;
         Q_EMIT dataChanged(index(idx, PasswordIdx),index(idx, PasswordIdx));
     }
 }
 
 
 void CredentialsModel::update(const QString & service, const QString & login, const QString & description) {
-    auto it = std::find_if(std::begin(m_credentials), std::end(m_credentials), [&login, &service](const Credential & c) {
-        return c.login == login && c.service == service;
-    });
-    if(it != std::end(m_credentials)) {
-        const auto idx = it - std::begin(m_credentials);
-        it->description = description;
-        it->password.clear();
+    const int idx = m_index.value(CredentialKey(service, login), -1);
+    if(idx >= 0) {
+        Credential &cred = m_credentials[idx];
+        cred.description = description;
+        cred.password.clear();
+        updateSearchText(cred);
         Q_EMIT dataChanged(index(idx, PasswordIdx),index(idx, DescriptionIdx));
     }
     else {
@@ -170,7 +214,9 @@ void CredentialsModel::update(const QString & service, const QString & login, co
         c.service = service;
         c.login = login;
         c.description = description;
+        updateSearchText(c);
         beginInsertRows(QModelIndex(), m_credentials.size(), m_credentials.size());
+        m_index.insert(keyOf(c), m_credentials.size());
         m_credentials << c;
         endInsertRows();
     }
@@ -179,41 +225,82 @@ void CredentialsModel::update(const QString & service, const QString & login, co
 
 void  CredentialsModel::mergeWith(const QVector<Credential> & newCreds) {
 
-    for(const Credential & newCred: newCreds) {
-        auto it = std::find_if(std::begin(m_credentials), std::end(m_credentials), [&newCred](const Credential & c) {
-            return c.login == newCred.login && c.service == newCred.service;
-        });
-        if(it == std::end(m_credentials)) {
-            beginInsertRows(QModelIndex(), m_credentials.size(), m_credentials.size());
-            m_credentials << newCred;
-            endInsertRows();
+    //Index of the new credentials, if a service/login is there twice the last one is kept
+    QHash<CredentialKey, int> newIndex;
+    newIndex.reserve(newCreds.size());
+    for(int i = 0; i < newCreds.size(); i++)
+        newIndex.insert(keyOf(newCreds.at(i)), i);
+
+    //Remove the credentials not there anymore, one notification for each
+    //range of rows. Start from the end so that row numbers stay valid.
+    int row = m_credentials.size() - 1;
+    while(row >= 0) {
+        if(newIndex.contains(keyOf(m_credentials.at(row)))) {
+            row--;
             continue;
         }
-        if(it->description != newCred.description || it->createdDate != newCred.createdDate || it->updatedDate != newCred.updatedDate){
-            *it = newCred;
-            const auto idx = it - std::begin(m_credentials);
-            dataChanged(index(idx, LoginIdx +1), index(idx, ColumnCount-1));
+        const int last = row;
+        while(row > 0 && !newIndex.contains(keyOf(m_credentials.at(row - 1))))
+            row--;
+        beginRemoveRows({}, row, last);
+        m_credentials.remove(row, last - row + 1);
+        endRemoveRows();
+        row--;
+    }
+    rebuildIndex();
+
+    //Update the remaining ones, contiguous changed rows are notified together
+    QVector<bool> known(newCreds.size(), false);
+    int changedFirst = -1;
+    auto notifyChanged = [this, &changedFirst](int changedLast) {
+        if(changedFirst >= 0)
+            Q_EMIT dataChanged(index(changedFirst, LoginIdx +1), index(changedLast, ColumnCount-1));
+        changedFirst = -1;
+    };
+    for(int i = 0; i < m_credentials.size(); i++) {
+        Credential &cred = m_credentials[i];
+        const int j = newIndex.value(keyOf(cred));
+        known[j] = true;
+        const Credential &newCred = newCreds.at(j);
+        if(cred.description != newCred.description || cred.createdDate != newCred.createdDate || cred.updatedDate != newCred.updatedDate) {
+            cred = newCred;
+            if(changedFirst < 0)
+                changedFirst = i;
+        }
+        else {
+            notifyChanged(i - 1);
         }
     }
-    if(newCreds.size() != m_credentials.size()) {
-        QVector<Credential>::size_type idx = 0;
-        while(idx < m_credentials.size())  {
-            const Credential & oldCred = m_credentials.at(idx);
-            auto it = std::find_if(std::begin(newCreds), std::end(newCreds), [&oldCred](const Credential & c) {
-                return c.login == oldCred.login && c.service == oldCred.service;
-            });
-            if(it == std::end(newCreds)) {
-                beginRemoveRows({}, idx, idx);
-                m_credentials.remove(idx);
-                endRemoveRows();
-            }
-            else  {
-                idx++;
-            }
+    notifyChanged(m_credentials.size() - 1);
+
+    //Append the new ones at once
+    QVector<Credential> added;
+    for(int j = 0; j < newCreds.size(); j++) {
+        if(!known.at(j) && newIndex.value(keyOf(newCreds.at(j))) == j)
+            added << newCreds.at(j);
+    }
+    if(!added.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_credentials.size(), m_credentials.size() + added.size() - 1);
+        for(const Credential & c: added) {
+            m_index.insert(keyOf(c), m_credentials.size());
+            m_credentials << c;
         }
+        endInsertRows();
     }
 }
 
+void CredentialsModel::rebuildIndex() {
+    m_index.clear();
+    m_index.reserve(m_credentials.size());
+    for(int i = 0; i < m_credentials.size(); i++)
+        m_index.insert(keyOf(m_credentials.at(i)), i);
+}
+
 auto CredentialsModel::at(int idx) const  -> const Credential & {
     return m_credentials.at(idx);
 }
+
+void CredentialsModel::updateSearchText(Credential &cred) {
+    //Fields are separated so that a filter can't match across two of them
+    cred.searchText = QStringLiteral("%1\n%2\n%3").arg(cred.service, cred.login, cred.description).toLower();
+}
@@ -22,6 +22,10 @@
 #include <QtCore>
 #include <QStandardItemModel>
 
+//Filter on service, login and description.
+//The filter is applied after a short delay so that typing is not slowed down,
+//and when the new filter extends the previous one only the rows that were
+//matching are checked again.
 class CredentialsFilterModel: public QSortFilterProxyModel
 {
     Q_OBJECT
@@ -30,6 +34,8 @@ public:
 
     void setFilter(const QString &filter_str);
 
+    void setSourceModel(QAbstractItemModel *model) override;
+
     Q_INVOKABLE int indexToSource(int idx);
     Q_INVOKABLE int indexFromSource(int idx);
 
@@ -37,8 +43,20 @@ protected:
     virtual bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
     virtual bool lessThan(const QModelIndex &left, const QModelIndex &right) const;
 
+private slots:
+    void applyFilter();
+
 private:
     QString filter;
+    QString pendingFilter;
+    QTimer *filterTimer;
+
+    //Source rows matching the current filter, only valid while the
+    //source rows are not moved
+    mutable QVector<bool> matches;
+    QVector<bool> previousMatches;
+    bool matchesValid = false;
+    bool narrowing = false;
 };
 
 class CredentialsModel: public QAbstractTableModel
@@ -83,11 +101,22 @@ private:
         QString description;
         QDate createdDate;
         QDate updatedDate;
+        //Lower case service, login and description for the filter
+        QString searchText;
     };
     QVector<Credential> m_credentials;
 
+    //Row of each credential by service/login
+    typedef QPair<QString, QString> CredentialKey;
+    QHash<CredentialKey, int> m_index;
+
+    static CredentialKey keyOf(const Credential &cred) { return CredentialKey(cred.service, cred.login); }
+    void rebuildIndex();
+
     auto at(int idx) const -> const Credential&;
 
+    static void updateSearchText(Credential &cred);
+
     void mergeWith(const QVector<Credential> &);
 
     friend class CredentialsFilterModel;
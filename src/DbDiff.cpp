@@ -0,0 +1,382 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "DbDiff.h"
+#include "MPNode.h"
+#include "MPSnapshot.h"
+
+static const char *nodeTypeName(int type)
+{
+    switch (type)
+    {
+    case MPNode::NodeParent: return "parent";
+    case MPNode::NodeChild: return "child";
+    case MPNode::NodeParentData: return "data_parent";
+    case MPNode::NodeChildData: return "data_child";
+    default: return "unknown";
+    }
+}
+
+static bool isNullAddress(const QByteArray &addr)
+{
+    return addr.isEmpty() || addr == MPNode::EmptyAddress;
+}
+
+DbDiff::DbDiff()
+{
+}
+
+DbDiff::~DbDiff()
+{
+}
+
+DbDiff::Database::~Database()
+{
+    qDeleteAll(nodes);
+}
+
+bool DbDiff::load(const QString &oldPath, const QString &newPath, const QString &passphrase, QString &errstr)
+{
+    return loadDatabase(oldPath, passphrase, oldDb, errstr) &&
+           loadDatabase(newPath, passphrase, newDb, errstr);
+}
+
+bool DbDiff::loadDatabase(const QString &path, const QString &passphrase, Database &db, QString &errstr)
+{
+    MPSnapshotReader reader;
+    if (!reader.open(path, passphrase, errstr))
+    {
+        errstr = QStringLiteral("%1: %2").arg(path).arg(errstr);
+        return false;
+    }
+
+    db.ctr = reader.ctr();
+    db.startNode = reader.startNode();
+    db.startDataNode = reader.startDataNode();
+    db.favorites = reader.favorites();
+    db.cpzCtr = reader.cpzCtrValues();
+
+    for (int type = MPNode::NodeParent;type <= MPNode::NodeChildData;type++)
+    {
+        db.nodes.reserve(db.nodes.size() + reader.nodeCount(type));
+
+        bool ok = reader.forEachNode(type, [&db, type](const QByteArray &address, const QByteArray &data)
+        {
+            if (db.nodes.contains(address))
+                return;
+
+            MPNode *node = new MPNode(data, nullptr, address);
+            db.nodes.insert(address, node);
+
+            if (!node->isValid())
+                return;
+            if (type == MPNode::NodeParent && !db.services.contains(node->getService()))
+                db.services.insert(node->getService(), node);
+            else if (type == MPNode::NodeParentData && !db.dataServices.contains(node->getService()))
+                db.dataServices.insert(node->getService(), node);
+        });
+
+        if (!ok)
+        {
+            errstr = QStringLiteral("%1: invalid node blocks").arg(path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QHash<QString, MPNode *> DbDiff::Database::children(const MPNode *parent) const
+{
+    QHash<QString, MPNode *> res;
+    QSet<QByteArray> seen;
+
+    //Loops in a corrupted list are stopped by seen
+    QByteArray addr = parent->getStartChildAddress();
+    while (!isNullAddress(addr) && !seen.contains(addr))
+    {
+        seen.insert(addr);
+        MPNode *c = nodes.value(addr);
+        if (!c || c->getType() != MPNode::NodeChild)
+            break;
+        res.insert(c->getLogin(), c);
+        addr = c->getNextChildAddress();
+    }
+
+    return res;
+}
+
+QByteArray DbDiff::Database::dataContent(const MPNode *parent) const
+{
+    QByteArray res;
+    QSet<QByteArray> seen;
+
+    QByteArray addr = parent->getStartChildAddress();
+    while (!isNullAddress(addr) && !seen.contains(addr))
+    {
+        seen.insert(addr);
+        MPNode *c = nodes.value(addr);
+        if (!c || c->getType() != MPNode::NodeChildData)
+            break;
+        res.append(c->getChildData());
+        addr = c->getNextDataAddress();
+    }
+
+    return res;
+}
+
+QJsonObject DbDiff::diff() const
+{
+    QJsonObject root = diffServices();
+    root["data_nodes"] = diffDataNodes();
+    root["links"] = diffLinks();
+    root["header"] = diffHeader();
+
+    int allocated = 0, freed = 0;
+    for (auto it = newDb.nodes.constBegin();it != newDb.nodes.constEnd();it++)
+        if (!oldDb.nodes.contains(it.key())) allocated++;
+    for (auto it = oldDb.nodes.constBegin();it != oldDb.nodes.constEnd();it++)
+        if (!newDb.nodes.contains(it.key())) freed++;
+    root["nodes"] = QJsonObject{{ "allocated", allocated }, { "freed", freed }};
+
+    identical = allocated == 0 && freed == 0 &&
+                root["links"].toArray().isEmpty() &&
+                root["header"].toObject().isEmpty();
+    for (const QString &k: { "services", "logins", "data_nodes" })
+    {
+        QJsonObject o = root[k].toObject();
+        for (auto it = o.constBegin();it != o.constEnd();it++)
+            identical = identical && it.value().toArray().isEmpty();
+    }
+
+    return root;
+}
+
+static QJsonArray sortedArray(QStringList l)
+{
+    l.sort();
+    return QJsonArray::fromStringList(l);
+}
+
+QJsonObject DbDiff::diffServices() const
+{
+    QJsonArray servicesAdded, servicesRemoved;
+    QList<QPair<QString, QString>> loginsAdded, loginsRemoved;
+    QMap<QPair<QString, QString>, QStringList> loginsChanged;
+
+    QStringList added, removed;
+    for (auto it = newDb.services.constBegin();it != newDb.services.constEnd();it++)
+        if (!oldDb.services.contains(it.key())) added.append(it.key());
+    for (auto it = oldDb.services.constBegin();it != oldDb.services.constEnd();it++)
+        if (!newDb.services.contains(it.key())) removed.append(it.key());
+    added.sort();
+    removed.sort();
+
+    for (const QString &s: added)
+        servicesAdded.append(QJsonObject{{ "service", s },
+                                         { "logins", sortedArray(newDb.children(newDb.services.value(s)).keys()) }});
+    for (const QString &s: removed)
+        servicesRemoved.append(QJsonObject{{ "service", s },
+                                           { "logins", sortedArray(oldDb.children(oldDb.services.value(s)).keys()) }});
+
+    for (auto it = oldDb.services.constBegin();it != oldDb.services.constEnd();it++)
+    {
+        MPNode *newParent = newDb.services.value(it.key());
+        if (!newParent)
+            continue;
+
+        QHash<QString, MPNode *> oldChildren = oldDb.children(it.value());
+        QHash<QString, MPNode *> newChildren = newDb.children(newParent);
+
+        for (auto c = newChildren.constBegin();c != newChildren.constEnd();c++)
+            if (!oldChildren.contains(c.key())) loginsAdded.append(qMakePair(it.key(), c.key()));
+
+        for (auto c = oldChildren.constBegin();c != oldChildren.constEnd();c++)
+        {
+            MPNode *n = newChildren.value(c.key());
+            if (!n)
+            {
+                loginsRemoved.append(qMakePair(it.key(), c.key()));
+                continue;
+            }
+
+            MPNode *o = c.value();
+            QStringList fields;
+            if (o->getPasswordEnc() != n->getPasswordEnc()) fields << "password";
+            if (o->getDescription() != n->getDescription()) fields << "description";
+            if (o->getCTR() != n->getCTR()) fields << "ctr";
+            if (o->getDateCreated() != n->getDateCreated()) fields << "date_created";
+            if (o->getDateLastUsed() != n->getDateLastUsed()) fields << "date_last_used";
+            if (o->getAddress() != n->getAddress()) fields << "address";
+            if (!fields.isEmpty())
+                loginsChanged.insert(qMakePair(it.key(), c.key()), fields);
+        }
+    }
+
+    std::sort(loginsAdded.begin(), loginsAdded.end());
+    std::sort(loginsRemoved.begin(), loginsRemoved.end());
+
+    auto toJson = [](const QList<QPair<QString, QString>> &l)
+    {
+        QJsonArray a;
+        for (const auto &p: l)
+            a.append(QJsonObject{{ "service", p.first }, { "login", p.second }});
+        return a;
+    };
+
+    QJsonArray changed;
+    for (auto it = loginsChanged.constBegin();it != loginsChanged.constEnd();it++)
+        changed.append(QJsonObject{{ "service", it.key().first },
+                                   { "login", it.key().second },
+                                   { "fields", QJsonArray::fromStringList(it.value()) }});
+
+    return QJsonObject{{ "services", QJsonObject{{ "added", servicesAdded },
+                                                 { "removed", servicesRemoved }} },
+                       { "logins", QJsonObject{{ "added", toJson(loginsAdded) },
+                                               { "removed", toJson(loginsRemoved) },
+                                               { "changed", changed }} }};
+}
+
+QJsonObject DbDiff::diffDataNodes() const
+{
+    QStringList added, removed;
+    for (auto it = newDb.dataServices.constBegin();it != newDb.dataServices.constEnd();it++)
+        if (!oldDb.dataServices.contains(it.key())) added.append(it.key());
+    for (auto it = oldDb.dataServices.constBegin();it != oldDb.dataServices.constEnd();it++)
+        if (!newDb.dataServices.contains(it.key())) removed.append(it.key());
+
+    QMap<QString, QJsonObject> changed;
+    for (auto it = oldDb.dataServices.constBegin();it != oldDb.dataServices.constEnd();it++)
+    {
+        MPNode *n = newDb.dataServices.value(it.key());
+        if (!n)
+            continue;
+
+        QByteArray oldData = oldDb.dataContent(it.value());
+        QByteArray newData = newDb.dataContent(n);
+        if (oldData != newData)
+            changed.insert(it.key(), QJsonObject{{ "service", it.key() },
+                                                 { "old_size", oldData.size() },
+                                                 { "new_size", newData.size() }});
+    }
+
+    QJsonArray c;
+    for (const QJsonObject &o: changed)
+        c.append(o);
+
+    return QJsonObject{{ "added", sortedArray(added) },
+                       { "removed", sortedArray(removed) },
+                       { "changed", c }};
+}
+
+QJsonArray DbDiff::diffLinks() const
+{
+    QMap<QByteArray, QJsonArray> changes;
+
+    auto addChange = [&changes](const QByteArray &addr, int type, const char *field,
+                                const QByteArray &o, const QByteArray &n)
+    {
+        if (o == n)
+            return;
+        changes[addr].append(QJsonObject{{ "address", QString(addr.toHex()) },
+                                         { "type", nodeTypeName(type) },
+                                         { "field", field },
+                                         { "old", QString(o.toHex()) },
+                                         { "new", QString(n.toHex()) }});
+    };
+
+    for (auto it = oldDb.nodes.constBegin();it != oldDb.nodes.constEnd();it++)
+    {
+        MPNode *o = it.value();
+        MPNode *n = newDb.nodes.value(it.key());
+        if (!n)
+            continue;
+
+        int type = o->getType();
+        if (type != n->getType())
+        {
+            changes[it.key()].append(QJsonObject{{ "address", QString(it.key().toHex()) },
+                                                 { "type", nodeTypeName(type) },
+                                                 { "field", "type" },
+                                                 { "old", nodeTypeName(type) },
+                                                 { "new", nodeTypeName(n->getType()) }});
+            continue;
+        }
+
+        switch (type)
+        {
+        case MPNode::NodeParent:
+        case MPNode::NodeParentData:
+            addChange(it.key(), type, "prev_parent", o->getPreviousParentAddress(), n->getPreviousParentAddress());
+            addChange(it.key(), type, "next_parent", o->getNextParentAddress(), n->getNextParentAddress());
+            addChange(it.key(), type, "start_child", o->getStartChildAddress(), n->getStartChildAddress());
+            break;
+        case MPNode::NodeChild:
+            addChange(it.key(), type, "prev_child", o->getPreviousChildAddress(), n->getPreviousChildAddress());
+            addChange(it.key(), type, "next_child", o->getNextChildAddress(), n->getNextChildAddress());
+            break;
+        case MPNode::NodeChildData:
+            addChange(it.key(), type, "next_data", o->getNextDataAddress(), n->getNextDataAddress());
+            break;
+        default:
+            break;
+        }
+    }
+
+    QJsonArray res;
+    for (const QJsonArray &a: changes)
+        for (const QJsonValue &v: a)
+            res.append(v);
+    return res;
+}
+
+QJsonObject DbDiff::diffHeader() const
+{
+    QJsonObject res;
+
+    auto addChange = [&res](const char *field, const QByteArray &o, const QByteArray &n)
+    {
+        if (o != n)
+            res[field] = QJsonObject{{ "old", QString(o.toHex()) }, { "new", QString(n.toHex()) }};
+    };
+
+    addChange("ctr", oldDb.ctr, newDb.ctr);
+    addChange("start_node", oldDb.startNode, newDb.startNode);
+    addChange("start_data_node", oldDb.startDataNode, newDb.startDataNode);
+
+    QJsonArray favs;
+    for (int i = 0;i < qMax(oldDb.favorites.size(), newDb.favorites.size());i++)
+    {
+        QByteArray o = oldDb.favorites.value(i);
+        QByteArray n = newDb.favorites.value(i);
+        if (o != n)
+            favs.append(QJsonObject{{ "index", i },
+                                    { "old", QString(o.toHex()) },
+                                    { "new", QString(n.toHex()) }});
+    }
+    if (!favs.isEmpty())
+        res["favorites"] = favs;
+
+    QSet<QByteArray> oldCpz = oldDb.cpzCtr.toSet();
+    QSet<QByteArray> newCpz = newDb.cpzCtr.toSet();
+    if (oldCpz != newCpz)
+        res["cpz_ctr"] = QJsonObject{{ "added", QSet<QByteArray>(newCpz).subtract(oldCpz).size() },
+                                     { "removed", QSet<QByteArray>(oldCpz).subtract(newCpz).size() }};
+
+    return res;
+}
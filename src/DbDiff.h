@@ -0,0 +1,75 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef DBDIFF_H
+#define DBDIFF_H
+
+#include "Common.h"
+
+class MPNode;
+
+//Compare two database snapshots (see MPSnapshot.h) without a device.
+//Nodes are indexed by address, services and logins in hash tables and
+//the linked lists are walked once, the diff is linear in the number of nodes.
+class DbDiff
+{
+public:
+    DbDiff();
+    ~DbDiff();
+
+    bool load(const QString &oldPath, const QString &newPath, const QString &passphrase, QString &errstr);
+
+    //Structured diff: services, logins, data nodes, link pointers, favorites
+    //and header values. Lists are sorted so the output is stable
+    QJsonObject diff() const;
+
+    //True if the last diff() found no change
+    bool isIdentical() const { return identical; }
+
+private:
+    Q_DISABLE_COPY(DbDiff)
+
+    struct Database
+    {
+        QHash<QByteArray, MPNode *> nodes; //by address
+        QHash<QString, MPNode *> services;
+        QHash<QString, MPNode *> dataServices;
+        QByteArray ctr;
+        QByteArray startNode;
+        QByteArray startDataNode;
+        QList<QByteArray> favorites;
+        QList<QByteArray> cpzCtr;
+
+        ~Database();
+        QHash<QString, MPNode *> children(const MPNode *parent) const;
+        QByteArray dataContent(const MPNode *parent) const;
+    };
+
+    static bool loadDatabase(const QString &path, const QString &passphrase, Database &db, QString &errstr);
+
+    QJsonObject diffServices() const;
+    QJsonObject diffDataNodes() const;
+    QJsonArray diffLinks() const;
+    QJsonObject diffHeader() const;
+
+    Database oldDb;
+    Database newDb;
+    mutable bool identical = true;
+};
+
+#endif // DBDIFF_H
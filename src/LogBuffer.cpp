@@ -0,0 +1,84 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "LogBuffer.h"
+
+LogBuffer::LogBuffer(int capacity)
+{
+    buffer.resize(capacity);
+}
+
+void LogBuffer::append(const QByteArray &data)
+{
+    const int capacity = buffer.size();
+    if (capacity == 0 || data.isEmpty())
+        return;
+
+    //Only the end of the data fits
+    if (data.size() >= capacity)
+    {
+        memcpy(buffer.data(), data.constData() + data.size() - capacity, capacity);
+        start = 0;
+        used = capacity;
+        wrapped = true;
+        return;
+    }
+
+    //Copy in two parts if the data goes over the end of the buffer
+    int pos = (start + used) % capacity;
+    int first = qMin(data.size(), capacity - pos);
+    memcpy(buffer.data() + pos, data.constData(), first);
+    memcpy(buffer.data(), data.constData() + first, data.size() - first);
+
+    int overflow = used + data.size() - capacity;
+    if (overflow > 0)
+    {
+        start = (start + overflow) % capacity;
+        used = capacity;
+        wrapped = true;
+    }
+    else
+        used += data.size();
+}
+
+QByteArray LogBuffer::data() const
+{
+    const int capacity = buffer.size();
+    int first = qMin(used, capacity - start);
+
+    QByteArray out;
+    out.reserve(used);
+    out.append(buffer.constData() + start, first);
+    out.append(buffer.constData(), used - first);
+
+    //First line was partially overwritten
+    if (wrapped)
+    {
+        int nl = out.indexOf('\n');
+        out.remove(0, nl + 1);
+    }
+
+    return out;
+}
+
+void LogBuffer::clear()
+{
+    start = 0;
+    used = 0;
+    wrapped = false;
+}
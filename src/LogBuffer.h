@@ -0,0 +1,46 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include <QtCore>
+
+//Fixed size circular buffer keeping the last bytes of a log.
+//Appending never moves the bytes already stored, the oldest
+//ones are overwritten when the buffer is full.
+class LogBuffer
+{
+public:
+    explicit LogBuffer(int capacity);
+
+    void append(const QByteArray &data);
+
+    //Buffer content from the oldest complete line
+    QByteArray data() const;
+
+    void clear();
+
+private:
+    QByteArray buffer;
+    int start = 0;
+    int used = 0;
+    bool wrapped = false;
+};
+
+#endif // LOGBUFFER_H
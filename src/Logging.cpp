@@ -0,0 +1,254 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "Logging.h"
+#include "AsyncLogger.h"
+#include <string.h>
+
+#ifdef Q_OS_WIN_DISABLE_FOR_NOW
+#define COLOR_LIGHTRED
+#define COLOR_RED
+#define COLOR_LIGHTBLUE
+#define COLOR_BLUE
+#define COLOR_GREEN
+#define COLOR_YELLOW
+#define COLOR_ORANGE
+#define COLOR_WHITE
+#define COLOR_LIGHTCYAN
+#define COLOR_CYAN
+#define COLOR_RESET
+#define COLOR_HIGH
+#else
+#define COLOR_LIGHTRED  "\033[31;1m"
+#define COLOR_RED       "\033[31m"
+#define COLOR_LIGHTBLUE "\033[34;1m"
+#define COLOR_BLUE      "\033[34m"
+#define COLOR_GREEN     "\033[32;1m"
+#define COLOR_YELLOW    "\033[33;1m"
+#define COLOR_ORANGE    "\033[0;33m"
+#define COLOR_WHITE     "\033[37;1m"
+#define COLOR_LIGHTCYAN "\033[36;1m"
+#define COLOR_CYAN      "\033[36m"
+#define COLOR_RESET     "\033[0m"
+#define COLOR_HIGH      "\033[1m"
+#endif
+
+Q_LOGGING_CATEGORY(lcDevice, "mc.device", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcNode, "mc.node", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcData, "mc.data", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcUsb, "mc.usb", QtInfoMsg)
+
+QByteArray Logging::formatRecord(const LogRecord &rec, bool colors)
+{
+    const char *fname = rec.file ? rec.file : "";
+    const char *sep = strrchr(fname, '\\');
+    if (sep)
+        fname = sep + 1;
+
+    const char *level;
+    switch (rec.type) {
+    default:
+    case QtDebugMsg: level = colors ? COLOR_CYAN "DEBUG" COLOR_RESET : "DEBUG"; break;
+    case QtInfoMsg: level = colors ? COLOR_GREEN "INFO" COLOR_RESET : "INFO"; break;
+    case QtWarningMsg: level = colors ? COLOR_YELLOW "WARNING" COLOR_RESET : "WARNING"; break;
+    case QtCriticalMsg: level = colors ? COLOR_ORANGE "CRITICAL" COLOR_RESET : "CRITICAL"; break;
+    case QtFatalMsg: level = colors ? COLOR_RED "FATAL" COLOR_RESET : "FATAL"; break;
+    }
+
+    QByteArray s;
+    s.reserve(qstrlen(level) + qstrlen(fname) + rec.message.size() + 64);
+    s.append(level).append(": ");
+
+    //Messages from qDebug() and friends don't show their category
+    if (rec.category && qstrcmp(rec.category, "default"))
+        s.append('[').append(rec.category).append("] ");
+
+    s.append(fname).append(':').append(QByteArray::number(rec.line))
+     .append(" - ").append(rec.message);
+
+    if (rec.command >= 0 || !rec.address.isEmpty() || rec.latency >= 0)
+    {
+        s.append(" {");
+        if (rec.command >= 0)
+            s.append(" cmd=0x").append(QByteArray::number(rec.command, 16));
+        if (!rec.address.isEmpty())
+            s.append(" addr=").append(rec.address.toHex());
+        if (rec.latency >= 0)
+            s.append(" latency=").append(QByteArray::number(rec.latency)).append("ms");
+        s.append(" }");
+    }
+
+    s.append('\n');
+    return s;
+}
+
+int Logging::severity(QtMsgType type)
+{
+    switch (type) {
+    default:
+    case QtDebugMsg: return 0;
+    case QtInfoMsg: return 1;
+    case QtWarningMsg: return 2;
+    case QtCriticalMsg: return 3;
+    case QtFatalMsg: return 4;
+    }
+}
+
+bool LogSubscription::accepts(const LogRecord &rec) const
+{
+    if (Logging::severity(rec.type) < Logging::severity(minLevel))
+        return false;
+    if (categories.isEmpty())
+        return true;
+
+    const char *name = rec.category ? rec.category : "default";
+    for (const QByteArray &c: categories)
+    {
+        if (qstrncmp(name, c.constData(), c.size()) == 0 &&
+            (name[c.size()] == '\0' || name[c.size()] == '.'))
+            return true;
+    }
+    return false;
+}
+
+//Max size of a frame, bigger ones are dropped
+#define LOG_FRAME_MAX_SIZE  (1024 * 1024)
+
+static QByteArray rawString(const char *s)
+{
+    return s ? QByteArray::fromRawData(s, qstrlen(s)) : QByteArray();
+}
+
+static void setFrameSize(QByteArray &frame)
+{
+    qToBigEndian<quint32>(frame.size() - sizeof(quint32), reinterpret_cast<uchar *>(frame.data()));
+}
+
+QByteArray Logging::encodeRecord(const LogRecord &rec)
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << quint32(0) << quint8(FrameRecord)
+        << rec.timestamp << quint8(rec.type)
+        << rawString(rec.category) << rawString(rec.file) << qint32(rec.line)
+        << rec.message
+        << qint32(rec.command) << rec.address << rec.latency;
+
+    setFrameSize(frame);
+    return frame;
+}
+
+QByteArray Logging::encodeSubscription(const LogSubscription &sub)
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << quint32(0) << quint8(FrameSubscribe)
+        << quint8(sub.minLevel) << sub.categories;
+
+    setFrameSize(frame);
+    return frame;
+}
+
+bool Logging::readFrame(QIODevice *dev, QByteArray &payload)
+{
+    if (dev->bytesAvailable() < (qint64)sizeof(quint32))
+        return false;
+
+    QByteArray header = dev->peek(sizeof(quint32));
+    quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(header.constData()));
+
+    if (size > LOG_FRAME_MAX_SIZE)
+    {
+        //Not a valid stream, nothing can be read after that
+        qWarning() << "Invalid log frame size:" << size;
+        dev->readAll();
+        return false;
+    }
+
+    if (dev->bytesAvailable() < (qint64)(sizeof(quint32) + size))
+        return false;
+
+    dev->read(sizeof(quint32));
+    payload = dev->read(size);
+    return true;
+}
+
+bool Logging::decodeRecord(const QByteArray &payload, LogRecord &rec, QByteArray &category, QByteArray &file)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint8 frameType, type;
+    qint32 line, command;
+    in >> frameType;
+    if (frameType != FrameRecord)
+        return false;
+
+    in >> rec.timestamp >> type >> category >> file >> line
+       >> rec.message >> command >> rec.address >> rec.latency;
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    rec.type = QtMsgType(type);
+    rec.category = category.isNull() ? nullptr : category.constData();
+    rec.file = file.isNull() ? nullptr : file.constData();
+    rec.line = line;
+    rec.command = command;
+    return true;
+}
+
+bool Logging::decodeSubscription(const QByteArray &payload, LogSubscription &sub)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint8 frameType, level;
+    in >> frameType;
+    if (frameType != FrameSubscribe)
+        return false;
+
+    in >> level >> sub.categories;
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    sub.minLevel = QtMsgType(level);
+    return true;
+}
+
+LogBuilder::LogBuilder(QtMsgType type, const QLoggingCategory &cat, const char *file, int line):
+    dbg(&buffer)
+{
+    rec.timestamp = QDateTime::currentMSecsSinceEpoch();
+    rec.type = type;
+    rec.category = cat.categoryName();
+    rec.file = file;
+    rec.line = line;
+}
+
+LogBuilder::~LogBuilder()
+{
+    //QDebug adds a space after each item
+    if (buffer.endsWith(QLatin1Char(' ')))
+        buffer.chop(1);
+    rec.message = buffer.toUtf8();
+    AsyncLogger::Instance()->log(rec);
+}
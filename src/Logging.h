@@ -0,0 +1,129 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QtCore>
+
+//Logging categories, their levels can be changed at runtime with
+//QLoggingCategory::setFilterRules() or QT_LOGGING_RULES, ex: "mc.node.debug=true"
+//Debug records of mc.* categories are disabled by default.
+Q_DECLARE_LOGGING_CATEGORY(lcDevice)
+Q_DECLARE_LOGGING_CATEGORY(lcNode)
+Q_DECLARE_LOGGING_CATEGORY(lcData)
+Q_DECLARE_LOGGING_CATEGORY(lcUsb)
+
+//A log record as queued to the logger thread. Text formatting
+//is done by the logger, records keep typed fields
+struct LogRecord
+{
+    qint64 timestamp = 0; //ms since epoch
+    QtMsgType type = QtDebugMsg;
+    const char *category = nullptr; //category names and file names are static strings
+    const char *file = nullptr;
+    int line = 0;
+    QByteArray message;
+
+    //Optional fields
+    int command = -1;
+    QByteArray address;
+    qint64 latency = -1; //ms
+};
+Q_DECLARE_METATYPE(LogRecord)
+
+//Records wanted by a client of the log socket
+struct LogSubscription
+{
+    QtMsgType minLevel = QtDebugMsg;
+    //Category names or prefixes ("mc" matches "mc.node"), all categories if empty
+    QList<QByteArray> categories;
+
+    bool accepts(const LogRecord &rec) const;
+};
+
+namespace Logging
+{
+    //Format a record as a text line: "LEVEL: [category] file:line - message {fields}\n"
+    //The level is colored with ANSI escapes for terminals when colors is true
+    QByteArray formatRecord(const LogRecord &rec, bool colors = true);
+
+    //QtMsgType values are not ordered by severity
+    int severity(QtMsgType type);
+
+    //Log socket protocol. A frame is a 32 bits big endian payload size followed
+    //by the payload, a QDataStream starting with the frame type.
+    //Clients send a subscribe frame to change their filter (all records by
+    //default), the daemon sends record frames.
+    enum FrameType
+    {
+        FrameSubscribe = 1,
+        FrameRecord = 2
+    };
+
+    QByteArray encodeRecord(const LogRecord &rec);
+    QByteArray encodeSubscription(const LogSubscription &sub);
+
+    //Read the payload of the next frame if it is fully received
+    bool readFrame(QIODevice *dev, QByteArray &payload);
+
+    //Category and file of the decoded record point to the data of category and file
+    bool decodeRecord(const QByteArray &payload, LogRecord &rec, QByteArray &category, QByteArray &file);
+    bool decodeSubscription(const QByteArray &payload, LogSubscription &sub);
+}
+
+//Builds a record with the streaming operators of QDebug
+//and queues it to the logger thread when destroyed
+class LogBuilder
+{
+public:
+    LogBuilder(QtMsgType type, const QLoggingCategory &cat, const char *file, int line);
+    ~LogBuilder();
+
+    LogBuilder &command(quint8 cmd) { rec.command = cmd; return *this; }
+    LogBuilder &address(const QByteArray &addr) { rec.address = addr; return *this; }
+    LogBuilder &latency(qint64 ms) { rec.latency = ms; return *this; }
+
+    template<typename T>
+    LogBuilder &operator<<(const T &v) { dbg << v; return *this; }
+
+private:
+    Q_DISABLE_COPY(LogBuilder)
+
+    LogRecord rec;
+    QString buffer;
+    QDebug dbg;
+};
+
+//Use like qCDebug: mcDebug(lcNode).address(addr) << "node loaded:" << name;
+//Nothing after the macro is evaluated when the level is disabled for the category.
+//Building with CONFIG+=strip_debug_logs removes debug records from the binary.
+#define MC_LOG(type, enabled, cat) \
+    for (bool mcLogEnabled = cat().enabled(); mcLogEnabled; mcLogEnabled = false) \
+        LogBuilder(type, cat(), __FILE__, __LINE__)
+
+#ifdef MC_STRIP_DEBUG_LOGS
+#define mcDebug(cat) while (false) LogBuilder(QtDebugMsg, cat(), __FILE__, __LINE__)
+#else
+#define mcDebug(cat) MC_LOG(QtDebugMsg, isDebugEnabled, cat)
+#endif
+#define mcInfo(cat) MC_LOG(QtInfoMsg, isInfoEnabled, cat)
+#define mcWarning(cat) MC_LOG(QtWarningMsg, isWarningEnabled, cat)
+#define mcCritical(cat) MC_LOG(QtCriticalMsg, isCriticalEnabled, cat)
+
+#endif // LOGGING_H
@@ -17,10 +17,23 @@
  **
  ******************************************************************************/
 #include "MPDevice.h"
+#include "Logging.h"
 #include <functional>
 
 const QRegularExpression regVersion("v([0-9]+)\\.([0-9]+)(.*)");
 
+//Bytes returned by MP_GET_RANDOM_NUMBER
+#define RANDOM_NUMBERS_SIZE         32
+//Max commands of one prefetch job, so other requests do not wait too long
+#define RANDOM_POOL_MAX_FETCH       4
+#define RANDOM_POOL_CHECK_INTERVAL  2000
+//Bytes of image data in one export/import packet
+#define IMAGE_PACKET_SIZE           62
+//EEPROM size, the flash size depends on the device
+#define IMAGE_EEPROM_SIZE           1024
+//Bytes of node data in one MP_WRITE_FLASH_NODE packet, after address and packet index
+#define NODE_WRITE_PACKET_SIZE      59
+
 MPDevice::MPDevice(QObject *parent):
     QObject(parent)
 {
@@ -60,8 +73,32 @@ MPDevice::MPDevice(QObject *parent):
         });
     });
 
+    //Check from time to time if the random pool needs to be filled
+    randomPoolTimer = new QTimer(this);
+    randomPoolTimer->start(RANDOM_POOL_CHECK_INTERVAL);
+    connect(randomPoolTimer, &QTimer::timeout, this, &MPDevice::prefetchRandomNumbers);
+
     connect(this, SIGNAL(platformDataRead(QByteArray)), this, SLOT(newDataRead(QByteArray)));
 
+    connect(this, &MPDevice::statusChanged, [=]()
+    {
+        //card removed or device locked, user may change
+        if (get_status() != Common::Unlocked)
+            invalidateServiceIndex();
+    });
+
+    //The service index is only valid for the db change numbers it was built for
+    connect(this, &MPDevice::credentialsDbChangeNumberChanged, [=](quint8 nb)
+    {
+        if (serviceIndexValid && nb != serviceIndexCredentialsChangeNb)
+            invalidateServiceIndex();
+    });
+    connect(this, &MPDevice::dataDbChangeNumberChanged, [=](quint8 nb)
+    {
+        if (serviceIndexValid && nb != serviceIndexDataChangeNb)
+            invalidateServiceIndex();
+    });
+
 //    connect(this, SIGNAL(platformFailed()), this, SLOT(commandFailed()));
 
     QTimer::singleShot(100, [this]() { exitMemMgmtMode(false); });
@@ -69,6 +106,22 @@ MPDevice::MPDevice(QObject *parent):
 
 MPDevice::~MPDevice()
 {
+    delete trace;
+}
+
+bool MPDevice::startTrace(const QString &path, QString &errstr)
+{
+    MPTraceFile *t = new MPTraceFile();
+    if (!t->create(path, errstr))
+    {
+        delete t;
+        return false;
+    }
+
+    delete trace;
+    trace = t;
+    qInfo() << "Recording USB trace to" << path;
+    return true;
 }
 
 void MPDevice::sendData(unsigned char c, const QByteArray &data, MPCommandCb cb)
@@ -99,9 +152,12 @@ void MPDevice::sendDataDequeue()
 
     MPCommand &currentCmd = commandQueue.head();
     currentCmd.running = true;
+    currentCmd.timer.start();
 
     // send data with platform code
-    //qDebug() << "Platform send command: " << QString("0x%1").arg((quint8)currentCmd.data[1], 2, 16, QChar('0'));
+    mcDebug(lcUsb).command((quint8)currentCmd.data[MP_CMD_FIELD_INDEX]) << "Platform send command";
+    if (trace)
+        trace->record(MPTraceFile::Out, currentCmd.data);
     platformWrite(currentCmd.data);
 }
 
@@ -533,6 +589,9 @@ void MPDevice::newDataRead(const QByteArray &data)
     //we assume that the QByteArray size is at least 64 bytes
     //this should be done by the platform code
 
+    if (trace)
+        trace->record(MPTraceFile::In, data);
+
     //qWarning() << "---> Packet data " << " size:" << (quint8)data[0] << " data:" << QString("0x%1").arg((quint8)data[1], 2, 16, QChar('0'));
     if ((quint8)data[1] == MP_DEBUG)
         qWarning() << data;
@@ -551,6 +610,8 @@ void MPDevice::newDataRead(const QByteArray &data)
 
     if (done)
     {
+        mcDebug(lcUsb).command((quint8)currentCmd.data[MP_CMD_FIELD_INDEX]).latency(currentCmd.timer.elapsed())
+                << "command done";
         commandQueue.dequeue();
         sendDataDequeue();
     }
@@ -703,6 +764,8 @@ void MPDevice::memMgmtModeReadFlash(AsyncJobs *jobs, bool fullScan, std::functio
 {
     /* For when the MMM is left */
     newAddressesNeededCounter = 0;
+    freeAddresses.clear();
+    freeAddresses.append(QByteArray());
 
     /* Get CTR value */
     jobs->append(new MPCommandJob(this, MP_GET_CTRVALUE,
@@ -934,13 +997,15 @@ void MPDevice::memMgmtModeReadFlash(AsyncJobs *jobs, bool fullScan, std::functio
     }));
 }
 
-void MPDevice::startMemMgmtMode(std::function<void(int total, int current)> cbProgress)
+void MPDevice::startMemMgmtMode(std::function<void(bool success, QString errstr)> cb,
+                                std::function<void(int total, int current)> cbProgress)
 {
     /* Start MMM here, and load all memory data from the device */
 
     /* If we're already in MMM, return */
     if (get_memMgmtMode())
     {
+        cb(true, QString());
         return;
     }
 
@@ -960,13 +1025,14 @@ void MPDevice::startMemMgmtMode(std::function<void(int total, int current)> cbPr
         //all jobs finished success
 
         qInfo() << "Mem management mode enabled";
+        cb(true, QString());
         force_memMgmtMode(true);
     });
 
     connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
     {
-        Q_UNUSED(failedJob);
         qCritical() << "Setting device in MMM failed";
+        cb(false, failedJob->getErrorStr());
 
         /* Cleaning all temp values */
         ctrValue.clear();
@@ -1071,7 +1137,7 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
     /* Because of recursive calls, make sure we haven't reached the end of the memory */
     if (getFlashPageFromAddress(address) == getNumberOfPages())
     {
-        qDebug() << "Reached the end of flash memory";
+        mcDebug(lcNode) << "Reached the end of flash memory";
         return;
     }
 
@@ -1082,13 +1148,12 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
         cbProgress(getNumberOfPages(), lastFlashPageScanned);
     }
 
-    //qDebug() << "Loading Node" << getNodeIdFromAddress(address) << "at page" << getFlashPageFromAddress(address);
-    Q_UNUSED(cbProgress);
+    mcDebug(lcNode).address(address) << "Loading Node" << getNodeIdFromAddress(address) << "at page" << getFlashPageFromAddress(address);
 
     /* For performance diagnostics */
     if (diagLastSecs != QDateTime::currentMSecsSinceEpoch()/1000)
     {
-        qInfo() << "Current transfer speed:" << diagNbBytesRec << "B/s";
+        mcInfo(lcNode) << "Current transfer speed:" << diagNbBytesRec << "B/s";
         diagLastSecs = QDateTime::currentMSecsSinceEpoch()/1000;
         diagNbBytesRec = 0;
     }
@@ -1111,7 +1176,7 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
         else if (data[MP_LEN_FIELD_INDEX] == 1)
         {
             /* Received one byte as answer: we are not allowed to read */
-            //qDebug() << "Loading Node" << getNodeIdFromAddress(address) << "at page" << getFlashPageFromAddress(address) << ": we are not allowed to read there";
+            mcDebug(lcNode).address(address) << "we are not allowed to read there";
 
             /* No point in keeping these nodes, simply delete them */
             delete pnodeClone;
@@ -1138,7 +1203,7 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
                 // Node is loaded
                 if (!pnode->isValid())
                 {
-                    //qDebug() << address.toHex() << ": empty node loaded";
+                    mcDebug(lcNode).address(address) << "empty node loaded";
 
                     /* No point in keeping these nodes, simply delete them */
                     delete pnodeClone;
@@ -1150,28 +1215,28 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
                     {
                         case MPNode::NodeParent :
                         {
-                            qDebug() << address.toHex() << ": parent node loaded:" << pnode->getService();
+                            mcDebug(lcNode).address(address) << "parent node loaded:" << pnode->getService();
                             loginNodesClone.append(pnodeClone);
                             loginNodes.append(pnode);
                             break;
                         }
                         case MPNode::NodeChild :
                         {
-                            qDebug() << address.toHex() << ": child node loaded:" << pnode->getLogin();
+                            mcDebug(lcNode).address(address) << "child node loaded:" << pnode->getLogin();
                             loginChildNodesClone.append(pnodeClone);
                             loginChildNodes.append(pnode);
                             break;
                         }
                         case MPNode::NodeParentData :
                         {
-                            qDebug() << address.toHex() << ": data parent node loaded:" << pnode->getService();
+                            mcDebug(lcNode).address(address) << "data parent node loaded:" << pnode->getService();
                             dataNodesClone.append(pnodeClone);
                             dataNodes.append(pnode);
                             break;
                         }
                         case MPNode::NodeChildData :
                         {
-                            qDebug() << address.toHex() << ": data child node loaded";
+                            mcDebug(lcNode).address(address) << "data child node loaded";
                             dataChildNodesClone.append(pnodeClone);
                             dataChildNodes.append(pnode);
                             break;
@@ -1192,7 +1257,7 @@ void MPDevice::loadSingleNodeAndScan(AsyncJobs *jobs, const QByteArray &address,
 
 void MPDevice::loadLoginNode(AsyncJobs *jobs, const QByteArray &address, std::function<void(int total, int current)> cbProgress)
 {    
-    qDebug() << "Loading cred parent node at address: " << address.toHex();
+    mcDebug(lcNode).address(address) << "Loading cred parent node";
 
     /* Create new parent node, append to list */
     MPNode *pnode = new MPNode(this, address);
@@ -1241,16 +1306,16 @@ void MPDevice::loadLoginNode(AsyncJobs *jobs, const QByteArray &address, std::fu
             else
             {
                 //Node is loaded
-                qDebug() << address.toHex() << ": parent node loaded:" << pnode->getService();
+                mcDebug(lcNode).address(address) << "parent node loaded:" << pnode->getService();
 
                 if (pnode->getStartChildAddress() != MPNode::EmptyAddress)
                 {
-                    qDebug() << pnode->getService() << ": loading child nodes...";
+                    mcDebug(lcNode) << pnode->getService() << ": loading child nodes...";
                     loadLoginChildNode(jobs, pnode, pnodeClone, pnode->getStartChildAddress());
                 }
                 else
                 {
-                    qDebug() << "Parent does not have childs.";
+                    mcDebug(lcNode) << "Parent does not have childs.";
                 }
 
                 //Load next parent
@@ -1267,7 +1332,7 @@ void MPDevice::loadLoginNode(AsyncJobs *jobs, const QByteArray &address, std::fu
 
 void MPDevice::loadLoginChildNode(AsyncJobs *jobs, MPNode *parent, MPNode *parentClone, const QByteArray &address)
 {
-    qDebug() << "Loading cred child node at address:" << address.toHex();
+    mcDebug(lcNode).address(address) << "Loading cred child node";
 
     /* Create empty child node and add it to the list */
     MPNode *cnode = new MPNode(this, address);
@@ -1310,7 +1375,7 @@ void MPDevice::loadLoginChildNode(AsyncJobs *jobs, MPNode *parent, MPNode *paren
             else
             {
                 //Node is loaded
-                qDebug() << address.toHex() << ": child node loaded:" << cnode->getLogin();
+                mcDebug(lcNode).address(address) << "child node loaded:" << cnode->getLogin();
 
                 //Load next child
                 if (cnode->getNextChildAddress() != MPNode::EmptyAddress)
@@ -1331,7 +1396,7 @@ void MPDevice::loadDataNode(AsyncJobs *jobs, const QByteArray &address, bool loa
     MPNode *pnodeClone = new MPNode(this, address);
     dataNodesClone.append(pnodeClone);
 
-    qDebug() << "Loading data parent node at address: " << address;
+    mcDebug(lcNode).address(address) << "Loading data parent node";
 
     jobs->append(new MPCommandJob(this, MP_READ_FLASH_NODE,
                                   address,
@@ -1369,16 +1434,16 @@ void MPDevice::loadDataNode(AsyncJobs *jobs, const QByteArray &address, bool loa
         else
         {
             //Node is loaded
-            qDebug() << "Parent data node loaded: " << pnode->getService();
+            mcDebug(lcNode).address(address) << "Parent data node loaded:" << pnode->getService();
 
             //Load data child
             if (pnode->getStartChildAddress() != MPNode::EmptyAddress && load_childs)
             {
-                qDebug() << "Loading data child nodes...";
+                mcDebug(lcNode) << "Loading data child nodes...";
                 loadDataChildNode(jobs, pnode, pnode->getStartChildAddress());
             }
             else
-                qDebug() << "Parent data node does not have childs.";
+                mcDebug(lcNode) << "Parent data node does not have childs.";
 
             //Load next parent
             if (pnode->getNextParentAddress() != MPNode::EmptyAddress)
@@ -1396,7 +1461,7 @@ void MPDevice::loadDataChildNode(AsyncJobs *jobs, MPNode *parent, const QByteArr
     dataChildNodes.append(cnode);
     dataChildNodesClone.append(cnode);
 
-    qDebug() << "Loading data child node at address: " << address;
+    mcDebug(lcNode).address(address) << "Loading data child node";
 
     jobs->prepend(new MPCommandJob(this, MP_READ_FLASH_NODE,
                                   address,
@@ -1425,7 +1490,7 @@ void MPDevice::loadDataChildNode(AsyncJobs *jobs, MPNode *parent, const QByteArr
         else
         {
             //Node is loaded
-            qDebug() << "Child data node loaded";
+            mcDebug(lcNode).address(address) << "Child data node loaded";
 
             //Load next child
             if (cnode->getNextChildDataAddress() != MPNode::EmptyAddress)
@@ -1465,6 +1530,94 @@ MPNode *MPDevice::findNodeWithServiceInList(const QString &service)
     return it == loginNodes.end()?nullptr:*it;
 }
 
+void MPDevice::buildServiceIndex()
+{
+    invalidateServiceIndex();
+
+    //Without change numbers we can't know if the db was changed
+    if (!isFw12())
+        return;
+
+    for (const MPNode *node: loginNodes)
+    {
+        credentialServicesIndex.insert(node->getService());
+        serviceMatcher.addService(node->getService());
+    }
+    for (const MPNode *node: dataNodes)
+        dataServicesIndex.insert(node->getService());
+
+    serviceIndexCredentialsChangeNb = get_credentialsDbChangeNumber();
+    serviceIndexDataChangeNb = get_dataDbChangeNumber();
+    serviceIndexValid = true;
+
+    qDebug() << "Service index built:" << credentialServicesIndex.size() << "credentials,"
+             << dataServicesIndex.size() << "data";
+}
+
+void MPDevice::invalidateServiceIndex()
+{
+    serviceIndexValid = false;
+    credentialServicesIndex.clear();
+    dataServicesIndex.clear();
+    serviceMatcher.clear();
+}
+
+QString MPDevice::matchService(const QString &url, ServiceMatcher::MatchType *type)
+{
+    if (type)
+        *type = ServiceMatcher::MatchNone;
+
+    if (!serviceIndexValid)
+        return QString();
+
+    return serviceMatcher.match(url, type);
+}
+
+bool MPDevice::serviceIndexLookup(const QString &service, bool isDataNode, bool &exists)
+{
+    if (!serviceIndexValid)
+        return false;
+
+    //same exact compare as findNodeWithServiceInList
+    exists = isDataNode?dataServicesIndex.contains(service):
+                        credentialServicesIndex.contains(service);
+    return true;
+}
+
+bool MPDevice::resolveServiceFromIndex(const QString &service, const QString &fallback_service, bool isDataNode,
+                                       QString &ctxService, QString &ctxFallback, QString &errstr)
+{
+    ctxService = service;
+    ctxFallback = fallback_service;
+
+    bool exists;
+    if (!serviceIndexLookup(service, isDataNode, exists))
+        return true;
+
+    //service exists, no need for the fallback
+    if (exists)
+    {
+        ctxFallback.clear();
+        return true;
+    }
+
+    bool fallbackExists = false;
+    if (!fallback_service.isEmpty())
+        serviceIndexLookup(fallback_service, isDataNode, fallbackExists);
+
+    if (!fallbackExists)
+    {
+        errstr = fallback_service.isEmpty()?"failed to select context on device":
+                                            "failed to select context and fallback_context on device";
+        return false;
+    }
+
+    //directly select the fallback
+    ctxService = fallback_service;
+    ctxFallback.clear();
+    return true;
+}
+
 void MPDevice::detagPointedNodes(void)
 {
     for (auto &i: loginNodes)
@@ -2000,18 +2153,158 @@ MPNode* MPDevice::addNewServiceToDB(const QString &service)
         return nullptr;
     }
 
-    /* Create new node with null address and virtual address set to our counter value */
-    newNodePt = new MPNode(QByteArray(MP_NODE_SIZE, 0), this, QByteArray(), newAddressesNeededCounter);
+    /* Create new node with null address and a new virtual address */
+    newNodePt = new MPNode(QByteArray(MP_NODE_SIZE, 0), this, QByteArray(), getNewVirtualAddress());
     newNodePt->setService(service);
 
-    /* Increment new addresses counter, add node to list */
-    newAddressesNeededCounter += 1;
+    /* Add node to list */
     loginNodes.append(newNodePt);
     addOrphanParentToDB(newNodePt, false);
 
     return newNodePt;
 }
 
+bool MPDevice::addNewServicesToDB(QStringList services, QHash<QString, MPNode *> &parentsByService)
+{
+    QHash<QByteArray, MPNode *> nodesByAddress;
+    QList<MPNode *> parentChain;
+    QList<MPNode *> mergedChain;
+
+    /* Walk the parent linked list once, the database was checked before */
+    for (auto &i: loginNodes)
+        nodesByAddress.insert(i->getAddress(), i);
+    QByteArray tempAddress = startNode;
+    while (tempAddress != MPNode::EmptyAddress)
+    {
+        MPNode *tempNodePt = nodesByAddress.value(tempAddress);
+        if (!tempNodePt || parentChain.size() > loginNodes.size())
+        {
+            qCritical() << "addNewServices: invalid parent linked list at address" << tempAddress.toHex();
+            return false;
+        }
+        parentChain.append(tempNodePt);
+        tempAddress = tempNodePt->getNextParentAddress();
+    }
+
+    /* Same ordering as addOrphanParentToDB */
+    std::sort(services.begin(), services.end(), [](const QString &a, const QString &b)
+    {
+        return a.compare(b) < 0;
+    });
+
+    /* Merge the sorted new services in the chain */
+    int i = 0;
+    for (const QString &service: services)
+    {
+        while (i < parentChain.size() && parentChain[i]->getService().compare(service) <= 0)
+            mergedChain.append(parentChain[i++]);
+
+        qDebug() << "Creating new service" << service << "in DB";
+        MPNode *newNodePt = new MPNode(QByteArray(MP_NODE_SIZE, 0), this, QByteArray(), getNewVirtualAddress());
+        newNodePt->setService(service);
+        loginNodes.append(newNodePt);
+        parentsByService.insert(service, newNodePt);
+        mergedChain.append(newNodePt);
+    }
+    while (i < parentChain.size())
+        mergedChain.append(parentChain[i++]);
+
+    /* Relink, only the neighbours of the new nodes actually change */
+    for (i = 0;i < mergedChain.size();i++)
+    {
+        MPNode *nodePt = mergedChain[i];
+        if (i == 0)
+            nodePt->setPreviousParentAddress(MPNode::EmptyAddress);
+        else
+            nodePt->setPreviousParentAddress(mergedChain[i - 1]->getAddress(), mergedChain[i - 1]->getVirtualAddress());
+        if (i == mergedChain.size() - 1)
+            nodePt->setNextParentAddress(MPNode::EmptyAddress);
+        else
+            nodePt->setNextParentAddress(mergedChain[i + 1]->getAddress(), mergedChain[i + 1]->getVirtualAddress());
+    }
+
+    if (!mergedChain.isEmpty())
+    {
+        startNode = mergedChain.first()->getAddress();
+        virtualStartNode = mergedChain.first()->getVirtualAddress();
+    }
+
+    return true;
+}
+
+MPNode* MPDevice::addNewLoginToDB(MPNode *parentNodePt, const QString &login)
+{
+    MPNode* tempNodePt = nullptr;
+    MPNode* prevNodePt = nullptr;
+    MPNode* newNodePt;
+
+    qDebug() << "Creating new login" << login << "for service" << parentNodePt->getService();
+
+    /* Create new child node with null address and a new virtual address */
+    newNodePt = new MPNode(QByteArray(MP_NODE_SIZE, 0), this, QByteArray(), getNewVirtualAddress());
+    newNodePt->setType(MPNode::NodeChild);
+    newNodePt->setLogin(login);
+    newNodePt->setDateCreated(QDate::currentDate());
+    newNodePt->setDateLastUsed(QDate::currentDate());
+
+    /* Browse the children of the parent, they are sorted by login */
+    QByteArray tempAddress = parentNodePt->getStartChildAddress();
+    quint32 tempVirtualAddress = parentNodePt->getFirstChildVirtualAddress();
+    while (tempAddress != MPNode::EmptyAddress)
+    {
+        tempNodePt = findNodeWithAddressInList(parentNodePt->getChildNodes(), tempAddress, tempVirtualAddress);
+        if (!tempNodePt)
+        {
+            qCritical() << "addNewLogin: couldn't find child node with address" << tempAddress.toHex();
+            delete newNodePt;
+            return nullptr;
+        }
+
+        if (tempNodePt->getLogin() == login)
+        {
+            qCritical() << "Login already exists.... dumbass!";
+            delete newNodePt;
+            return nullptr;
+        }
+
+        if (tempNodePt->getLogin().compare(login) > 0)
+            break;
+
+        prevNodePt = tempNodePt;
+        tempNodePt = nullptr;
+        tempAddress = prevNodePt->getNextChildAddress();
+        tempVirtualAddress = prevNodePt->getNextChildVirtualAddress();
+    }
+
+    /* Link with the previous node, or we are the new first child */
+    if (prevNodePt)
+    {
+        prevNodePt->setNextChildAddress(newNodePt->getAddress(), newNodePt->getVirtualAddress());
+        newNodePt->setPreviousChildAddress(prevNodePt->getAddress(), prevNodePt->getVirtualAddress());
+    }
+    else
+    {
+        parentNodePt->setStartChildAddress(newNodePt->getAddress(), newNodePt->getVirtualAddress());
+        newNodePt->setPreviousChildAddress(MPNode::EmptyAddress);
+    }
+
+    /* Link with the next node, or we are the last child */
+    if (tempNodePt)
+    {
+        tempNodePt->setPreviousChildAddress(newNodePt->getAddress(), newNodePt->getVirtualAddress());
+        newNodePt->setNextChildAddress(tempNodePt->getAddress(), tempNodePt->getVirtualAddress());
+    }
+    else
+    {
+        newNodePt->setNextChildAddress(MPNode::EmptyAddress);
+    }
+
+    loginChildNodes.append(newNodePt);
+    parentNodePt->appendChild(newNodePt);
+
+    return newNodePt;
+}
+
 bool MPDevice::addOrphanChildToDB(MPNode* childNodePt)
 {
     QString recovered_service_name = "_recovered_";
@@ -2188,7 +2481,7 @@ bool MPDevice::generateSavePackets(AsyncJobs *jobs)
             qInfo() << "Generating save packet for new login" << nodelist_iterator->getLogin();
             diagSavePacketsGenerated = true;
         }
-        else if (nodelist_iterator->getNodeData() != nodelist_iterator->getNodeData())
+        else if (nodelist_iterator->getNodeData() != temp_node_pointer->getNodeData())
         {
             qInfo() << "Generating save packet for updated login" << nodelist_iterator->getLogin();
             diagSavePacketsGenerated = true;
@@ -2327,19 +2620,109 @@ bool MPDevice::generateSavePackets(AsyncJobs *jobs)
     return true;
 }
 
+void MPDevice::createJobsSaveChanges(AsyncJobs *jobs)
+{
+    /* Clones by address, so bulk changes do not search the lists for each node */
+    QHash<QByteArray, MPNode *> loginNodesCloneByAddress;
+    for (auto &i: loginNodesClone)
+        loginNodesCloneByAddress.insert(i->getAddress(), i);
+    QHash<QByteArray, MPNode *> loginChildNodesCloneByAddress;
+    for (auto &i: loginChildNodesClone)
+        loginChildNodesCloneByAddress.insert(i->getAddress(), i);
+
+    /* Only login nodes and the start node are written, data nodes,
+     * deletions and favorites are not changed by the callers */
+    for (auto &i: loginNodes)
+    {
+        MPNode *cloneNodePt = loginNodesCloneByAddress.value(i->getAddress());
+        if (!cloneNodePt || i->getNodeData() != cloneNodePt->getNodeData())
+        {
+            qDebug() << "Writing service node" << i->getService();
+            createJobWriteNode(jobs, i);
+        }
+    }
+    for (auto &i: loginChildNodes)
+    {
+        MPNode *cloneNodePt = loginChildNodesCloneByAddress.value(i->getAddress());
+        if (!cloneNodePt || i->getNodeData() != cloneNodePt->getNodeData())
+        {
+            qDebug() << "Writing login node" << i->getLogin();
+            createJobWriteNode(jobs, i);
+        }
+    }
+
+    if (startNode != startNodeClone)
+    {
+        qDebug() << "Writing start node";
+        jobs->append(new MPCommandJob(this, MP_SET_STARTING_PARENT, startNode, MPCommandJob::defaultCheckRet));
+    }
+}
+
+void MPDevice::createJobWriteNode(AsyncJobs *jobs, MPNode *node)
+{
+    QByteArray nodeData = node->getNodeData();
+    QByteArray address = node->getAddress();
+
+    /* A node is written with 3 packets: address, packet index and node data */
+    for (int i = 0;i * NODE_WRITE_PACKET_SIZE < nodeData.size();i++)
+    {
+        QByteArray packet = address;
+        packet.append((char)i);
+        packet.append(nodeData.mid(i * NODE_WRITE_PACKET_SIZE, NODE_WRITE_PACKET_SIZE));
+
+        jobs->append(new MPCommandJob(this, MP_WRITE_FLASH_NODE, packet,
+                                      [=](const QByteArray &data, bool &) -> bool
+        {
+            if (data[MP_PAYLOAD_FIELD_INDEX] != 1)
+            {
+                qCritical() << "Write node: couldn't write node at address" << address.toHex();
+                jobs->setCurrentJobError("Mooltipass refused to write a node to flash");
+                return false;
+            }
+            mcDebug(lcNode).address(address) << "node packet" << i << "written";
+            return true;
+        }));
+    }
+}
+
 // If check_status is false, loaded nodes are not checked, and
 // return status of command is not checked too
 // This prevents having critical and scarry error messages
 // in user console.
-void MPDevice::exitMemMgmtMode(bool check_status)
+void MPDevice::exitMemMgmtMode(bool check_status, bool nodesSaved)
 {
     if (check_status)
         checkLoadedNodes(false);
 
+    //Loaded nodes only describe the flash after a full MMM session or a
+    //successful save, otherwise the services are unknown
+    bool rebuildIndex = isFw12() && (get_memMgmtMode() || nodesSaved);
+    if (!rebuildIndex)
+        invalidateServiceIndex();
+
     AsyncJobs *jobs = new AsyncJobs("Exiting MMM", this);
 
     jobs->append(new MPCommandJob(this, MP_END_MEMORYMGMT, MPCommandJob::defaultCheckRet));
 
+    //The index is stamped with the change numbers of the saved db
+    QSharedPointer<bool> changeNbRead(new bool(false));
+    if (rebuildIndex)
+    {
+        jobs->append(new MPCommandJob(this, MP_GET_USER_CHANGE_NB,
+                                      [=](const QByteArray &data, bool &) -> bool
+        {
+            if (data[MP_PAYLOAD_FIELD_INDEX] == 0)
+            {
+                qWarning() << "Couldn't request change numbers";
+                return true;
+            }
+            set_credentialsDbChangeNumber((quint8)data[MP_PAYLOAD_FIELD_INDEX+1]);
+            set_dataDbChangeNumber((quint8)data[MP_PAYLOAD_FIELD_INDEX+2]);
+            *changeNbRead = true;
+            return true;
+        }));
+    }
+
     connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
     {
         //data is last result
@@ -2347,6 +2730,30 @@ void MPDevice::exitMemMgmtMode(bool check_status)
 
         qInfo() << "MMM exit ok";
 
+        if (*changeNbRead)
+        {
+            buildServiceIndex();
+
+            /* A saved service must be answered by the index from now on */
+            bool exists = false;
+            if (!loginNodes.isEmpty() &&
+                (!serviceIndexLookup(loginNodes.first()->getService(), false, exists) || !exists))
+                qCritical() << "Service index: lookup of" << loginNodes.first()->getService() << "missed after MMM exit";
+
+            /* Urls of the saved services must resolve with the matcher too */
+            for (const MPNode *node: loginNodes)
+            {
+                QString host = ServiceMatcher::hostFromUrl(node->getService());
+                if (host.isEmpty())
+                    continue;
+                if (matchService(QStringLiteral("https://%1/").arg(host)).isEmpty())
+                    qCritical() << "Service matcher: no match for" << host << "after MMM exit";
+                break;
+            }
+        }
+        else
+            invalidateServiceIndex();
+
         /* Debug */
         /*qDebug() << ctrValue;
         qDebug() << ctrValueClone;
@@ -2392,6 +2799,8 @@ void MPDevice::exitMemMgmtMode(bool check_status)
         if (check_status)
             qCritical() << "Failed to exit MMM";
 
+        invalidateServiceIndex();
+
         /* Cleaning all temp values */
         ctrValue.clear();
         cpzCtrValue.clear();
@@ -2587,6 +2996,8 @@ void MPDevice::cancelUserRequest(const QString &reqid)
         ba.append(MP_CANCEL_USER_REQUEST);
 
         qDebug() << "Platform send command: " << QString("0x%1").arg((quint8)ba[1], 2, 16, QChar('0'));
+        if (trace)
+            trace->record(MPTraceFile::Out, ba);
         platformWrite(ba);
         return;
     }
@@ -2606,6 +3017,7 @@ void MPDevice::cancelUserRequest(const QString &reqid)
 }
 
 void MPDevice::getCredential(const QString &service, const QString &login, const QString &fallback_service, const QString &reqid,
+                             int fields,
                              std::function<void(bool success, QString errstr, const QString &_service, const QString &login, const QString &pass, const QString &desc)> cb)
 {
     QString logInf = QStringLiteral("Ask for password for service: %1 login: %2 fallback_service: %3 reqid: %4")
@@ -2614,13 +3026,22 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
                      .arg(fallback_service)
                      .arg(reqid);
 
+    //Use the service index to avoid probing the device for unknown contexts
+    QString ctxService, ctxFallback, errstr;
+    if (!resolveServiceFromIndex(service, fallback_service, false, ctxService, ctxFallback, errstr))
+    {
+        qWarning() << "Service" << service << "not found in service index";
+        cb(false, errstr, QString(), QString(), QString(), QString());
+        return;
+    }
+
     AsyncJobs *jobs;
     if (reqid.isEmpty())
         jobs = new AsyncJobs(logInf, this);
     else
         jobs = new AsyncJobs(logInf, reqid, this);
 
-    QByteArray sdata = service.toUtf8();
+    QByteArray sdata = ctxService.toUtf8();
     sdata.append((char)0);
 
     jobs->append(new MPCommandJob(this, MP_CONTEXT,
@@ -2629,9 +3050,9 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
     {
         if (data[2] != 1)
         {
-            if (!fallback_service.isEmpty())
+            if (!ctxFallback.isEmpty())
             {
-                QByteArray fsdata = fallback_service.toUtf8();
+                QByteArray fsdata = ctxFallback.toUtf8();
                 fsdata.append((char)0);
                 jobs->prepend(new MPCommandJob(this, MP_CONTEXT,
                                               fsdata,
@@ -2644,7 +3065,7 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
                         return false;
                     }
 
-                    QVariantMap m = {{ "service", fallback_service }};
+                    QVariantMap m = {{ "service", ctxFallback }};
                     jobs->user_data = m;
 
                     return true;
@@ -2657,7 +3078,7 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
             return false;
         }
 
-        QVariantMap m = {{ "service", service }};
+        QVariantMap m = {{ "service", ctxService }};
         jobs->user_data = m;
 
         return true;
@@ -2666,7 +3087,8 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
     jobs->append(new MPCommandJob(this, MP_GET_LOGIN,
                                   [=](const QByteArray &data, bool &) -> bool
     {
-        if (data[2] == 0 && !login.isEmpty())
+        //Without a password query, a refusal is only reported here
+        if (data[2] == 0 && (!login.isEmpty() || !(fields & CredentialPassword)))
         {
             jobs->setCurrentJobError("credential access refused by user");
             return false;
@@ -2686,42 +3108,48 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
         return true;
     }));
 
-    jobs->append(new MPCommandJob(this, MP_GET_DESCRIPTION,
-                                  [=](const QByteArray &data, bool &) -> bool
+    if (fields & CredentialDescription)
     {
-        if (data[2] == 0)
+        jobs->append(new MPCommandJob(this, MP_GET_DESCRIPTION,
+                                      [=](const QByteArray &data, bool &) -> bool
         {
-            jobs->setCurrentJobError("failed to query description on device");
-            qWarning() << "failed to query description on device";
-            return true; //Do not fail if description is not available for this node
-        }
-        QVariantMap m = jobs->user_data.toMap();
-        m["description"] = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
-        jobs->user_data = m;
-        return true;
-    }));
+            if (data[2] == 0)
+            {
+                jobs->setCurrentJobError("failed to query description on device");
+                qWarning() << "failed to query description on device";
+                return true; //Do not fail if description is not available for this node
+            }
+            QVariantMap m = jobs->user_data.toMap();
+            m["description"] = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+            jobs->user_data = m;
+            return true;
+        }));
+    }
 
-    jobs->append(new MPCommandJob(this, MP_GET_PASSWORD,
-                                  [=](const QByteArray &data, bool &) -> bool
+    if (fields & CredentialPassword)
     {
-        if (data[2] == 0)
+        jobs->append(new MPCommandJob(this, MP_GET_PASSWORD,
+                                      [=](const QByteArray &data, bool &) -> bool
         {
-            jobs->setCurrentJobError("failed to query password on device");
-            return false;
-        }
-        return true;
-    }));
+            if (data[2] == 0)
+            {
+                jobs->setCurrentJobError("failed to query password on device");
+                return false;
+            }
+            QVariantMap m = jobs->user_data.toMap();
+            m["password"] = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+            jobs->user_data = m;
+            return true;
+        }));
+    }
 
-    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &data)
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
     {
-        //data is last result
         //all jobs finished success
-
-        qInfo() << "Password retreived ok";
-        QString pass = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+        qInfo() << "Credential retreived ok";
 
         QVariantMap m = jobs->user_data.toMap();
-        cb(true, QString(), m["service"].toString(), m["login"].toString(), pass, m["description"].toString());
+        cb(true, QString(), m["service"].toString(), m["login"].toString(), m["password"].toString(), m["description"].toString());
     });
 
     connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
@@ -2734,52 +3162,378 @@ void MPDevice::getCredential(const QString &service, const QString &login, const
     runAndDequeueJobs();
 }
 
-void MPDevice::getRandomNumber(std::function<void(bool success, QString errstr, const QByteArray &nums)> cb)
+void MPDevice::getCredentialsBatch(const QList<MPCredentialRequest> &requests, const QString &reqid,
+                                   MPCredentialBatchCb cbItem,
+                                   std::function<void(bool success, QString errstr)> cb)
 {
-    AsyncJobs *jobs = new AsyncJobs("Get random numbers from device", this);
+    QString logInf = QStringLiteral("Ask for %1 credentials reqid: %2")
+                     .arg(requests.size())
+                     .arg(reqid);
 
-    jobs->append(new MPCommandJob(this, MP_GET_RANDOM_NUMBER, QByteArray()));
+    AsyncJobs *jobs;
+    if (reqid.isEmpty())
+        jobs = new AsyncJobs(logInf, this);
+    else
+        jobs = new AsyncJobs(logInf, reqid, this);
 
-    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &data)
+    //Group requests by service/fallback so the context is only selected once
+    QList<QPair<QString, QString>> services;
+    QHash<QPair<QString, QString>, QList<int>> indexes;
+    for (int i = 0;i < requests.size();i++)
     {
-        //data is last result
-        //all jobs finished success
-
-        qInfo() << "Random numbers generated ok";
-        cb(true, QString(), data);
-    });
+        QPair<QString, QString> key(requests.at(i).service, requests.at(i).fallback_service);
+        if (!indexes.contains(key))
+            services.append(key);
+        indexes[key].append(i);
+    }
 
-    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    for (const QPair<QString, QString> &key: services)
     {
-        Q_UNUSED(failedJob);
-        qCritical() << "Failed generating rng";
-        cb(false, "failed to generate random numbers", QByteArray());
-    });
+        QList<int> idx = indexes[key];
 
-    jobsQueue.enqueue(jobs);
-    runAndDequeueJobs();
-}
+        //A failing context only fails the credentials of this service,
+        //the next context is tried anyway
+        auto failItems = [=](const QString &errstr)
+        {
+            for (int i: idx)
+                cbItem(i, false, errstr, QString(), QString(), QString(), QString());
+        };
 
-void MPDevice::createJobAddContext(const QString &service, AsyncJobs *jobs, bool isDataNode)
-{
-    QByteArray sdata = service.toUtf8();
-    sdata.append((char)0);
+        QString service, fallback_service, errstr;
+        if (!resolveServiceFromIndex(key.first, key.second, false, service, fallback_service, errstr))
+        {
+            failItems(errstr);
+            continue;
+        }
 
-    quint8 cmdAddCtx = isDataNode?MP_ADD_DATA_SERVICE:MP_ADD_CONTEXT;
-    quint8 cmdSelectCtx = isDataNode?MP_SET_DATA_SERVICE:MP_CONTEXT;
+        QByteArray sdata = service.toUtf8();
+        sdata.append((char)0);
 
-    //Create context
-    jobs->prepend(new MPCommandJob(this, cmdAddCtx,
-                  sdata,
-                  [=](const QByteArray &data, bool &) -> bool
-    {
-        if (data[2] != 1)
+        jobs->append(new MPCommandJob(this, MP_CONTEXT,
+                                      sdata,
+                                      [=](const QByteArray &data, bool &) -> bool
+        {
+            if (data[2] == 1)
+            {
+                createJobsCredentialBatch(jobs, service, idx, requests, cbItem);
+                return true;
+            }
+
+            if (fallback_service.isEmpty())
+            {
+                qWarning() << "Error setting context: " << (quint8)data[2];
+                failItems("failed to select context on device");
+                return true;
+            }
+
+            QByteArray fsdata = fallback_service.toUtf8();
+            fsdata.append((char)0);
+            jobs->prepend(new MPCommandJob(this, MP_CONTEXT,
+                                          fsdata,
+                                          [=](const QByteArray &data, bool &) -> bool
+            {
+                if (data[2] != 1)
+                {
+                    qWarning() << "Error setting context: " << (quint8)data[2];
+                    failItems("failed to select context and fallback_context on device");
+                    return true;
+                }
+
+                createJobsCredentialBatch(jobs, fallback_service, idx, requests, cbItem);
+                return true;
+            }));
+            return true;
+        }));
+    }
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        qInfo() << "Credentials batch done";
+        cb(true, QString());
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed getting credentials: " << failedJob->getErrorStr();
+        cb(false, failedJob->getErrorStr());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+void MPDevice::createJobsCredentialBatch(AsyncJobs *jobs, const QString &service,
+                                         const QList<int> &indexes, const QList<MPCredentialRequest> &requests,
+                                         MPCredentialBatchCb cbItem)
+{
+    //Jobs are prepended so they run right after the current context selection,
+    //walk the list backward to keep the requests order
+    for (int n = indexes.size() - 1;n >= 0;n--)
+    {
+        int i = indexes.at(n);
+        QString login = requests.at(i).login;
+        QString key = QString::number(i);
+
+        jobs->prepend(new MPCommandJob(this, MP_GET_LOGIN,
+                                       [=](const QByteArray &data, bool &) -> bool
+        {
+            int fields = requests.at(i).fields;
+            bool withPass = fields & CredentialPassword;
+            bool withDesc = fields & CredentialDescription;
+
+            //Without a password query, a refusal is only reported here
+            if (data[2] == 0 && (!login.isEmpty() || !withPass))
+            {
+                cbItem(i, false, "credential access refused by user", QString(), QString(), QString(), QString());
+                return true;
+            }
+
+            QString l = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+            if (!login.isEmpty() && l != login)
+            {
+                cbItem(i, false, "login mismatch", QString(), QString(), QString(), QString());
+                return true;
+            }
+
+            if (!withPass && !withDesc)
+            {
+                cbItem(i, true, QString(), service, l, QString(), QString());
+                return true;
+            }
+
+            //Login is ok, query description and password for this credential.
+            //The last job of the credential sends the result.
+            if (withPass)
+            {
+                jobs->prepend(new MPCommandJob(this, MP_GET_PASSWORD,
+                                               [=](const QByteArray &data, bool &) -> bool
+                {
+                    QVariantMap m = jobs->user_data.toMap();
+                    QString desc = m.take(key).toString();
+                    jobs->user_data = m;
+
+                    if (data[2] == 0)
+                    {
+                        cbItem(i, false, "failed to query password on device", QString(), QString(), QString(), QString());
+                        return true;
+                    }
+
+                    QString pass = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+                    cbItem(i, true, QString(), service, l, pass, desc);
+                    return true;
+                }));
+            }
+
+            if (withDesc)
+            {
+                jobs->prepend(new MPCommandJob(this, MP_GET_DESCRIPTION,
+                                               [=](const QByteArray &data, bool &) -> bool
+                {
+                    QString desc;
+                    if (data[2] == 0)
+                        qWarning() << "failed to query description on device"; //Do not fail if description is not available for this node
+                    else
+                        desc = data.mid(MP_PAYLOAD_FIELD_INDEX, data[MP_LEN_FIELD_INDEX]);
+
+                    if (!withPass)
+                    {
+                        cbItem(i, true, QString(), service, l, QString(), desc);
+                        return true;
+                    }
+
+                    QVariantMap m = jobs->user_data.toMap();
+                    m[key] = desc;
+                    jobs->user_data = m;
+                    return true;
+                }));
+            }
+
+            return true;
+        }));
+    }
+}
+
+void MPDevice::serviceExists(const QString &service, bool isDataNode, const QString &reqid,
+                             std::function<void(bool success, QString errstr, bool exists)> cb)
+{
+    if (service.isEmpty())
+    {
+        qWarning() << "context is empty.";
+        cb(false, "context is empty", false);
+        return;
+    }
+
+    bool exists;
+    if (serviceIndexLookup(service, isDataNode, exists))
+    {
+        cb(true, QString(), exists);
+        return;
+    }
+
+    QString logInf = QStringLiteral("Check if service exists: %1 reqid: %2")
+                     .arg(service)
+                     .arg(reqid);
+
+    AsyncJobs *jobs;
+    if (reqid.isEmpty())
+        jobs = new AsyncJobs(logInf, this);
+    else
+        jobs = new AsyncJobs(logInf, reqid, this);
+
+    QByteArray sdata = service.toUtf8();
+    sdata.append((char)0);
+
+    jobs->append(new MPCommandJob(this, isDataNode?MP_SET_DATA_SERVICE:MP_CONTEXT, sdata));
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &data)
+    {
+        //data is last result
+        cb(true, QString(), data[2] == 1);
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed selecting context";
+        cb(false, failedJob->getErrorStr(), false);
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+void MPDevice::getRandomNumber(std::function<void(bool success, QString errstr, const QByteArray &nums)> cb)
+{
+    QByteArray nums;
+    if (randomPool.take(RANDOM_NUMBERS_SIZE, nums))
+    {
+        cb(true, QString(), nums);
+        QTimer::singleShot(0, this, &MPDevice::prefetchRandomNumbers);
+        return;
+    }
+
+    //Pool is empty, ask the device now
+    AsyncJobs *jobs = new AsyncJobs("Get random numbers from device", this);
+
+    createJobRandomNumbers(jobs, 1);
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        //all jobs finished success
+        QByteArray n;
+        if (!randomPool.take(RANDOM_NUMBERS_SIZE, n))
+        {
+            qCritical() << "Random pool empty after fetching random numbers";
+            cb(false, "failed to generate random numbers", QByteArray());
+            return;
+        }
+
+        qInfo() << "Random numbers generated ok";
+        cb(true, QString(), n);
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        Q_UNUSED(failedJob);
+        qCritical() << "Failed generating rng";
+        cb(false, "failed to generate random numbers", QByteArray());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+void MPDevice::createJobRandomNumbers(AsyncJobs *jobs, int count)
+{
+    for (int i = 0;i < count;i++)
+    {
+        jobs->append(new MPCommandJob(this, MP_GET_RANDOM_NUMBER, QByteArray(),
+                                      [=](const QByteArray &data, bool &) -> bool
+        {
+            if ((quint8)data[MP_CMD_FIELD_INDEX] != MP_GET_RANDOM_NUMBER)
+            {
+                qWarning() << "Get random numbers: wrong command received as answer:" << QString("0x%1").arg((quint8)data[MP_CMD_FIELD_INDEX], 0, 16);
+                return false;
+            }
+
+            //Only the payload is random, it conditions the pool
+            randomPool.addEntropy(data.mid(MP_PAYLOAD_FIELD_INDEX, RANDOM_NUMBERS_SIZE));
+            return true;
+        }));
+    }
+}
+
+void MPDevice::prefetchRandomNumbers()
+{
+    if (randomPool.isLow())
+        fillRandomPool();
+}
+
+void MPDevice::fillRandomPool()
+{
+    //Only when nobody else is using the device
+    if (randomPoolFetching || get_memMgmtMode() || get_status() == Common::UnknownStatus ||
+        currentJobs || !jobsQueue.isEmpty())
+        return;
+
+    int count = qMin((randomPool.missing() + RANDOM_NUMBERS_SIZE - 1) / RANDOM_NUMBERS_SIZE,
+                     RANDOM_POOL_MAX_FETCH);
+    if (count <= 0)
+        return;
+
+    AsyncJobs *jobs = new AsyncJobs("Prefetch random numbers from device", this);
+    createJobRandomNumbers(jobs, count);
+
+    randomPoolFetching = true;
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        randomPoolFetching = false;
+        qDebug() << "Random pool filled," << randomPool.size() << "bytes";
+
+        //Continue until the high watermark while still idle
+        if (randomPool.missing() > 0)
+            QTimer::singleShot(0, this, &MPDevice::fillRandomPool);
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *)
+    {
+        randomPoolFetching = false;
+        qWarning() << "Failed to prefetch random numbers";
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+void MPDevice::createJobAddContext(const QString &service, AsyncJobs *jobs, bool isDataNode)
+{
+    QByteArray sdata = service.toUtf8();
+    sdata.append((char)0);
+
+    quint8 cmdAddCtx = isDataNode?MP_ADD_DATA_SERVICE:MP_ADD_CONTEXT;
+    quint8 cmdSelectCtx = isDataNode?MP_SET_DATA_SERVICE:MP_CONTEXT;
+
+    //Create context
+    jobs->prepend(new MPCommandJob(this, cmdAddCtx,
+                  sdata,
+                  [=](const QByteArray &data, bool &) -> bool
+    {
+        if (data[2] != 1)
         {
             qWarning() << "Failed to add new context";
             jobs->setCurrentJobError("add_context failed on device");
             return false;
         }
         qDebug() << "context " << service << " added";
+        if (serviceIndexValid)
+        {
+            if (isDataNode)
+                dataServicesIndex.insert(service);
+            else
+            {
+                credentialServicesIndex.insert(service);
+                serviceMatcher.addService(service);
+            }
+        }
         return true;
     }));
 
@@ -2811,6 +3565,9 @@ void MPDevice::setCredential(const QString &service, const QString &login,
         return;
     }
 
+    //logins cached by clients for this service are outdated
+    emit credentialChanged(service);
+
     QString logInf = QStringLiteral("Adding/Changing credential for service: %1 login: %2")
                      .arg(service)
                      .arg(login);
@@ -2820,21 +3577,30 @@ void MPDevice::setCredential(const QString &service, const QString &login,
     QByteArray sdata = service.toUtf8();
     sdata.append((char)0);
 
-    //First query if context exist
-    jobs->append(new MPCommandJob(this, MP_CONTEXT,
-                                  sdata,
-                                  [=](const QByteArray &data, bool &) -> bool
+    bool exists;
+    if (serviceIndexLookup(service, false, exists) && !exists)
     {
-        if (data[2] != 1)
+        //Context is known to be missing, directly create it
+        createJobAddContext(service, jobs);
+    }
+    else
+    {
+        //First query if context exist
+        jobs->append(new MPCommandJob(this, MP_CONTEXT,
+                                      sdata,
+                                      [=](const QByteArray &data, bool &) -> bool
         {
-            qWarning() << "context " << service << " does not exist";
-            //Context does not exists, create it
-            createJobAddContext(service, jobs);
-        }
-        else
-            qDebug() << "set_context " << service;
-        return true;
-    }));
+            if (data[2] != 1)
+            {
+                qWarning() << "context " << service << " does not exist";
+                //Context does not exists, create it
+                createJobAddContext(service, jobs);
+            }
+            else
+                qDebug() << "set_context " << service;
+            return true;
+        }));
+    }
 
     QByteArray ldata = login.toUtf8();
     ldata.append((char)0);
@@ -2895,38 +3661,353 @@ void MPDevice::setCredential(const QString &service, const QString &login,
                                                pdata,
                                                [=](const QByteArray &data, bool &) -> bool
                 {
-                    if (data[2] == 0)
-                    {
-                        jobs->setCurrentJobError("set_password failed on device");
-                        qWarning() << "failed to set_password";
-                        return false;
-                    }
-                    qDebug() << "set_password ok";
+                    if (data[2] == 0)
+                    {
+                        jobs->setCurrentJobError("set_password failed on device");
+                        qWarning() << "failed to set_password";
+                        return false;
+                    }
+                    qDebug() << "set_password ok";
+                    return true;
+                }));
+            }
+            else
+                qDebug() << "password not changed";
+
+            return true;
+        }));
+    }
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        //all jobs finished success
+        qInfo() << "set_credential success";
+        cb(true, QString());
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed adding new credential";
+        cb(false, failedJob->getErrorStr());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+void MPDevice::importCredentials(const QList<MPCredentialImport> &credentials,
+                                 MPCredentialImportCb cbItem,
+                                 std::function<void(bool success, QString errstr)> cb,
+                                 std::function<void(int total, int current)> cbProgress)
+{
+    if (get_memMgmtMode())
+    {
+        cb(false, "Memory management mode is running, exit it first");
+        return;
+    }
+
+    /* Check everything before entering MMM. A login imported twice keeps the last values */
+    QList<MPCredentialImport> creds;
+    QList<int> credsOrigIndex;
+    QHash<QPair<QString, QString>, int> credsIndex;
+    for (int i = 0;i < credentials.size();i++)
+    {
+        const MPCredentialImport &c = credentials.at(i);
+        QString err;
+        if (c.service.isEmpty() || c.login.isEmpty())
+            err = "service or login is empty";
+        else if (c.password.isEmpty())
+            err = "password is empty";
+        else if (c.service.toUtf8().size() >= MP_MAX_SERVICE_LENGTH)
+            err = "service is too long";
+        else if (c.login.toUtf8().size() >= MP_MAX_LOGIN_LENGTH)
+            err = "login is too long";
+        else if (c.password.toUtf8().size() >= MP_MAX_PASSWORD_LENGTH)
+            err = "password is too long";
+        else if (c.description.toUtf8().size() > MOOLTIPASS_DESC_SIZE)
+            err = QStringLiteral("description is more than %1 bytes").arg(MOOLTIPASS_DESC_SIZE);
+
+        if (!err.isEmpty())
+        {
+            cb(false, QStringLiteral("credential %1: %2").arg(i + 1).arg(err));
+            return;
+        }
+
+        auto key = qMakePair(c.service, c.login);
+        if (credsIndex.contains(key))
+        {
+            creds[credsIndex.value(key)] = c;
+            credsOrigIndex[credsIndex.value(key)] = i;
+        }
+        else
+        {
+            credsIndex.insert(key, creds.size());
+            creds.append(c);
+            credsOrigIndex.append(i);
+        }
+    }
+
+    if (creds.isEmpty())
+    {
+        cb(false, "no credential to import");
+        return;
+    }
+
+    /* Entries replaced by a later one for the same login are not imported */
+    for (int i = 0;i < credentials.size();i++)
+    {
+        int n = credsIndex.value(qMakePair(credentials.at(i).service, credentials.at(i).login));
+        if (credsOrigIndex.at(n) != i)
+            cbItem(i, false, QStringLiteral("replaced by credential %1 for the same login").arg(credsOrigIndex.at(n) + 1));
+    }
+
+    AsyncJobs *jobs = new AsyncJobs(QStringLiteral("Importing %1 credentials").arg(creds.size()), this);
+
+    /* Load the database in MMM */
+    jobs->append(new MPCommandJob(this, MP_START_MEMORYMGMT, MPCommandJob::defaultCheckRet));
+    memMgmtModeReadFlash(jobs, false, cbProgress);
+
+    /* Add the credentials to the loaded nodes */
+    QSharedPointer<QVector<bool>> isNew(new QVector<bool>());
+    CustomJob *stageJob = new CustomJob();
+    stageJob->setWork([this, stageJob, creds, isNew]()
+    {
+        QString errstr;
+        if (!stageCredentialsImport(creds, *isNew, errstr))
+        {
+            stageJob->setErrorStr(errstr);
+            emit stageJob->error();
+            return;
+        }
+        emit stageJob->done(QByteArray());
+    });
+    jobs->append(stageJob);
+
+    /* Get flash slots for all new nodes */
+    createJobAllocateAddresses(jobs);
+
+    /* Write the changed nodes */
+    CustomJob *saveJob = new CustomJob();
+    saveJob->setWork([this, jobs, saveJob]()
+    {
+        createJobsSaveChanges(jobs);
+        emit saveJob->done(QByteArray());
+    });
+    jobs->append(saveJob);
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        qInfo() << "Imported credentials written to the database";
+
+        exitMemMgmtMode(true, true);
+
+        /* Passwords are encrypted by the card, they can only be set out of MMM.
+         * Each credential reports its own result, a refused password does not
+         * stop the next ones */
+        QSharedPointer<QVector<bool>> reported(new QVector<bool>(creds.size(), false));
+        AsyncJobs *passJobs = createJobsImportPasswords(creds, *isNew,
+                                                        [=](int index, bool success, QString errstr)
+        {
+            (*reported)[index] = true;
+            cbItem(credsOrigIndex.at(index), success, errstr);
+        }, cbProgress);
+
+        connect(passJobs, &AsyncJobs::finished, [=](const QByteArray &)
+        {
+            qInfo() << "import_credentials success";
+            cb(true, QString());
+        });
+
+        connect(passJobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+        {
+            qCritical() << "Failed setting imported passwords";
+            /* The device stopped answering, the remaining logins have no password set */
+            for (int i = 0;i < creds.size();i++)
+            {
+                if (reported->at(i))
+                    continue;
+                if (isNew->value(i))
+                    cbItem(credsOrigIndex.at(i), false, QStringLiteral("login added without a password: %1").arg(failedJob->getErrorStr()));
+                else
+                    cbItem(credsOrigIndex.at(i), false, QStringLiteral("password not updated: %1").arg(failedJob->getErrorStr()));
+            }
+            cb(false, failedJob->getErrorStr());
+        });
+
+        jobsQueue.enqueue(passJobs);
+        runAndDequeueJobs();
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed importing credentials";
+        exitMemMgmtMode(false);
+        for (int i = 0;i < creds.size();i++)
+            cbItem(credsOrigIndex.at(i), false, QStringLiteral("not imported: %1").arg(failedJob->getErrorStr()));
+        cb(false, failedJob->getErrorStr());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+bool MPDevice::stageCredentialsImport(const QList<MPCredentialImport> &credentials, QVector<bool> &isNew, QString &errstr)
+{
+    /* Nodes are inserted in the linked lists, they have to be valid */
+    if (!tagPointedNodes(false))
+    {
+        errstr = "The database has errors, run an integrity check first";
+        return false;
+    }
+
+    QHash<QString, MPNode *> parentsByService;
+    for (auto &i: loginNodes)
+        parentsByService.insert(i->getService(), i);
+
+    /* All new services are inserted in one pass */
+    QStringList newServices;
+    for (const MPCredentialImport &c: credentials)
+        if (!parentsByService.contains(c.service) && !newServices.contains(c.service))
+            newServices.append(c.service);
+    if (!newServices.isEmpty() && !addNewServicesToDB(newServices, parentsByService))
+    {
+        errstr = "Failed to add the new services to the database";
+        return false;
+    }
+
+    isNew.fill(false, credentials.size());
+    int newLogins = 0;
+
+    for (int i = 0;i < credentials.size();i++)
+    {
+        const MPCredentialImport &c = credentials.at(i);
+        MPNode *parentNodePt = parentsByService.value(c.service);
+
+        MPNode *childNodePt = nullptr;
+        for (MPNode *n: parentNodePt->getChildNodes())
+        {
+            if (n->getLogin() == c.login)
+            {
+                childNodePt = n;
+                break;
+            }
+        }
+
+        if (!childNodePt)
+        {
+            childNodePt = addNewLoginToDB(parentNodePt, c.login);
+            if (!childNodePt)
+            {
+                errstr = QStringLiteral("Failed to add login %1 for service %2").arg(c.login).arg(c.service);
+                return false;
+            }
+            isNew[i] = true;
+            newLogins++;
+        }
+
+        if (!c.description.isNull())
+            childNodePt->setDescription(c.description);
+    }
+
+    qInfo() << "Import:" << newServices.size() << "new services," << newLogins << "new logins,"
+            << credentials.size() - newLogins << "existing logins," << newAddressesNeededCounter << "nodes to allocate";
+
+    return true;
+}
+
+AsyncJobs *MPDevice::createJobsImportPasswords(const QList<MPCredentialImport> &credentials, const QVector<bool> &isNew,
+                                               MPCredentialImportCb cbItem,
+                                               std::function<void(int total, int current)> cbProgress)
+{
+    AsyncJobs *jobs = new AsyncJobs(QStringLiteral("Setting %1 imported passwords").arg(credentials.size()), this);
+
+    //Only the context selection is queued for each credential, the next jobs
+    //are prepended when it succeeds, so a failing credential is skipped and
+    //reported without stopping the others
+    for (int i = 0;i < credentials.size();i++)
+    {
+        const MPCredentialImport &c = credentials.at(i);
+        int total = credentials.size();
+        bool newLogin = isNew.value(i);
+
+        QByteArray sdata = c.service.toUtf8();
+        sdata.append((char)0);
+        QByteArray ldata = c.login.toUtf8();
+        ldata.append((char)0);
+        QByteArray pdata = c.password.toUtf8();
+        pdata.append((char)0);
+
+        auto itemDone = [=](bool success, const QString &errstr)
+        {
+            if (!success)
+                qWarning() << "Import failed for" << c.service << c.login << ":" << errstr;
+            cbItem(i, success, errstr);
+            cbProgress(total, i + 1);
+        };
+
+        //The nodes of a new login are already in flash, without its password
+        auto itemFailed = [=](const QString &errstr)
+        {
+            if (newLogin)
+                itemDone(false, QStringLiteral("login added without a password: %1").arg(errstr));
+            else
+                itemDone(false, QStringLiteral("password not updated: %1").arg(errstr));
+        };
+
+        auto setPasswordJob = [=]()
+        {
+            return new MPCommandJob(this, MP_SET_PASSWORD, pdata,
+                                    [=](const QByteArray &data, bool &) -> bool
+            {
+                if (data[2] == 0)
+                    itemFailed("set_password refused on device");
+                else
+                    itemDone(true, QString());
+                return true;
+            });
+        };
+
+        jobs->append(new MPCommandJob(this, MP_CONTEXT, sdata,
+                                      [=](const QByteArray &data, bool &) -> bool
+        {
+            if (data[2] != 1)
+            {
+                itemFailed("service not found on device");
+                return true;
+            }
+
+            jobs->prepend(new MPCommandJob(this, MP_SET_LOGIN, ldata,
+                                           [=](const QByteArray &data, bool &) -> bool
+            {
+                if (data[2] == 0)
+                {
+                    itemFailed("set_login failed on device");
+                    return true;
+                }
+
+                if (newLogin)
+                {
+                    jobs->prepend(setPasswordJob());
+                    return true;
+                }
+
+                /* Only ask the user to approve passwords that changed */
+                jobs->prepend(new MPCommandJob(this, MP_CHECK_PASSWORD, pdata,
+                                               [=](const QByteArray &data, bool &) -> bool
+                {
+                    if (data[2] != 1)
+                        jobs->prepend(setPasswordJob());
+                    else
+                        itemDone(true, QString());
                     return true;
                 }));
-            }
-            else
-                qDebug() << "password not changed";
-
+                return true;
+            }));
             return true;
         }));
     }
 
-    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
-    {
-        //all jobs finished success
-        qInfo() << "set_credential success";
-        cb(true, QString());
-    });
-
-    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
-    {
-        qCritical() << "Failed adding new credential";
-        cb(false, failedJob->getErrorStr());
-    });
-
-    jobsQueue.enqueue(jobs);
-    runAndDequeueJobs();
+    return jobs;
 }
 
 bool MPDevice::getDataNodeCb(AsyncJobs *jobs,
@@ -2996,13 +4077,21 @@ void MPDevice::getDataNode(const QString &service, const QString &fallback_servi
                      .arg(fallback_service)
                      .arg(reqid);
 
+    QString ctxService, ctxFallback, errstr;
+    if (!resolveServiceFromIndex(service, fallback_service, true, ctxService, ctxFallback, errstr))
+    {
+        qWarning() << "Data service" << service << "not found in service index";
+        cb(false, errstr, QString(), QByteArray());
+        return;
+    }
+
     AsyncJobs *jobs;
     if (reqid.isEmpty())
         jobs = new AsyncJobs(logInf, this);
     else
         jobs = new AsyncJobs(logInf, reqid, this);
 
-    QByteArray sdata = service.toUtf8();
+    QByteArray sdata = ctxService.toUtf8();
     sdata.append((char)0);
 
     jobs->append(new MPCommandJob(this, MP_SET_DATA_SERVICE,
@@ -3011,9 +4100,9 @@ void MPDevice::getDataNode(const QString &service, const QString &fallback_servi
     {
         if (data[2] != 1)
         {
-            if (!fallback_service.isEmpty())
+            if (!ctxFallback.isEmpty())
             {
-                QByteArray fsdata = fallback_service.toUtf8();
+                QByteArray fsdata = ctxFallback.toUtf8();
                 fsdata.append((char)0);
                 jobs->prepend(new MPCommandJob(this, MP_SET_DATA_SERVICE,
                                               fsdata,
@@ -3026,7 +4115,7 @@ void MPDevice::getDataNode(const QString &service, const QString &fallback_servi
                         return false;
                     }
 
-                    QVariantMap m = {{ "service", fallback_service }};
+                    QVariantMap m = {{ "service", ctxFallback }};
                     jobs->user_data = m;
 
                     return true;
@@ -3039,7 +4128,7 @@ void MPDevice::getDataNode(const QString &service, const QString &fallback_servi
             return false;
         }
 
-        QVariantMap m = {{ "service", service }};
+        QVariantMap m = {{ "service", ctxService }};
         jobs->user_data = m;
 
         return true;
@@ -3082,7 +4171,7 @@ bool MPDevice::setDataNodeCb(AsyncJobs *jobs, int current,
 {
     using namespace std::placeholders;
 
-    qDebug() << "setDataNodeCb data current: " << current;
+    mcDebug(lcData).command(MP_WRITE_32B_IN_DN) << "setDataNodeCb data current:" << current;
 
     if (data[2] == 0)
     {
@@ -3138,20 +4227,29 @@ void MPDevice::setDataNode(const QString &service, const QByteArray &nodeData, c
     QByteArray sdata = service.toUtf8();
     sdata.append((char)0);
 
-    jobs->append(new MPCommandJob(this, MP_SET_DATA_SERVICE,
-                                  sdata,
-                                  [=](const QByteArray &data, bool &) -> bool
+    bool exists;
+    if (serviceIndexLookup(service, true, exists) && !exists)
     {
-        if (data[2] != 1)
+        //Context is known to be missing, directly create it
+        createJobAddContext(service, jobs, true);
+    }
+    else
+    {
+        jobs->append(new MPCommandJob(this, MP_SET_DATA_SERVICE,
+                                      sdata,
+                                      [=](const QByteArray &data, bool &) -> bool
         {
-            qWarning() << "context " << service << " does not exist";
-            //Context does not exists, create it
-            createJobAddContext(service, jobs, true);
-        }
-        else
-            qDebug() << "set_data_context " << service;
-        return true;
-    }));
+            if (data[2] != 1)
+            {
+                qWarning() << "context " << service << " does not exist";
+                //Context does not exists, create it
+                createJobAddContext(service, jobs, true);
+            }
+            else
+                qDebug() << "set_data_context " << service;
+            return true;
+        }));
+    }
 
     using namespace std::placeholders;
 
@@ -3194,6 +4292,272 @@ void MPDevice::setDataNode(const QString &service, const QByteArray &nodeData, c
     runAndDequeueJobs();
 }
 
+bool MPDevice::exportSnapshot(const QString &path, const QString &passphrase, QString &errstr)
+{
+    if (!get_memMgmtMode())
+    {
+        errstr = "Not in memory management mode";
+        return false;
+    }
+
+    //Clones are the nodes as they are in the flash, without pending changes
+    MPSnapshotWriter writer;
+    if (!writer.open(path, get_flashMbSize(), passphrase, errstr))
+        return false;
+
+    writer.setCtr(ctrValueClone);
+    writer.setStartNodes(startNodeClone, startDataNodeClone);
+    for (const QByteArray &fav: favoritesAddrsClone)
+        writer.addFavorite(fav);
+    for (const QByteArray &cpz: cpzCtrValueClone)
+        writer.addCpzCtr(cpz);
+
+    for (const MPNode *n: loginNodesClone)
+        writer.addNode(n);
+    for (const MPNode *n: loginChildNodesClone)
+        writer.addNode(n);
+    for (const MPNode *n: dataNodesClone)
+        writer.addNode(n);
+    for (const MPNode *n: dataChildNodesClone)
+        writer.addNode(n);
+
+    if (!writer.finish(errstr))
+        return false;
+
+    qInfo() << "Database snapshot written to" << path;
+    return true;
+}
+
+int MPDevice::getFlashPageSize()
+{
+    //Flash pages are 264 bytes up to 8Mb, 528 bytes after
+    return get_flashMbSize() >= 16? 528: 264;
+}
+
+int MPDevice::getImageSize(MPImageFile::ImageType type)
+{
+    if (type == MPImageFile::Eeprom)
+        return IMAGE_EEPROM_SIZE;
+
+    //The export is a dump of the whole flash
+    return getNumberOfPages() * getFlashPageSize();
+}
+
+bool MPDevice::exportImageCb(AsyncJobs *jobs, QSharedPointer<MPImageFile> image,
+                             std::function<void(int total, int current)> cbProgress,
+                             const QByteArray &data, bool &)
+{
+    using namespace std::placeholders;
+
+    quint8 readCmd = image->type() == MPImageFile::Flash? MP_EXPORT_FLASH: MP_EXPORT_EEPROM;
+    quint8 endCmd = image->type() == MPImageFile::Flash? MP_EXPORT_FLASH_END: MP_EXPORT_EEPROM_END;
+
+    //Device answers with the end command when everything was sent
+    if ((quint8)data[MP_CMD_FIELD_INDEX] == endCmd)
+        return true;
+
+    if ((quint8)data[MP_CMD_FIELD_INDEX] != readCmd)
+    {
+        jobs->setCurrentJobError("Export image: Mooltipass sent an answer packet with a different command ID");
+        return false;
+    }
+
+    if (!image->append(data.mid(MP_PAYLOAD_FIELD_INDEX, (quint8)data[MP_LEN_FIELD_INDEX])))
+    {
+        jobs->setCurrentJobError("Failed to write image file");
+        return false;
+    }
+
+    int total = getImageSize(image->type());
+    cbProgress(total, qMin<qint64>(image->size(), total));
+
+    //Ask for next packet
+    jobs->append(new MPCommandJob(this, readCmd,
+                                  std::bind(&MPDevice::exportImageCb, this, jobs, image,
+                                            std::move(cbProgress), _1, _2)));
+
+    return true;
+}
+
+void MPDevice::exportImage(MPImageFile::ImageType type, const QString &path,
+                           std::function<void(bool success, QString errstr)> cb,
+                           std::function<void(int total, int current)> cbProgress)
+{
+    using namespace std::placeholders;
+
+    //The device exports the flash from its first page
+    QString errstr;
+    QSharedPointer<MPImageFile> image(new MPImageFile());
+    if (!image->create(path, type, get_flashMbSize(), 0, errstr))
+    {
+        qWarning() << errstr;
+        cb(false, errstr);
+        return;
+    }
+
+    AsyncJobs *jobs = new AsyncJobs(QStringLiteral("Exporting %1 image").arg(MPImageFile::typeName(type)), this);
+
+    //User has to approve the export on the device
+    jobs->append(new MPCommandJob(this, type == MPImageFile::Flash? MP_EXPORT_FLASH_START: MP_EXPORT_EEPROM_START,
+                                  [=](const QByteArray &data, bool &) -> bool
+    {
+        if (data[MP_PAYLOAD_FIELD_INDEX] != 0x01)
+        {
+            jobs->setCurrentJobError("Export was refused on the device");
+            return false;
+        }
+        return true;
+    }));
+
+    //Data is read packet by packet until the end command, each one queues the next read
+    jobs->append(new MPCommandJob(this, type == MPImageFile::Flash? MP_EXPORT_FLASH: MP_EXPORT_EEPROM,
+                                  std::bind(&MPDevice::exportImageCb, this, jobs, image,
+                                            std::move(cbProgress), _1, _2)));
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        QString err;
+        if (!image->finish(err))
+        {
+            qCritical() << err;
+            cb(false, err);
+            return;
+        }
+
+        qInfo() << "Image exported to" << path << image->size() << "bytes";
+        cb(true, QString());
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed exporting image";
+        image->abort();
+        cb(false, failedJob->getErrorStr());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
+bool MPDevice::createJobImportImagePacket(AsyncJobs *jobs, QSharedPointer<MPImageFile> image,
+                                          std::function<void(int total, int current)> cbProgress)
+{
+    bool flash = image->type() == MPImageFile::Flash;
+
+    if (image->atEnd())
+    {
+        jobs->append(new MPCommandJob(this, flash? MP_IMPORT_FLASH_END: MP_IMPORT_EEPROM_END,
+                                      MPCommandJob::defaultCheckRet));
+        return true;
+    }
+
+    //Data is read from the file when the previous packet is written
+    QByteArray packet = image->read(IMAGE_PACKET_SIZE);
+    if (packet.isEmpty())
+    {
+        qCritical() << "Failed to read image file" << image->fileName();
+        return false;
+    }
+
+    jobs->append(new MPCommandJob(this, flash? MP_IMPORT_FLASH: MP_IMPORT_EEPROM,
+                                  packet,
+                                  [=](const QByteArray &data, bool &) -> bool
+    {
+        if (data[MP_PAYLOAD_FIELD_INDEX] != 0x01)
+        {
+            jobs->setCurrentJobError("Writing image to device failed");
+            return false;
+        }
+
+        cbProgress(image->size(), image->position());
+        if (!createJobImportImagePacket(jobs, image, cbProgress))
+        {
+            jobs->setCurrentJobError("Failed to read image file");
+            return false;
+        }
+        return true;
+    }));
+
+    return true;
+}
+
+void MPDevice::importImage(MPImageFile::ImageType type, const QString &path,
+                           std::function<void(bool success, QString errstr)> cb,
+                           std::function<void(int total, int current)> cbProgress)
+{
+    //The whole file is checked before anything is written
+    QString errstr;
+    QSharedPointer<MPImageFile> image(new MPImageFile());
+    if (!image->open(path, errstr))
+    {
+        qWarning() << errstr;
+        cb(false, errstr);
+        return;
+    }
+
+    if (image->type() != type)
+    {
+        cb(false, QStringLiteral("This is not a %1 image").arg(MPImageFile::typeName(type)));
+        return;
+    }
+
+    if (type == MPImageFile::Flash && image->flashMbSize() != get_flashMbSize())
+    {
+        cb(false, QStringLiteral("Image was exported from a device with another flash size (%1Mb)").arg(image->flashMbSize()));
+        return;
+    }
+
+    //The device writes the flash back from the user space start, not from the
+    //page the image starts at. Pages before it (graphics) are not restored.
+    if (type == MPImageFile::Flash)
+    {
+        int userStartPage = getFlashPageFromAddress(getMemoryFirstNodeAddress());
+        if (image->startPage() > userStartPage ||
+            !image->skip((qint64)(userStartPage - image->startPage()) * getFlashPageSize()))
+        {
+            cb(false, "Image does not contain the user space of the flash");
+            return;
+        }
+    }
+
+    AsyncJobs *jobs = new AsyncJobs(QStringLiteral("Importing %1 image").arg(MPImageFile::typeName(type)), this);
+
+    //User has to approve the import on the device, flash is written from the user space start
+    jobs->append(new MPCommandJob(this, type == MPImageFile::Flash? MP_IMPORT_FLASH_BEGIN: MP_IMPORT_EEPROM_BEGIN,
+                                  type == MPImageFile::Flash? QByteArray(1, 0x00): QByteArray(),
+                                  [=](const QByteArray &data, bool &) -> bool
+    {
+        if (data[MP_PAYLOAD_FIELD_INDEX] != 0x01)
+        {
+            jobs->setCurrentJobError("Import was refused on the device");
+            return false;
+        }
+        return true;
+    }));
+
+    if (!createJobImportImagePacket(jobs, image, cbProgress))
+    {
+        delete jobs;
+        cb(false, "Failed to read image file");
+        return;
+    }
+
+    connect(jobs, &AsyncJobs::finished, [=](const QByteArray &)
+    {
+        qInfo() << "Image imported from" << path;
+        cb(true, QString());
+    });
+
+    connect(jobs, &AsyncJobs::failed, [=](AsyncJob *failedJob)
+    {
+        qCritical() << "Failed importing image";
+        cb(false, failedJob->getErrorStr());
+    });
+
+    jobsQueue.enqueue(jobs);
+    runAndDequeueJobs();
+}
+
 void MPDevice::changeVirtualAddressesToFreeAddresses(void)
 {
     for (auto &i: loginNodes)
@@ -3221,6 +4585,93 @@ void MPDevice::changeVirtualAddressesToFreeAddresses(void)
         if (i->getAddress().isNull()) i->setAddress(freeAddresses[i->getVirtualAddress()]);
         if (i->getNextChildDataAddress().isNull()) i->setNextChildDataAddress(freeAddresses[i->getNextChildVirtualAddress()]);
     }
+    if (startNode.isNull()) startNode = freeAddresses[virtualStartNode];
+    if (startDataNode.isNull()) startDataNode = freeAddresses[virtualDataStartNode];
+}
+
+quint32 MPDevice::getNewVirtualAddress(void)
+{
+    /* Virtual address 0 is not used, it is the placeholder in freeAddresses */
+    return ++newAddressesNeededCounter;
+}
+
+void MPDevice::loadFreeAddresses(AsyncJobs *jobs, const QByteArray &addressFrom, bool discardFirstAddr)
+{
+    mcDebug(lcNode).address(addressFrom) << "Loading free addresses";
+
+    jobs->prepend(new MPCommandJob(this, MP_GET_30_FREE_SLOTS, addressFrom,
+                                   [=](const QByteArray &data, bool &) -> bool
+    {
+        if ((quint8)data[MP_CMD_FIELD_INDEX] != MP_GET_30_FREE_SLOTS)
+        {
+            qCritical() << "Get free slots: wrong command received as answer:" << QString("0x%1").arg((quint8)data[MP_CMD_FIELD_INDEX], 0, 16);
+            jobs->setCurrentJobError("Get free slots: Mooltipass sent an answer packet with a different command ID");
+            return false;
+        }
+        if ((quint8)data[MP_LEN_FIELD_INDEX] == 1)
+        {
+            qCritical() << "Get free slots: couldn't get answer";
+            jobs->setCurrentJobError("Mooltipass refused to send us free slots");
+            return false;
+        }
+
+        /* The slot we started from is sent back when it is free */
+        int nbReceived = (quint8)data[MP_LEN_FIELD_INDEX] / 2;
+        int first = 0;
+        if (discardFirstAddr && nbReceived > 0 && data.mid(MP_PAYLOAD_FIELD_INDEX, 2) == addressFrom)
+            first = 1;
+
+        for (int i = first;i < nbReceived;i++)
+            freeAddresses.append(data.mid(MP_PAYLOAD_FIELD_INDEX + i * 2, 2));
+
+        qDebug() << "Received" << nbReceived - first << "free addresses," << freeAddresses.size() - 1
+                 << "in pool for" << newAddressesNeededCounter << "new nodes";
+
+        if ((quint32)freeAddresses.size() <= newAddressesNeededCounter)
+        {
+            /* Less than 30 slots means the end of the flash was reached */
+            if (nbReceived < 30)
+            {
+                qCritical() << "Get free slots: not enough free space in memory";
+                jobs->setCurrentJobError("Not enough free space in the Mooltipass memory");
+                return false;
+            }
+            loadFreeAddresses(jobs, freeAddresses.last(), true);
+        }
+
+        return true;
+    }));
+}
+
+void MPDevice::createJobAllocateAddresses(AsyncJobs *jobs)
+{
+    CustomJob *fetchJob = new CustomJob();
+    fetchJob->setWork([this, jobs, fetchJob]()
+    {
+        if (freeAddresses.isEmpty())
+            freeAddresses.append(QByteArray());
+
+        /* Only ask the device for what the pool is missing, the slots are
+         * then fetched 30 at a time */
+        if ((quint32)freeAddresses.size() <= newAddressesNeededCounter)
+        {
+            if (freeAddresses.size() > 1)
+                loadFreeAddresses(jobs, freeAddresses.last(), true);
+            else
+                loadFreeAddresses(jobs, getMemoryFirstNodeAddress(), false);
+        }
+
+        emit fetchJob->done(QByteArray());
+    });
+    jobs->append(fetchJob);
+
+    CustomJob *resolveJob = new CustomJob();
+    resolveJob->setWork([this, resolveJob]()
+    {
+        changeVirtualAddressesToFreeAddresses();
+        emit resolveJob->done(QByteArray());
+    });
+    jobs->append(resolveJob);
 }
 
 bool MPDevice::testCodeAgainstCleanDBChanges(AsyncJobs *jobs)
@@ -3276,6 +4727,7 @@ bool MPDevice::testCodeAgainstCleanDBChanges(AsyncJobs *jobs)
 
     diagSavePacketsGenerated = false;
     qInfo() << "testCodeAgainstCleanDBChanges: Changing valid address for virtual address";
+    freeAddresses.clear();
     freeAddresses.append(QByteArray());
     freeAddresses.append(loginNodes[1]->getAddress());
     loginNodes[1]->setAddress(QByteArray(), 1);
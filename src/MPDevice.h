@@ -25,6 +25,11 @@
 #include "QtHelper.h"
 #include "AsyncJobs.h"
 #include "MPNode.h"
+#include "ServiceMatcher.h"
+#include "RandomPool.h"
+#include "MPImageFile.h"
+#include "MPSnapshot.h"
+#include "MPTraceFile.h"
 
 typedef std::function<void(bool success, const QByteArray &data, bool &done)> MPCommandCb;
 
@@ -34,8 +39,43 @@ public:
     QByteArray data;
     MPCommandCb cb;
     bool running = false;
+    QElapsedTimer timer; //started when sent to the device
 };
 
+//Fields queried on the device when getting a credential.
+//The login is always queried as this is the command asking the user for approval
+enum MPCredentialField
+{
+    CredentialLogin = 0x01,
+    CredentialPassword = 0x02,
+    CredentialDescription = 0x04,
+    CredentialAllFields = CredentialLogin | CredentialPassword | CredentialDescription,
+};
+
+//One credential of a get_credentials_batch request
+class MPCredentialRequest
+{
+public:
+    QString service;
+    QString login;
+    QString fallback_service;
+    int fields = CredentialAllFields;
+};
+
+//One credential of an import_credentials request
+class MPCredentialImport
+{
+public:
+    QString service;
+    QString login;
+    QString password;
+    QString description; //null to keep the description of an existing login
+};
+
+typedef std::function<void(int index, bool success, QString errstr, const QString &service,
+                           const QString &login, const QString &pass, const QString &desc)> MPCredentialBatchCb;
+typedef std::function<void(int index, bool success, QString errstr)> MPCredentialImportCb;
+
 class MPDevice: public QObject
 {
     Q_OBJECT
@@ -113,8 +153,11 @@ public:
     void getUID(const QByteArray & key);
 
     //mem mgmt mode
-    void startMemMgmtMode(std::function<void(int total, int current)> cbProgress);
-    void exitMemMgmtMode(bool check_status = true);
+    void startMemMgmtMode(std::function<void(bool success, QString errstr)> cb,
+                          std::function<void(int total, int current)> cbProgress);
+    //The service index is rebuilt from the loaded nodes when they match the
+    //flash: a whole MMM session, or nodesSaved after the changes were written
+    void exitMemMgmtMode(bool check_status = true, bool nodesSaved = false);
     void startIntegrityCheck(std::function<void(bool success, QString errstr)> cb,
                              std::function<void(int total, int current)> cbProgress);
 
@@ -128,20 +171,50 @@ public:
     void getChangeNumbers();
 
     //Ask a password for specified service/login to MP
+    //fields is a combination of MPCredentialField, only those are read from the device
     void getCredential(const QString &service, const QString &login, const QString &fallback_service, const QString &reqid,
+                       int fields,
                        std::function<void(bool success, QString errstr, const QString &_service, const QString &login, const QString &pass, const QString &desc)> cb);
 
+    //Ask for a list of credentials. Requests for the same service share the
+    //context selection, cbItem is called for each credential as soon as it is
+    //retrieved (or failed), cb is called when the whole batch is done
+    void getCredentialsBatch(const QList<MPCredentialRequest> &requests, const QString &reqid,
+                             MPCredentialBatchCb cbItem,
+                             std::function<void(bool success, QString errstr)> cb);
+
     //Add or Set service/login/pass/desc in MP
     void setCredential(const QString &service, const QString &login,
                        const QString &pass, const QString &description, bool setDesc,
                        std::function<void(bool success, QString errstr)> cb);
 
-    //get 32 random bytes from device
+    //Import many credentials at once. New services and logins are added to
+    //the database in memory management mode and written in one batch, then
+    //the passwords are set one by one as only the card can encrypt them.
+    //cbItem is called for each credential once its password is set (or failed),
+    //cb is called when the whole import is done
+    void importCredentials(const QList<MPCredentialImport> &credentials,
+                           MPCredentialImportCb cbItem,
+                           std::function<void(bool success, QString errstr)> cb,
+                           std::function<void(int total, int current)> cbProgress);
+
+    //get 32 random bytes from device, served from the prefetched pool when possible
     void getRandomNumber(std::function<void(bool success, QString errstr, const QByteArray &nums)> cb);
 
     //Send a cancel request to device
     void cancelUserRequest(const QString &reqid);
 
+    //Check if a service exists on the device, the local service index is used
+    //when valid, otherwise the context is selected on the device
+    void serviceExists(const QString &service, bool isDataNode, const QString &reqid,
+                       std::function<void(bool success, QString errstr, bool exists)> cb);
+
+    //Best known credential service for an url or hostname, only available
+    //when the service index is valid. Returns an empty string if none matches
+    QString matchService(const QString &url, ServiceMatcher::MatchType *type = nullptr);
+    //The service index is filled when memory management mode exits
+    bool hasServiceIndex() const { return serviceIndexValid; }
+
     //Request for a raw data node from the device
     void getDataNode(const QString &service, const QString &fallback_service, const QString &reqid,
                      std::function<void(bool success, QString errstr, QString service, QByteArray rawData)> cb,
@@ -152,6 +225,23 @@ public:
                      std::function<void(bool success, QString errstr)> cb,
                      std::function<void(int total, int current)> cbProgress);
 
+    //Dump the flash or EEPROM to an image file, the user has to approve it on the device
+    void exportImage(MPImageFile::ImageType type, const QString &path,
+                     std::function<void(bool success, QString errstr)> cb,
+                     std::function<void(int total, int current)> cbProgress);
+
+    //Write an image file back to the device. The file is verified first
+    void importImage(MPImageFile::ImageType type, const QString &path,
+                     std::function<void(bool success, QString errstr)> cb,
+                     std::function<void(int total, int current)> cbProgress);
+
+    //Write the database as read from the flash in mem mgmt mode to a snapshot file.
+    //The file is encrypted and authenticated with keys derived from passphrase
+    bool exportSnapshot(const QString &path, const QString &passphrase, QString &errstr);
+
+    //Record all packets sent and received to a trace file, see MPDevice_replay
+    bool startTrace(const QString &path, QString &errstr);
+
     //After successfull mem mgmt mode, clients can query data
     QList<MPNode *> &getLoginNodes() { return loginNodes; }
     QList<MPNode *> &getDataNodes() { return dataNodes; }
@@ -169,6 +259,9 @@ signals:
     /* the command has failed in platform code */
     void platformFailed();
 
+    /* credential of a service is being added or changed */
+    void credentialChanged(const QString &service);
+
 private slots:
     void newDataRead(const QByteArray &data);
     void commandFailed();
@@ -192,6 +285,14 @@ private:
                                std::function<void(int total, int current)> cbProgress);
 
     void createJobAddContext(const QString &service, AsyncJobs *jobs, bool isDataNode = false);
+    //Fetch 32 bytes count times from the device into the random pool
+    void createJobRandomNumbers(AsyncJobs *jobs, int count);
+    //Start filling the random pool when under the low watermark
+    void prefetchRandomNumbers();
+    void fillRandomPool();
+    void createJobsCredentialBatch(AsyncJobs *jobs, const QString &service,
+                                   const QList<int> &indexes, const QList<MPCredentialRequest> &requests,
+                                   MPCredentialBatchCb cbItem);
 
     bool getDataNodeCb(AsyncJobs *jobs,
                        std::function<void(int total, int current)> cbProgress,
@@ -200,6 +301,15 @@ private:
                        std::function<void(int total, int current)> cbProgress,
                        const QByteArray &data, bool &done);
 
+    int getFlashPageSize();
+    //Expected image size, for progress
+    int getImageSize(MPImageFile::ImageType type);
+    bool exportImageCb(AsyncJobs *jobs, QSharedPointer<MPImageFile> image,
+                       std::function<void(int total, int current)> cbProgress,
+                       const QByteArray &data, bool &done);
+    bool createJobImportImagePacket(AsyncJobs *jobs, QSharedPointer<MPImageFile> image,
+                                    std::function<void(int total, int current)> cbProgress);
+
     // Functions added by mathieu for MMM
     void memMgmtModeReadFlash(AsyncJobs *jobs, bool fullScan, std::function<void(int total, int current)> cbProgress);
     MPNode *findNodeWithAddressInList(QList<MPNode *> list, const QByteArray &address, const quint32 virt_addr = 0);
@@ -215,6 +325,8 @@ private:
     // Functions added by mathieu for MMM : checks & repairs
     bool addOrphanParentToDB(MPNode *parentNodePt, bool isDataParent);
     MPNode* addNewServiceToDB(const QString &service);
+    MPNode* addNewLoginToDB(MPNode *parentNodePt, const QString &login);
+    bool addNewServicesToDB(QStringList services, QHash<QString, MPNode *> &parentsByService);
     bool addOrphanChildToDB(MPNode* childNodePt);
     bool checkLoadedNodes(bool repairAllowed);
     bool tagPointedNodes(bool repairAllowed);
@@ -224,10 +336,27 @@ private:
 
     // Generate save packets
     bool generateSavePackets(AsyncJobs *jobs);
+    // Write the changed login nodes and start node to the device
+    void createJobsSaveChanges(AsyncJobs *jobs);
+    void createJobWriteNode(AsyncJobs *jobs, MPNode *node);
+
+    // Bulk credentials import: add the credentials to the loaded database,
+    // isNew is set for the logins that were created
+    bool stageCredentialsImport(const QList<MPCredentialImport> &credentials, QVector<bool> &isNew, QString &errstr);
+    AsyncJobs *createJobsImportPasswords(const QList<MPCredentialImport> &credentials, const QVector<bool> &isNew,
+                                         MPCredentialImportCb cbItem,
+                                         std::function<void(int total, int current)> cbProgress);
 
     // once we fetched free addresses, this function is called
     void changeVirtualAddressesToFreeAddresses(void);
 
+    // Free addresses allocator: new nodes get a virtual address, resolved to
+    // a free flash slot once the pool is filled from the device
+    quint32 getNewVirtualAddress(void);
+    void loadFreeAddresses(AsyncJobs *jobs, const QByteArray &addressFrom, bool discardFirstAddr);
+    // Fill the pool up to the number of new nodes and resolve virtual addresses
+    void createJobAllocateAddresses(AsyncJobs *jobs);
+
     // Last page scanned
     quint16 lastFlashPageScanned = 0;
 
@@ -237,6 +366,11 @@ private:
     //timer that asks status
     QTimer *statusTimer = nullptr;
 
+    //Device random numbers fetched in background when the device is idle
+    RandomPool randomPool;
+    QTimer *randomPoolTimer = nullptr;
+    bool randomPoolFetching = false;
+
     //local vars for performance diagnostics
     qint64 diagLastSecs;
     quint32 diagNbBytesRec;
@@ -247,10 +381,34 @@ private:
     //command queue
     QQueue<MPCommand> commandQueue;
 
+    //USB trace when recording
+    MPTraceFile *trace = nullptr;
+
+    //Index of the services stored on the device, built from the parent nodes
+    //when MMM exits. It is stamped with the db change numbers read at that time
+    //and dropped as soon as they change, so it is only used on fw >= 1.2
+    QSet<QString> credentialServicesIndex;
+    QSet<QString> dataServicesIndex;
+    bool serviceIndexValid = false;
+    quint8 serviceIndexCredentialsChangeNb = 0;
+    quint8 serviceIndexDataChangeNb = 0;
+    ServiceMatcher serviceMatcher;
+
+    void buildServiceIndex();
+    void invalidateServiceIndex();
+    //returns false if the index can't be used
+    bool serviceIndexLookup(const QString &service, bool isDataNode, bool &exists);
+    //Choose the context to select from service/fallback_service. ctxFallback is
+    //cleared when the index already knows which one exists. Returns false
+    //if the index knows that none of them exist.
+    bool resolveServiceFromIndex(const QString &service, const QString &fallback_service, bool isDataNode,
+                                 QString &ctxService, QString &ctxFallback, QString &errstr);
+
     // Number of new addresses we need
     quint32 newAddressesNeededCounter = 0;
 
-    // Buffer containing the free addresses we will need
+    // Buffer containing the free addresses we will need, indexed by virtual
+    // address. Index 0 is a placeholder, virtual addresses start at 1
     QList<QByteArray> freeAddresses;
 
     // Values loaded when needed (e.g. mem mgmt mode)
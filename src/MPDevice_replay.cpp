@@ -0,0 +1,110 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "MPDevice_replay.h"
+
+//How many records are searched for a command not matching the next one
+#define REPLAY_LOOKAHEAD    64
+
+MPDevice_replay::MPDevice_replay(QObject *parent, const QString &traceFile, double s):
+    MPDevice(parent),
+    speed(s)
+{
+    MPTraceFile trace;
+    QString err;
+    if (!trace.open(traceFile, err))
+    {
+        qCritical() << "Replay:" << err;
+        return;
+    }
+
+    MPTraceFile::Record rec;
+    while (trace.readRecord(rec))
+        records.append(rec);
+    if (!trace.atEnd())
+        qWarning() << "Replay: trace" << traceFile << "is truncated";
+
+    qInfo() << "Replay device," << records.size() << "records from" << traceFile << "speed:" << speed;
+}
+
+int MPDevice_replay::findCommand(quint8 cmd) const
+{
+    int end = qMin(records.size(), position + REPLAY_LOOKAHEAD);
+    for (int i = position;i < end;i++)
+    {
+        const MPTraceFile::Record &r = records.at(i);
+        if (r.direction == MPTraceFile::Out && r.data.size() > 1 && (quint8)r.data.at(1) == cmd)
+            return i;
+    }
+    return -1;
+}
+
+void MPDevice_replay::platformWrite(const QByteArray &data)
+{
+    quint8 cmd = (quint8)data.at(1);
+
+    int i = findCommand(cmd);
+    if (i < 0)
+    {
+        if (!lastReplies.contains(cmd))
+        {
+            qWarning() << "Replay: command" << QString("0x%1").arg(cmd, 2, 16, QChar('0'))
+                       << "not found in trace at record" << position;
+            return;
+        }
+
+        //Replay the last replies seen for this command
+        for (const QByteArray &d: lastReplies.value(cmd))
+            QTimer::singleShot(0, this, [this, d]() { emit platformDataRead(d); });
+        return;
+    }
+
+    if (i > position)
+        qDebug() << "Replay: skipping" << i - position << "records";
+
+    if (records.at(i).data != data)
+        qDebug() << "Replay: command" << QString("0x%1").arg(cmd, 2, 16, QChar('0')) << "payload differs from trace";
+
+    sendReplies(i);
+}
+
+void MPDevice_replay::sendReplies(int index)
+{
+    quint8 cmd = (quint8)records.at(index).data.at(1);
+    QList<QByteArray> replies;
+    qint64 delay = 0;
+
+    position = index + 1;
+    while (position < records.size() && records.at(position).direction == MPTraceFile::In)
+    {
+        const MPTraceFile::Record &r = records.at(position);
+        delay += speed > 0? qRound64(r.delay / speed): 0;
+        replies.append(r.data);
+
+        //Always go through the event loop, the reply ends up sending the next command
+        QByteArray d = r.data;
+        QTimer::singleShot((int)(delay / 1000), Qt::PreciseTimer, this, [this, d]() { emit platformDataRead(d); });
+        position++;
+    }
+
+    lastReplies[cmd] = replies;
+}
+
+void MPDevice_replay::platformRead()
+{
+}
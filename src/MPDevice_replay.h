@@ -0,0 +1,51 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef MPDEVICE_REPLAY_H
+#define MPDEVICE_REPLAY_H
+
+#include "MPDevice.h"
+#include "MPTraceFile.h"
+
+//Device backend playing back a trace recorded with --record-usb.
+//Each packet written is matched against the next recorded command and the
+//recorded replies are sent back with the original delays divided by speed
+//(0 replies immediately).
+class MPDevice_replay : public MPDevice
+{
+public:
+    MPDevice_replay(QObject *parent, const QString &traceFile, double speed);
+
+private:
+    virtual void platformRead();
+    virtual void platformWrite(const QByteArray &data);
+
+    int findCommand(quint8 cmd) const;
+    void sendReplies(int index);
+
+    QVector<MPTraceFile::Record> records;
+    int position = 0;
+    double speed;
+
+    //Replies of the last recorded occurence of each command, used when the
+    //daemon sends a command that is not in the trace (ex: status polling
+    //running at a different pace than during the recording)
+    QHash<quint8, QList<QByteArray>> lastReplies;
+};
+
+#endif // MPDEVICE_REPLAY_H
@@ -0,0 +1,237 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "MPImageFile.h"
+
+#define IMAGE_MAGIC         "MCIMAGE1"
+#define IMAGE_HEADER_SIZE   64
+//Data are written and hashed by chunks of this size
+#define IMAGE_CHUNK_SIZE    (64 * 1024)
+
+MPImageFile::MPImageFile():
+    hash(QCryptographicHash::Sha256)
+{
+}
+
+MPImageFile::~MPImageFile()
+{
+    if (writing)
+        abort();
+}
+
+QString MPImageFile::typeName(ImageType type)
+{
+    return type == Eeprom? "eeprom": "flash";
+}
+
+bool MPImageFile::typeFromName(const QString &name, ImageType &type)
+{
+    if (name == "flash")
+        type = Flash;
+    else if (name == "eeprom")
+        type = Eeprom;
+    else
+        return false;
+    return true;
+}
+
+QByteArray MPImageFile::header() const
+{
+    QByteArray h(IMAGE_HEADER_SIZE, 0);
+    memcpy(h.data(), IMAGE_MAGIC, 8);
+    h[8] = (quint8)imageType;
+    h[9] = (quint8)imageFlashMbSize;
+    qToBigEndian<quint16>(imageStartPage, reinterpret_cast<uchar *>(h.data() + 10));
+    qToBigEndian<quint64>(dataSize, reinterpret_cast<uchar *>(h.data() + 12));
+    memcpy(h.data() + 20, dataHash.constData(), qMin(dataHash.size(), 32));
+    return h;
+}
+
+bool MPImageFile::create(const QString &p, ImageType type, int flashMbSize, int startPage, QString &errstr)
+{
+    path = p;
+    imageType = type;
+    imageFlashMbSize = flashMbSize;
+    imageStartPage = startPage;
+    dataSize = 0;
+    dataHash.clear();
+    hash.reset();
+    chunk.clear();
+
+    file.setFileName(path + ".part");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errstr = QStringLiteral("Failed to create %1: %2").arg(file.fileName()).arg(file.errorString());
+        return false;
+    }
+
+    //Header is written again with the size and hash when finished
+    if (file.write(header()) != IMAGE_HEADER_SIZE)
+    {
+        errstr = QStringLiteral("Failed to write %1: %2").arg(file.fileName()).arg(file.errorString());
+        file.close();
+        file.remove();
+        return false;
+    }
+
+    writing = true;
+    return true;
+}
+
+bool MPImageFile::append(const QByteArray &data)
+{
+    chunk.append(data);
+    dataSize += data.size();
+    if (chunk.size() >= IMAGE_CHUNK_SIZE)
+        return flushChunk();
+    return true;
+}
+
+bool MPImageFile::flushChunk()
+{
+    if (chunk.isEmpty())
+        return true;
+
+    hash.addData(chunk);
+    bool ok = file.write(chunk) == chunk.size();
+    chunk.clear();
+    return ok;
+}
+
+bool MPImageFile::finish(QString &errstr)
+{
+    if (!flushChunk())
+    {
+        errstr = QStringLiteral("Failed to write %1: %2").arg(file.fileName()).arg(file.errorString());
+        abort();
+        return false;
+    }
+
+    dataHash = hash.result();
+    if (!file.seek(0) || file.write(header()) != IMAGE_HEADER_SIZE || !file.flush())
+    {
+        errstr = QStringLiteral("Failed to write %1: %2").arg(file.fileName()).arg(file.errorString());
+        abort();
+        return false;
+    }
+    file.close();
+    writing = false;
+
+    QFile::remove(path);
+    if (!QFile::rename(path + ".part", path))
+    {
+        errstr = QStringLiteral("Failed to rename %1.part").arg(path);
+        QFile::remove(path + ".part");
+        return false;
+    }
+
+    return true;
+}
+
+void MPImageFile::abort()
+{
+    file.close();
+    QFile::remove(path + ".part");
+    writing = false;
+}
+
+bool MPImageFile::open(const QString &p, QString &errstr)
+{
+    path = p;
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        errstr = QStringLiteral("Failed to open %1: %2").arg(path).arg(file.errorString());
+        return false;
+    }
+
+    if (!readHeader(errstr))
+    {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool MPImageFile::readHeader(QString &errstr)
+{
+    QByteArray h = file.read(IMAGE_HEADER_SIZE);
+    if (h.size() != IMAGE_HEADER_SIZE || !h.startsWith(IMAGE_MAGIC))
+    {
+        errstr = "Not a device image file";
+        return false;
+    }
+
+    quint8 t = h[8];
+    if (t != Flash && t != Eeprom)
+    {
+        errstr = "Unknown device image type";
+        return false;
+    }
+    imageType = (ImageType)t;
+    imageFlashMbSize = (quint8)h[9];
+    imageStartPage = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(h.constData() + 10));
+    dataSize = qFromBigEndian<quint64>(reinterpret_cast<const uchar *>(h.constData() + 12));
+    dataHash = h.mid(20, 32);
+
+    if (dataSize != file.size() - IMAGE_HEADER_SIZE)
+    {
+        errstr = "Device image file is truncated";
+        return false;
+    }
+
+    //Check the whole data before anything is sent to the device
+    hash.reset();
+    while (!file.atEnd())
+    {
+        QByteArray d = file.read(IMAGE_CHUNK_SIZE);
+        if (d.isEmpty())
+        {
+            errstr = QStringLiteral("Failed to read %1: %2").arg(path).arg(file.errorString());
+            return false;
+        }
+        hash.addData(d);
+    }
+
+    if (hash.result() != dataHash)
+    {
+        errstr = "Device image file is corrupted, checksum mismatch";
+        return false;
+    }
+
+    file.seek(IMAGE_HEADER_SIZE);
+    dataRead = 0;
+    return true;
+}
+
+QByteArray MPImageFile::read(int maxSize)
+{
+    QByteArray d = file.read(qMin<qint64>(maxSize, dataSize - dataRead));
+    dataRead += d.size();
+    return d;
+}
+
+bool MPImageFile::skip(qint64 size)
+{
+    if (size < 0 || size > dataSize - dataRead ||
+        !file.seek(IMAGE_HEADER_SIZE + dataRead + size))
+        return false;
+
+    dataRead += size;
+    return true;
+}
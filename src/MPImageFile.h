@@ -0,0 +1,89 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef MPIMAGEFILE_H
+#define MPIMAGEFILE_H
+
+#include <QtCore>
+
+//Raw image of the device flash or EEPROM.
+//File layout: a 64 bytes header (magic, image type, flash size of the
+//device, first flash page of the data, data size and SHA-256 of the data)
+//followed by the data.
+//Images are written to a .part file and renamed when complete, data are
+//written and read in chunks and hashed on the fly.
+class MPImageFile
+{
+public:
+    enum ImageType
+    {
+        Flash = 1,
+        Eeprom = 2
+    };
+
+    MPImageFile();
+    ~MPImageFile();
+
+    static QString typeName(ImageType type);
+    static bool typeFromName(const QString &name, ImageType &type);
+
+    //Writing
+    bool create(const QString &path, ImageType type, int flashMbSize, int startPage, QString &errstr);
+    bool append(const QByteArray &data);
+    bool finish(QString &errstr);
+    //Remove the partial file
+    void abort();
+
+    //Reading. The file is checked before returning, the data can then be read in chunks
+    bool open(const QString &path, QString &errstr);
+    //Empty on read error or at end
+    QByteArray read(int maxSize);
+    //Skip data not written back to the device
+    bool skip(qint64 size);
+    bool atEnd() const { return dataRead >= dataSize; }
+
+    ImageType type() const { return imageType; }
+    int flashMbSize() const { return imageFlashMbSize; }
+    int startPage() const { return imageStartPage; }
+    qint64 size() const { return dataSize; }
+    qint64 position() const { return dataRead; }
+    QByteArray sha256() const { return dataHash; }
+    QString fileName() const { return path; }
+
+private:
+    Q_DISABLE_COPY(MPImageFile)
+
+    bool flushChunk();
+    bool readHeader(QString &errstr);
+    QByteArray header() const;
+
+    QFile file;
+    QString path;
+    QCryptographicHash hash;
+    QByteArray chunk;
+    bool writing = false;
+
+    ImageType imageType = Flash;
+    int imageFlashMbSize = 0;
+    int imageStartPage = 0;
+    qint64 dataSize = 0;
+    qint64 dataRead = 0;
+    QByteArray dataHash;
+};
+
+#endif // MPIMAGEFILE_H
@@ -164,7 +164,10 @@ void MPManager::checkUsbDevices()
     if (AppDaemon::isEmulationMode())
     {
         MPDevice *device;
-        device = new MPDevice_emul(this);
+        if (!AppDaemon::replayFile().isEmpty())
+            device = new MPDevice_replay(this, AppDaemon::replayFile(), AppDaemon::replaySpeed());
+        else
+            device = new MPDevice_emul(this);
         detectedDevs.append("EMULDEVICE_ID");
         devices["EMULDEVICE_ID"] = device;
         emit mpConnected(device);
@@ -187,6 +190,8 @@ void MPManager::checkUsbDevices()
                 device = new MPDevice_linux(this, def);
 #endif
 
+                startUsbTrace(device);
+
                 devices[def.id] = device;
                 emit mpConnected(device);
             }
@@ -208,3 +213,22 @@ void MPManager::checkUsbDevices()
             it++;
     }
 }
+
+void MPManager::startUsbTrace(MPDevice *device)
+{
+    QString path = AppDaemon::usbTraceFile();
+    if (path.isEmpty())
+        return;
+
+    //Do not overwrite the trace of a previously connected device
+    QFileInfo fi(path);
+    if (fi.exists())
+        path = fi.dir().filePath(QStringLiteral("%1-%2.%3")
+                                 .arg(fi.completeBaseName())
+                                 .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"))
+                                 .arg(fi.suffix()));
+
+    QString err;
+    if (!device->startTrace(path, err))
+        qWarning() << err;
+}
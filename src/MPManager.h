@@ -29,6 +29,7 @@
 #include "MPDevice_linux.h"
 #endif
 #include "MPDevice_emul.h"
+#include "MPDevice_replay.h"
 
 class MPManager: public QObject
 {
@@ -48,6 +49,10 @@ public:
     int getDeviceCount() { return devices.count(); }
     QList<MPDevice *> getDevices();
 
+    //Platform id of a connected device, used as device selector by clients
+    QString getDeviceId(MPDevice *dev) const { return devices.key(dev); }
+    MPDevice *findDevice(const QString &id) const { return devices.value(id, nullptr); }
+
 signals:
     void mpConnected(MPDevice *device);
     void mpDisconnected(MPDevice *device);
@@ -60,6 +65,7 @@ private:
     MPManager();
 
     void checkUsbDevices();
+    void startUsbTrace(MPDevice *device);
 
     QHash<QString, MPDevice *> devices;
 };
@@ -43,6 +43,13 @@ int MPNode::getType() const
     return -1;
 }
 
+void MPNode::setType(int type)
+{
+    //Valid bit is 0 for a valid node, user id is set by the device on write
+    if (data.size() > 1)
+        data[1] = (quint8)((type & 0x03) << 6);
+}
+
 bool MPNode::isValid() const
 {
     return getType() != NodeUnknown &&
@@ -287,12 +294,34 @@ QString MPNode::getDescription() const
     return QString::fromUtf8(data.mid(6, 24));
 }
 
+void MPNode::setDescription(const QString &description)
+{
+    if (isValid())
+    {
+        QByteArray descArray = description.toUtf8();
+        descArray.truncate(MOOLTIPASS_DESC_SIZE);
+        descArray.append(QByteArray(24 - descArray.size(), 0));
+        data.replace(6, 24, descArray);
+    }
+}
+
 QString MPNode::getLogin() const
 {
     if (!isValid()) return QString();
     return QString::fromUtf8(data.mid(37, 63));
 }
 
+void MPNode::setLogin(const QString &login)
+{
+    if (isValid())
+    {
+        QByteArray loginArray = login.toUtf8();
+        loginArray.truncate(MP_MAX_LOGIN_LENGTH - 1);
+        loginArray.append(QByteArray(63 - loginArray.size(), 0));
+        data.replace(37, 63, loginArray);
+    }
+}
+
 QByteArray MPNode::getPasswordEnc() const
 {
     if (!isValid()) return QByteArray();
@@ -305,12 +334,24 @@ QDate MPNode::getDateCreated() const
     return Common::bytesToDate(data.mid(30, 2));
 }
 
+void MPNode::setDateCreated(const QDate &date)
+{
+    if (isValid())
+        data.replace(30, 2, Common::dateToBytes(date));
+}
+
 QDate MPNode::getDateLastUsed() const
 {
     if (!isValid()) return QDate();
     return Common::bytesToDate(data.mid(32, 2));
 }
 
+void MPNode::setDateLastUsed(const QDate &date)
+{
+    if (isValid())
+        data.replace(32, 2, Common::dateToBytes(date));
+}
+
 QByteArray MPNode::getNextDataAddress() const
 {
     if (!isValid()) return QByteArray();
@@ -47,6 +47,7 @@ public:
     void setVirtualAddress(quint32 addr);
     QByteArray getAddress() const;
     int getType() const;
+    void setType(int type);
 
     // NodeParent / NodeParentData properties
     void setPreviousParentAddress(const QByteArray &d, const quint32 virt_addr = 0);
@@ -78,10 +79,14 @@ public:
     QByteArray getPreviousChildAddress() const;
     QByteArray getCTR() const;
     QString getDescription() const;
+    void setDescription(const QString &description);
     QString getLogin() const;
+    void setLogin(const QString &login);
     QByteArray getPasswordEnc() const;
     QDate getDateCreated() const;
+    void setDateCreated(const QDate &date);
     QDate getDateLastUsed() const;
+    void setDateLastUsed(const QDate &date);
 
     //Data node address
     //Address in data node is not at the same position as cred nodes
@@ -0,0 +1,533 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "MPSnapshot.h"
+#include "MPNode.h"
+#include <random>
+
+#define SNAPSHOT_MAGIC          "MCDBSNAP"
+#define SNAPSHOT_END_MAGIC      "MCDBEND1"
+#define SNAPSHOT_HEADER_SIZE    48
+#define SNAPSHOT_BLOCK_HEADER   16
+#define SNAPSHOT_INDEX_ENTRY    24
+#define SNAPSHOT_FOOTER_SIZE    56
+#define SNAPSHOT_MAC_SIZE       32
+#define SNAPSHOT_KEY_SIZE       32
+//Flags set in the header when a passphrase is used
+#define SNAPSHOT_FLAG_KEYED     0x0001
+#define SNAPSHOT_FLAG_ENCRYPTED 0x0002
+//Refuse files asking for an absurd amount of work
+#define SNAPSHOT_MAX_ITERATIONS 10000000
+#define NODE_ADDRESS_SIZE       2
+
+static void appendU8(QByteArray &b, quint8 v) { b.append((char)v); }
+static void appendU16(QByteArray &b, quint16 v) { uchar d[2]; qToBigEndian(v, d); b.append((const char *)d, 2); }
+static void appendU32(QByteArray &b, quint32 v) { uchar d[4]; qToBigEndian(v, d); b.append((const char *)d, 4); }
+static void appendU64(QByteArray &b, quint64 v) { uchar d[8]; qToBigEndian(v, d); b.append((const char *)d, 8); }
+
+void MPSnapshot::deriveKeys(const QString &passphrase, const QByteArray &salt, quint32 iterations,
+                            QByteArray &encKey, QByteArray &macKey)
+{
+    //PBKDF2-HMAC-SHA256, two output blocks: encryption key then HMAC key
+    QMessageAuthenticationCode prf(QCryptographicHash::Sha256, passphrase.toUtf8());
+    QByteArray out;
+    for (quint32 block = 1;out.size() < 2 * SNAPSHOT_KEY_SIZE;block++)
+    {
+        QByteArray s = salt;
+        appendU32(s, block);
+        prf.reset();
+        prf.addData(s);
+        QByteArray u = prf.result();
+        QByteArray t = u;
+        for (quint32 i = 1;i < iterations;i++)
+        {
+            prf.reset();
+            prf.addData(u);
+            u = prf.result();
+            char *tp = t.data();
+            const char *up = u.constData();
+            for (int j = 0;j < t.size();j++)
+                tp[j] ^= up[j];
+        }
+        out.append(t);
+    }
+
+    encKey = out.left(SNAPSHOT_KEY_SIZE);
+    macKey = out.mid(SNAPSHOT_KEY_SIZE, SNAPSHOT_KEY_SIZE);
+}
+
+void MPSnapshot::cryptBlock(const QByteArray &encKey, quint64 nonce, QByteArray &data)
+{
+    //Keystream block i is HMAC(encKey, nonce | i), nonces are unique in a file
+    //and keys are unique to a file thanks to the salt
+    QMessageAuthenticationCode prf(QCryptographicHash::Sha256, encKey);
+    char *d = data.data();
+    for (quint32 i = 0;i * SNAPSHOT_KEY_SIZE < (quint32)data.size();i++)
+    {
+        QByteArray c;
+        appendU64(c, nonce);
+        appendU32(c, i);
+        prf.reset();
+        prf.addData(c);
+        QByteArray ks = prf.result();
+
+        int pos = i * SNAPSHOT_KEY_SIZE;
+        int len = qMin(SNAPSHOT_KEY_SIZE, data.size() - pos);
+        for (int j = 0;j < len;j++)
+            d[pos + j] ^= ks.at(j);
+    }
+}
+
+MPSnapshotWriter::MPSnapshotWriter():
+    mac(QCryptographicHash::Sha256)
+{
+}
+
+MPSnapshotWriter::~MPSnapshotWriter()
+{
+    if (writing)
+        abort();
+}
+
+bool MPSnapshotWriter::open(const QString &p, int flashMbSize, const QString &passphrase, QString &errstr)
+{
+    path = p;
+    columns.clear();
+    index.clear();
+    blockCount = 0;
+    failed = false;
+    encKey.clear();
+
+    //New salt for each file
+    QByteArray salt(MPSnapshot::SaltSize, 0);
+    quint32 iterations = 0;
+    QByteArray macKey;
+    if (!passphrase.isEmpty())
+    {
+        std::random_device rd;
+        for (int i = 0;i < salt.size();i++)
+            salt[i] = static_cast<char>(rd());
+        iterations = MPSnapshot::KdfIterations;
+        MPSnapshot::deriveKeys(passphrase, salt, iterations, encKey, macKey);
+    }
+    mac.setKey(macKey);
+
+    file.setFileName(path + ".part");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errstr = QStringLiteral("Failed to create %1: %2").arg(file.fileName()).arg(file.errorString());
+        return false;
+    }
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    writing = true;
+
+    QByteArray header(SNAPSHOT_MAGIC);
+    appendU16(header, MPSnapshot::Version);
+    appendU16(header, passphrase.isEmpty()? 0: SNAPSHOT_FLAG_KEYED | SNAPSHOT_FLAG_ENCRYPTED);
+    appendU8(header, flashMbSize);
+    header.append(QByteArray(3, 0));
+    appendU64(header, QDateTime::currentMSecsSinceEpoch());
+    header.append(salt);
+    appendU32(header, iterations);
+    header.append(QByteArray(4, 0));
+    write(header);
+
+    return true;
+}
+
+void MPSnapshotWriter::write(const QByteArray &data)
+{
+    if (failed)
+        return;
+
+    mac.addData(data);
+    if (file.write(data) != data.size())
+        failed = true;
+}
+
+void MPSnapshotWriter::addRecord(int section, const QByteArray &record)
+{
+    Column &c = columns[section];
+    c.data.append(record);
+    c.count++;
+}
+
+void MPSnapshotWriter::flushColumn(int section)
+{
+    auto it = columns.find(section);
+    if (it == columns.end() || it->count == 0)
+        return;
+
+    QByteArray compressed = qCompress(it->data);
+    quint64 offset = file.pos() + SNAPSHOT_BLOCK_HEADER;
+    if (!encKey.isEmpty())
+        MPSnapshot::cryptBlock(encKey, offset, compressed);
+
+    //Index entries point to the block data
+    appendU8(index, section);
+    index.append(QByteArray(3, 0));
+    appendU32(index, it->count);
+    appendU64(index, offset);
+    appendU32(index, it->data.size());
+    appendU32(index, compressed.size());
+
+    QByteArray header;
+    appendU8(header, section);
+    header.append(QByteArray(3, 0));
+    appendU32(header, it->count);
+    appendU32(header, it->data.size());
+    appendU32(header, compressed.size());
+    write(header);
+    write(compressed);
+
+    blockCount++;
+    it->data.clear();
+    it->count = 0;
+}
+
+void MPSnapshotWriter::setCtr(const QByteArray &ctr)
+{
+    addRecord(MPSnapshot::SectionCtr, ctr);
+}
+
+void MPSnapshotWriter::setStartNodes(const QByteArray &startNode, const QByteArray &startDataNode)
+{
+    addRecord(MPSnapshot::SectionStartNode, startNode);
+    addRecord(MPSnapshot::SectionStartDataNode, startDataNode);
+}
+
+void MPSnapshotWriter::addFavorite(const QByteArray &favorite)
+{
+    addRecord(MPSnapshot::SectionFavorites, favorite.leftJustified(MOOLTIPASS_ADDRESS_SIZE, 0, true));
+}
+
+void MPSnapshotWriter::addCpzCtr(const QByteArray &cpzCtr)
+{
+    //Variable size, records are prefixed with their size
+    QByteArray r;
+    appendU8(r, cpzCtr.size());
+    r.append(cpzCtr.left(0xFF));
+    addRecord(MPSnapshot::SectionCpzCtr, r);
+}
+
+void MPSnapshotWriter::addNode(const MPNode *node)
+{
+    int type = node->getType();
+    if (type < MPNode::NodeParent || type > MPNode::NodeChildData)
+        return;
+
+    int addrSection = MPSnapshot::SectionNodeAddress + type;
+    int dataSection = MPSnapshot::SectionNodeData + type;
+    addRecord(addrSection, node->getAddress().leftJustified(NODE_ADDRESS_SIZE, 0, true));
+    addRecord(dataSection, node->getNodeData().leftJustified(MP_NODE_SIZE, 0, true));
+
+    //Address and data blocks are written in pairs
+    if (columns[dataSection].count >= (quint32)MPSnapshot::BlockRecords)
+    {
+        flushColumn(addrSection);
+        flushColumn(dataSection);
+    }
+}
+
+bool MPSnapshotWriter::finish(QString &errstr)
+{
+    for (int section: columns.keys())
+        flushColumn(section);
+
+    quint64 indexOffset = file.pos();
+    write(index);
+
+    QByteArray footer;
+    appendU64(footer, indexOffset);
+    appendU32(footer, blockCount);
+    appendU32(footer, 0);
+    footer.append(SNAPSHOT_END_MAGIC);
+    write(footer);
+
+    //HMAC is not part of itself
+    QByteArray m = mac.result();
+    if (!failed && file.write(m) != m.size())
+        failed = true;
+
+    if (failed || !file.flush())
+    {
+        errstr = QStringLiteral("Failed to write %1: %2").arg(file.fileName()).arg(file.errorString());
+        abort();
+        return false;
+    }
+    file.close();
+    writing = false;
+
+    QFile::remove(path);
+    if (!QFile::rename(path + ".part", path))
+    {
+        errstr = QStringLiteral("Failed to rename %1.part").arg(path);
+        QFile::remove(path + ".part");
+        return false;
+    }
+    return true;
+}
+
+void MPSnapshotWriter::abort()
+{
+    file.close();
+    QFile::remove(path + ".part");
+    writing = false;
+    encKey.fill(0);
+}
+
+MPSnapshotReader::MPSnapshotReader()
+{
+}
+
+MPSnapshotReader::~MPSnapshotReader()
+{
+    close();
+}
+
+void MPSnapshotReader::close()
+{
+    if (map)
+        file.unmap(const_cast<uchar *>(map));
+    map = nullptr;
+    mapSize = 0;
+    blocks.clear();
+    encKey.fill(0);
+    encKey.clear();
+    file.close();
+}
+
+bool MPSnapshotReader::open(const QString &path, const QString &passphrase, QString &errstr)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        errstr = QStringLiteral("Failed to open %1: %2").arg(path).arg(file.errorString());
+        return false;
+    }
+
+    mapSize = file.size();
+    if (mapSize < SNAPSHOT_HEADER_SIZE + SNAPSHOT_FOOTER_SIZE)
+    {
+        errstr = "Not a database snapshot";
+        close();
+        return false;
+    }
+
+    map = file.map(0, mapSize);
+    if (!map)
+    {
+        errstr = QStringLiteral("Failed to map %1: %2").arg(path).arg(file.errorString());
+        close();
+        return false;
+    }
+
+    const char *data = reinterpret_cast<const char *>(map);
+    const char *footer = data + mapSize - SNAPSHOT_FOOTER_SIZE;
+    if (memcmp(data, SNAPSHOT_MAGIC, 8) || memcmp(footer + 16, SNAPSHOT_END_MAGIC, 8))
+    {
+        errstr = "Not a database snapshot";
+        close();
+        return false;
+    }
+
+    quint16 version = qFromBigEndian<quint16>(map + 8);
+    quint16 flags = qFromBigEndian<quint16>(map + 10);
+    if (version != MPSnapshot::Version)
+    {
+        errstr = QStringLiteral("Unsupported snapshot version %1").arg(version);
+        close();
+        return false;
+    }
+    if ((flags & SNAPSHOT_FLAG_KEYED) && passphrase.isEmpty())
+    {
+        errstr = "A passphrase is needed for this snapshot";
+        close();
+        return false;
+    }
+    snapFlashMbSize = map[12];
+    created = QDateTime::fromMSecsSinceEpoch(qFromBigEndian<quint64>(map + 16));
+
+    QByteArray macKey;
+    if (flags & SNAPSHOT_FLAG_KEYED)
+    {
+        QByteArray salt(data + 24, MPSnapshot::SaltSize);
+        quint32 iterations = qFromBigEndian<quint32>(map + 24 + MPSnapshot::SaltSize);
+        if (iterations == 0 || iterations > SNAPSHOT_MAX_ITERATIONS)
+        {
+            errstr = "Snapshot header is invalid";
+            close();
+            return false;
+        }
+        QByteArray k;
+        MPSnapshot::deriveKeys(passphrase, salt, iterations, k, macKey);
+        if (flags & SNAPSHOT_FLAG_ENCRYPTED)
+            encKey = k;
+    }
+
+    //Authenticate everything before the HMAC, directly from the mapping
+    QMessageAuthenticationCode m(QCryptographicHash::Sha256, macKey);
+    qint64 macOffset = mapSize - SNAPSHOT_MAC_SIZE;
+    for (qint64 pos = 0;pos < macOffset;pos += 1024 * 1024)
+        m.addData(data + pos, qMin<qint64>(1024 * 1024, macOffset - pos));
+    if (m.result() != QByteArray::fromRawData(data + macOffset, SNAPSHOT_MAC_SIZE))
+    {
+        errstr = (flags & SNAPSHOT_FLAG_KEYED)?
+                    "Snapshot authentication failed, wrong passphrase or corrupted file":
+                    "Snapshot is corrupted, checksum mismatch";
+        close();
+        return false;
+    }
+
+    quint64 indexOffset = qFromBigEndian<quint64>(map + mapSize - SNAPSHOT_FOOTER_SIZE);
+    quint32 count = qFromBigEndian<quint32>(map + mapSize - SNAPSHOT_FOOTER_SIZE + 8);
+    if (indexOffset + (quint64)count * SNAPSHOT_INDEX_ENTRY > (quint64)(mapSize - SNAPSHOT_FOOTER_SIZE))
+    {
+        errstr = "Snapshot index is invalid";
+        close();
+        return false;
+    }
+
+    blocks.reserve(count);
+    for (quint32 i = 0;i < count;i++)
+    {
+        const uchar *e = map + indexOffset + i * SNAPSHOT_INDEX_ENTRY;
+        Block b;
+        b.section = e[0];
+        b.count = qFromBigEndian<quint32>(e + 4);
+        b.offset = qFromBigEndian<quint64>(e + 8);
+        b.rawSize = qFromBigEndian<quint32>(e + 16);
+        b.compressedSize = qFromBigEndian<quint32>(e + 20);
+        if (b.offset + b.compressedSize > indexOffset)
+        {
+            errstr = "Snapshot index is invalid";
+            close();
+            return false;
+        }
+        blocks.append(b);
+    }
+
+    return true;
+}
+
+QByteArray MPSnapshotReader::readBlock(const Block &b) const
+{
+    QByteArray d;
+    if (encKey.isEmpty())
+        d = qUncompress(map + b.offset, b.compressedSize);
+    else
+    {
+        QByteArray c(reinterpret_cast<const char *>(map + b.offset), b.compressedSize);
+        MPSnapshot::cryptBlock(encKey, b.offset, c);
+        d = qUncompress(c);
+    }
+    if ((quint32)d.size() != b.rawSize)
+    {
+        qWarning() << "Snapshot block at" << b.offset << "is invalid";
+        return QByteArray();
+    }
+    return d;
+}
+
+QByteArray MPSnapshotReader::readSingle(int section) const
+{
+    for (const Block &b: blocks)
+    {
+        if (b.section == section)
+            return readBlock(b);
+    }
+    return QByteArray();
+}
+
+QList<QByteArray> MPSnapshotReader::readRecords(int section, int size) const
+{
+    QList<QByteArray> l;
+    for (const Block &b: blocks)
+    {
+        if (b.section != section)
+            continue;
+        QByteArray d = readBlock(b);
+        for (int i = 0;i + size <= d.size();i += size)
+            l.append(d.mid(i, size));
+    }
+    return l;
+}
+
+QList<QByteArray> MPSnapshotReader::favorites() const
+{
+    return readRecords(MPSnapshot::SectionFavorites, MOOLTIPASS_ADDRESS_SIZE);
+}
+
+QList<QByteArray> MPSnapshotReader::cpzCtrValues() const
+{
+    QList<QByteArray> l;
+    QByteArray d = readSingle(MPSnapshot::SectionCpzCtr);
+    int i = 0;
+    while (i < d.size())
+    {
+        int sz = (quint8)d.at(i);
+        l.append(d.mid(i + 1, sz));
+        i += sz + 1;
+    }
+    return l;
+}
+
+int MPSnapshotReader::nodeCount(int nodeType) const
+{
+    int count = 0;
+    for (const Block &b: blocks)
+    {
+        if (b.section == MPSnapshot::SectionNodeData + nodeType)
+            count += b.count;
+    }
+    return count;
+}
+
+bool MPSnapshotReader::forEachNode(int nodeType, std::function<void(const QByteArray &, const QByteArray &)> fn) const
+{
+    //i-th address block goes with the i-th data block of the same type
+    QVector<const Block *> addrBlocks, dataBlocks;
+    for (const Block &b: blocks)
+    {
+        if (b.section == MPSnapshot::SectionNodeAddress + nodeType)
+            addrBlocks.append(&b);
+        else if (b.section == MPSnapshot::SectionNodeData + nodeType)
+            dataBlocks.append(&b);
+    }
+
+    if (addrBlocks.size() != dataBlocks.size())
+        return false;
+
+    for (int i = 0;i < addrBlocks.size();i++)
+    {
+        QByteArray addr = readBlock(*addrBlocks.at(i));
+        QByteArray data = readBlock(*dataBlocks.at(i));
+        quint32 count = addrBlocks.at(i)->count;
+        if (count != dataBlocks.at(i)->count ||
+            (quint32)addr.size() != count * NODE_ADDRESS_SIZE ||
+            (quint32)data.size() != count * MP_NODE_SIZE)
+            return false;
+
+        for (quint32 n = 0;n < count;n++)
+            fn(addr.mid(n * NODE_ADDRESS_SIZE, NODE_ADDRESS_SIZE), data.mid(n * MP_NODE_SIZE, MP_NODE_SIZE));
+    }
+
+    return true;
+}
@@ -0,0 +1,166 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef MPSNAPSHOT_H
+#define MPSNAPSHOT_H
+
+#include "Common.h"
+
+class MPNode;
+
+//Snapshot of the device database as loaded in memory management mode.
+//
+//File layout (integers are big endian):
+// - header: magic "MCDBSNAP", version, flags, flash size, creation date,
+//   PBKDF2 salt and iteration count
+// - blocks: a 16 bytes block header (section, record count, raw and
+//   compressed size) followed by the records of the section compressed
+//   with qCompress. Each section is a column: node addresses and node data
+//   are stored in separate sections, by blocks of at most SnapshotBlockRecords
+// - index of the blocks (section, count, offset, sizes)
+// - footer: index offset, block count, magic "MCDBEND1" and the
+//   HMAC-SHA256 of everything before it
+//
+//With a passphrase, an encryption key and a HMAC key are derived from it with
+//PBKDF2-HMAC-SHA256 and the random salt of the header. Compressed blocks are
+//then encrypted with a HMAC-SHA256 keystream in counter mode (the nonce is the
+//offset of the block in the file), and the whole file is authenticated with
+//the HMAC key. Without passphrase the file is only checksummed.
+//
+//Both sides stream: the writer only keeps the current block of each
+//section, the reader maps the file and decompresses one block at a time.
+namespace MPSnapshot
+{
+    enum Section
+    {
+        SectionCtr = 0x01,
+        SectionStartNode = 0x02,
+        SectionStartDataNode = 0x03,
+        SectionFavorites = 0x04,
+        SectionCpzCtr = 0x05,
+        SectionNodeAddress = 0x10, //+ node type
+        SectionNodeData = 0x20, //+ node type
+    };
+
+    const quint16 Version = 2;
+    const int BlockRecords = 512;
+    const int SaltSize = 16;
+    const quint32 KdfIterations = 100000;
+
+    //Encryption and HMAC keys of a file
+    void deriveKeys(const QString &passphrase, const QByteArray &salt, quint32 iterations,
+                    QByteArray &encKey, QByteArray &macKey);
+
+    //Encrypt or decrypt a block in place
+    void cryptBlock(const QByteArray &encKey, quint64 nonce, QByteArray &data);
+}
+
+class MPSnapshotWriter
+{
+public:
+    MPSnapshotWriter();
+    ~MPSnapshotWriter();
+
+    //Blocks are encrypted if passphrase is not empty
+    bool open(const QString &path, int flashMbSize, const QString &passphrase, QString &errstr);
+
+    void setCtr(const QByteArray &ctr);
+    void setStartNodes(const QByteArray &startNode, const QByteArray &startDataNode);
+    void addFavorite(const QByteArray &favorite);
+    void addCpzCtr(const QByteArray &cpzCtr);
+    void addNode(const MPNode *node);
+
+    //Write the pending blocks, the index and rename the .part file
+    bool finish(QString &errstr);
+    void abort();
+
+private:
+    Q_DISABLE_COPY(MPSnapshotWriter)
+
+    struct Column
+    {
+        QByteArray data;
+        quint32 count = 0;
+    };
+
+    void addRecord(int section, const QByteArray &record);
+    void flushColumn(int section);
+    void write(const QByteArray &data);
+
+    QFile file;
+    QString path;
+    QMessageAuthenticationCode mac;
+    QByteArray encKey;
+    QMap<int, Column> columns;
+    QByteArray index;
+    quint32 blockCount = 0;
+    bool writing = false;
+    bool failed = false;
+};
+
+class MPSnapshotReader
+{
+public:
+    MPSnapshotReader();
+    ~MPSnapshotReader();
+
+    //Maps the file and checks its HMAC
+    bool open(const QString &path, const QString &passphrase, QString &errstr);
+    void close();
+
+    int flashMbSize() const { return snapFlashMbSize; }
+    QDateTime creationDate() const { return created; }
+
+    QByteArray ctr() const { return readSingle(MPSnapshot::SectionCtr); }
+    QByteArray startNode() const { return readSingle(MPSnapshot::SectionStartNode); }
+    QByteArray startDataNode() const { return readSingle(MPSnapshot::SectionStartDataNode); }
+    QList<QByteArray> favorites() const;
+    QList<QByteArray> cpzCtrValues() const;
+
+    //Node count for a MPNode type
+    int nodeCount(int nodeType) const;
+
+    //Call fn for each node of a MPNode type, blocks are decompressed one at a time
+    bool forEachNode(int nodeType, std::function<void(const QByteArray &address, const QByteArray &data)> fn) const;
+
+private:
+    Q_DISABLE_COPY(MPSnapshotReader)
+
+    struct Block
+    {
+        int section;
+        quint32 count;
+        quint64 offset;
+        quint32 rawSize;
+        quint32 compressedSize;
+    };
+
+    QByteArray readBlock(const Block &b) const;
+    QByteArray readSingle(int section) const;
+    QList<QByteArray> readRecords(int section, int size) const;
+
+    QFile file;
+    const uchar *map = nullptr;
+    qint64 mapSize = 0;
+    QVector<Block> blocks;
+    QByteArray encKey;
+    int snapFlashMbSize = 0;
+    QDateTime created;
+};
+
+#endif // MPSNAPSHOT_H
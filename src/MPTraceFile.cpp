@@ -0,0 +1,163 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "MPTraceFile.h"
+#include "MooltipassCmds.h"
+
+#define TRACE_MAGIC         "MCTRACE1"
+#define TRACE_PACKET_SIZE   64
+
+#define TRACE_FLAG_IN       0x01
+#define TRACE_FLAG_PADDED   0x02
+
+//Packets carrying a password or data node contents
+static bool hasSecretPayload(MPTraceFile::Direction direction, const QByteArray &data)
+{
+    if (data.size() <= MP_PAYLOAD_FIELD_INDEX)
+        return false;
+
+    switch ((quint8)data[MP_CMD_FIELD_INDEX])
+    {
+    case MP_GET_PASSWORD:
+    case MP_READ_32B_IN_DN:
+        return direction == MPTraceFile::In;
+    case MP_SET_PASSWORD:
+    case MP_CHECK_PASSWORD:
+    case MP_WRITE_32B_IN_DN:
+        return direction == MPTraceFile::Out;
+    default:
+        return false;
+    }
+}
+
+MPTraceFile::MPTraceFile()
+{
+}
+
+MPTraceFile::~MPTraceFile()
+{
+    close();
+}
+
+bool MPTraceFile::create(const QString &path, QString &errstr)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errstr = QStringLiteral("Failed to create %1: %2").arg(path).arg(file.errorString());
+        return false;
+    }
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    file.write(TRACE_MAGIC, 8);
+    timer.start();
+    lastRecord = 0;
+    return true;
+}
+
+void MPTraceFile::record(Direction direction, const QByteArray &packet)
+{
+    if (!file.isOpen() || !file.isWritable())
+        return;
+
+    //Only the size of secrets is kept, given by the length field
+    QByteArray data = packet;
+    if (hasSecretPayload(direction, data))
+        memset(data.data() + MP_PAYLOAD_FIELD_INDEX, 0, data.size() - MP_PAYLOAD_FIELD_INDEX);
+
+    qint64 now = timer.nsecsElapsed() / 1000;
+    quint64 delay = now - lastRecord;
+    lastRecord = now;
+
+    int len = qMin(data.size(), 255);
+    quint8 flags = direction == In? TRACE_FLAG_IN: 0;
+    if (data.size() == TRACE_PACKET_SIZE)
+    {
+        //Packets read from the device are mostly zero padding
+        flags |= TRACE_FLAG_PADDED;
+        while (len > 0 && data.at(len - 1) == 0)
+            len--;
+    }
+
+    QByteArray rec;
+    rec.reserve(len + 12);
+    rec.append((char)flags);
+    rec.append((char)len);
+    do
+    {
+        quint8 b = delay & 0x7F;
+        delay >>= 7;
+        rec.append((char)(delay? b | 0x80: b));
+    } while (delay);
+    rec.append(data.constData(), len);
+
+    file.write(rec);
+}
+
+void MPTraceFile::close()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+bool MPTraceFile::open(const QString &path, QString &errstr)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        errstr = QStringLiteral("Failed to open %1: %2").arg(path).arg(file.errorString());
+        return false;
+    }
+
+    if (file.read(8) != TRACE_MAGIC)
+    {
+        errstr = QStringLiteral("%1 is not a trace file").arg(path);
+        file.close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MPTraceFile::readRecord(Record &rec)
+{
+    char flags, len;
+    if (!file.getChar(&flags) || !file.getChar(&len))
+        return false;
+
+    quint64 delay = 0;
+    int shift = 0;
+    char b;
+    do
+    {
+        if (!file.getChar(&b) || shift > 63)
+            return false;
+        delay |= (quint64)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    rec.direction = (flags & TRACE_FLAG_IN)? In: Out;
+    rec.delay = delay;
+    rec.data = file.read((quint8)len);
+    if (rec.data.size() != (quint8)len)
+        return false;
+    if (flags & TRACE_FLAG_PADDED)
+        rec.data.append(QByteArray(TRACE_PACKET_SIZE - rec.data.size(), 0));
+
+    return true;
+}
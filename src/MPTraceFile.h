@@ -0,0 +1,72 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef MPTRACEFILE_H
+#define MPTRACEFILE_H
+
+#include <QtCore>
+
+//Trace of the USB packets exchanged with a device, used to replay a session
+//without the device (see MPDevice_replay).
+//File layout: magic followed by records. A record is a flags byte (direction,
+//packet padded to 64 bytes), the significant length on one byte, the delay
+//since the previous record in us (LEB128 varint) and the packet bytes.
+//Trailing zeros of padded packets are not stored.
+//Payloads holding secrets (passwords, data node contents) are zeroed, only
+//their length is kept. Logins, service names and descriptions are recorded.
+class MPTraceFile
+{
+public:
+    enum Direction
+    {
+        Out = 0, //daemon to device
+        In = 1   //device to daemon
+    };
+
+    class Record
+    {
+    public:
+        Direction direction = Out;
+        qint64 delay = 0; //us since previous record
+        QByteArray data;
+    };
+
+    MPTraceFile();
+    ~MPTraceFile();
+
+    //Writing. Delays are measured between calls to record()
+    bool create(const QString &path, QString &errstr);
+    void record(Direction direction, const QByteArray &packet);
+    void close();
+
+    //Reading
+    bool open(const QString &path, QString &errstr);
+    bool readRecord(Record &rec);
+    bool atEnd() const { return file.atEnd(); }
+
+    QString fileName() const { return file.fileName(); }
+
+private:
+    Q_DISABLE_COPY(MPTraceFile)
+
+    QFile file;
+    QElapsedTimer timer;
+    qint64 lastRecord = 0;
+};
+
+#endif // MPTRACEFILE_H
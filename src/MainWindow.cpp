@@ -36,7 +36,8 @@ static void updateComboBoxIndex(QComboBox* cb, const T & value, int defaultIdx =
 MainWindow::MainWindow(WSClient *client, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    wsClient(client)
+    wsClient(client),
+    logBuffer(100 * 1024)
 {
     QVariantMap whiteButtons = {{ "color", QColor(Qt::white) },
                                 { "color-selected", QColor(Qt::white) },
@@ -77,6 +78,7 @@ MainWindow::MainWindow(WSClient *client, QWidget *parent) :
 
     ui->pushButtonExportFile->setStyleSheet(CSS_BLUE_BUTTON);
     ui->pushButtonImportFile->setStyleSheet(CSS_BLUE_BUTTON);
+    ui->pushButtonImportCsv->setStyleSheet(CSS_BLUE_BUTTON);
     ui->pushButtonSettingsReset->setStyleSheet(CSS_BLUE_BUTTON);
     ui->pushButtonSettingsSave->setStyleSheet(CSS_BLUE_BUTTON);
 
@@ -697,16 +699,13 @@ void MainWindow::checkAutoStart()
         ui->pushButtonAutoStart->setText(tr("Enable"));
 }
 
-void MainWindow::daemonLogAppend(const QByteArray &logdata)
+void MainWindow::daemonLogAppend(QtMsgType type, const QByteArray &line)
 {
     if (dialogLog)
-        dialogLog->appendData(logdata);
-    logBuffer.append(logdata);
+        dialogLog->appendRecord(type, line);
 
-    const int maxsz = 100 * 1024;
-
-    if (logBuffer.size() > maxsz)
-        logBuffer = logBuffer.right(maxsz);
+    //The level is kept as the first byte of the line to color it when the window opens
+    logBuffer.append(static_cast<char>(type) + line);
 }
 
 void MainWindow::on_pushButtonViewLogs_clicked()
@@ -718,12 +717,14 @@ void MainWindow::on_pushButtonViewLogs_clicked()
     }
 
     dialogLog = new WindowLog();
-    dialogLog->appendData(logBuffer);
+    dialogLog->appendBuffered(logBuffer.data());
     dialogLog->show();
     connect(dialogLog, &WindowLog::destroyed, [this]()
     {
         dialogLog = nullptr;
+        emit logWindowOpenedChanged(false);
     });
+    emit logWindowOpenedChanged(true);
 }
 
 bool MainWindow::isHttpDebugChecked()
@@ -737,14 +738,295 @@ void MainWindow::on_checkBoxSSHAgent_stateChanged(int)
     s.setValue("settings/auto_start_ssh", ui->checkBoxSSHAgent->isChecked());
 }
 
+bool MainWindow::askImageType(const QString &label, QString &type)
+{
+    QStringList items = { tr("Flash memory"), tr("EEPROM") };
+    bool ok = false;
+    QString item = QInputDialog::getItem(this, "Moolticute", label, items, 0, false, &ok);
+    if (!ok)
+        return false;
+
+    type = item == items.at(0)? "flash": "eeprom";
+    return true;
+}
+
+void MainWindow::showImageProgress(const QString &label)
+{
+    imageProgressDialog = new QProgressDialog(label, QString(), 0, 0, this);
+    imageProgressDialog->setWindowModality(Qt::WindowModal);
+    imageProgressDialog->setMinimumDuration(0);
+    imageProgressDialog->show();
+
+    connect(wsClient, SIGNAL(progressChanged(int,int)), this, SLOT(imageProgress(int,int)));
+}
+
+void MainWindow::hideImageProgress()
+{
+    disconnect(wsClient, SIGNAL(progressChanged(int,int)), this, SLOT(imageProgress(int,int)));
+
+    delete imageProgressDialog;
+    imageProgressDialog = nullptr;
+}
+
+void MainWindow::imageProgress(int total, int current)
+{
+    if (!imageProgressDialog)
+        return;
+    imageProgressDialog->setMaximum(total);
+    imageProgressDialog->setValue(current);
+}
+
 void MainWindow::on_pushButtonExportFile_clicked()
 {
-    QMessageBox::information(this, "Moolticute", "Not yet implemented.");
+    QString type;
+    if (!askImageType(tr("Memory to export:"), type))
+        return;
+
+    imageFileName = QFileDialog::getSaveFileName(this, tr("Export device image..."),
+                                                 QString(), tr("Device image (*.mpimg)"));
+    if (imageFileName.isEmpty())
+        return;
+
+    showImageProgress(tr("Exporting, please approve the request on the device..."));
+    connect(wsClient, SIGNAL(imageExported(bool,QString,QString)), this, SLOT(imageExported(bool,QString,QString)));
+    wsClient->exportImage(type);
+}
+
+void MainWindow::imageExported(bool success, const QString &errstr, const QString &file)
+{
+    disconnect(wsClient, SIGNAL(imageExported(bool,QString,QString)), this, SLOT(imageExported(bool,QString,QString)));
+    hideImageProgress();
+
+    if (!success)
+    {
+        QMessageBox::warning(this, "Moolticute", tr("Export failed: %1").arg(errstr));
+        return;
+    }
+
+    //Daemon writes the image in its own dir, move it where the user wants it
+    QFile::remove(imageFileName);
+    if (!QFile::copy(file, imageFileName))
+    {
+        QMessageBox::warning(this, "Moolticute", tr("Unable to write '%1', the image is in '%2'").arg(imageFileName).arg(file));
+        return;
+    }
+    QFile::remove(file);
+
+    QMessageBox::information(this, "Moolticute", tr("Device image exported to '%1'").arg(imageFileName));
 }
 
 void MainWindow::on_pushButtonImportFile_clicked()
 {
-    QMessageBox::information(this, "Moolticute", "Not yet implemented.");
+    QString type;
+    if (!askImageType(tr("Memory to import:"), type))
+        return;
+
+    imageFileName = QFileDialog::getOpenFileName(this, tr("Import device image..."),
+                                                 QString(), tr("Device image (*.mpimg)"));
+    if (imageFileName.isEmpty())
+        return;
+
+    int r = QMessageBox::question(this, "Moolticute", tr("The content of the device will be replaced by this image. Do you want to continue?"));
+    if (r != QMessageBox::Yes)
+        return;
+
+    //Daemon only reads images from its own dir, copy the file there
+    QString name = QStringLiteral("import-%1.mpimg").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    QDir().mkpath(Common::imagesDir());
+    QString file = QDir(Common::imagesDir()).filePath(name);
+    QFile::remove(file);
+    if (!QFile::copy(imageFileName, file))
+    {
+        QMessageBox::warning(this, "Moolticute", tr("Unable to read '%1'").arg(imageFileName));
+        return;
+    }
+    imageFileName = file;
+
+    showImageProgress(tr("Importing, please approve the request on the device..."));
+    connect(wsClient, SIGNAL(imageImported(bool,QString)), this, SLOT(imageImported(bool,QString)));
+    wsClient->importImage(type, name);
+}
+
+void MainWindow::imageImported(bool success, const QString &errstr)
+{
+    disconnect(wsClient, SIGNAL(imageImported(bool,QString)), this, SLOT(imageImported(bool,QString)));
+    hideImageProgress();
+    QFile::remove(imageFileName);
+
+    if (!success)
+        QMessageBox::warning(this, "Moolticute", tr("Import failed: %1").arg(errstr));
+    else
+        QMessageBox::information(this, "Moolticute", tr("Device image imported"));
+}
+
+//The device stores the description in MOOLTIPASS_DESC_SIZE bytes of UTF-8,
+//cut it on a character boundary
+static QString truncateDescription(const QString &desc)
+{
+    QString d = desc;
+    while (d.toUtf8().size() > MOOLTIPASS_DESC_SIZE)
+    {
+        if (d.size() > 1 && d.at(d.size() - 1).isLowSurrogate() && d.at(d.size() - 2).isHighSurrogate())
+            d.chop(2);
+        else
+            d.chop(1);
+    }
+    return d;
+}
+
+//Split a CSV file in rows of fields. Quoted fields can contain separators,
+//new lines and doubled quotes
+static QList<QStringList> parseCsv(const QString &text)
+{
+    QList<QStringList> rows;
+    QStringList row;
+    QString field;
+    bool quoted = false;
+
+    for (int i = 0;i < text.size();i++)
+    {
+        QChar c = text.at(i);
+        if (quoted)
+        {
+            if (c == '"' && i + 1 < text.size() && text.at(i + 1) == '"')
+                field.append(text.at(++i));
+            else if (c == '"')
+                quoted = false;
+            else
+                field.append(c);
+        }
+        else if (c == '"')
+            quoted = true;
+        else if (c == ',')
+        {
+            row.append(field);
+            field.clear();
+        }
+        else if (c == '\n')
+        {
+            row.append(field);
+            field.clear();
+            if (row.size() > 1 || !row.first().isEmpty())
+                rows.append(row);
+            row.clear();
+        }
+        else if (c != '\r')
+            field.append(c);
+    }
+
+    row.append(field);
+    if (row.size() > 1 || !row.first().isEmpty())
+        rows.append(row);
+
+    return rows;
+}
+
+void MainWindow::on_pushButtonImportCsv_clicked()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import credentials..."),
+                                                    QString(), tr("CSV file (*.csv)"));
+    if (fileName.isEmpty())
+        return;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+    {
+        QMessageBox::warning(this, "Moolticute", tr("Unable to read '%1'").arg(fileName));
+        return;
+    }
+    QList<QStringList> rows = parseCsv(QString::fromUtf8(f.readAll()));
+
+    //Columns are service,login,password[,description] unless there is a header
+    //like the exports of other password managers (url, username, password...)
+    int colService = 0, colLogin = 1, colPassword = 2, colDesc = 3;
+    if (!rows.isEmpty())
+    {
+        QStringList header;
+        for (const QString &h: rows.first())
+            header.append(h.trimmed().toLower());
+
+        if (header.contains("password"))
+        {
+            auto column = [&header](const QStringList &names)
+            {
+                for (const QString &n: names)
+                    if (header.contains(n))
+                        return header.indexOf(n);
+                return -1;
+            };
+            colService = column({ "service", "url", "website", "name", "title" });
+            colLogin = column({ "login", "username", "user", "email" });
+            colPassword = header.indexOf("password");
+            colDesc = column({ "description", "name", "title" });
+            if (colDesc == colService)
+                colDesc = -1;
+            rows.removeFirst();
+        }
+    }
+
+    if (colService < 0 || colLogin < 0)
+    {
+        QMessageBox::warning(this, "Moolticute", tr("Service and login columns not found in '%1'").arg(fileName));
+        return;
+    }
+
+    QJsonArray credentials;
+    for (const QStringList &row: rows)
+    {
+        QString service = row.value(colService).trimmed();
+        //Keep only the host of urls
+        QUrl url(service);
+        if (service.contains("://") && !url.host().isEmpty())
+            service = url.host();
+
+        QJsonObject c = {{ "service", service },
+                         { "login", row.value(colLogin) },
+                         { "password", row.value(colPassword) }};
+        if (colDesc >= 0 && !row.value(colDesc).isEmpty())
+            c["description"] = truncateDescription(row.value(colDesc));
+        credentials.append(c);
+    }
+
+    if (credentials.isEmpty())
+    {
+        QMessageBox::warning(this, "Moolticute", tr("No credential found in '%1'").arg(fileName));
+        return;
+    }
+
+    int r = QMessageBox::question(this, "Moolticute",
+                                  tr("%1 credentials will be added to the device. "
+                                     "You will have to approve the memory management mode on the device, "
+                                     "then each new login and each changed password once. "
+                                     "Do you want to continue?").arg(credentials.size()));
+    if (r != QMessageBox::Yes)
+        return;
+
+    showImageProgress(tr("Importing credentials, please follow the instructions on the device..."));
+    connect(wsClient, SIGNAL(credentialsImported(bool,QString,QStringList)), this, SLOT(credentialsImported(bool,QString,QStringList)));
+    wsClient->importCredentials(credentials);
+}
+
+void MainWindow::credentialsImported(bool success, const QString &errstr, const QStringList &failures)
+{
+    disconnect(wsClient, SIGNAL(credentialsImported(bool,QString,QStringList)), this, SLOT(credentialsImported(bool,QString,QStringList)));
+    hideImageProgress();
+
+    if (failures.isEmpty())
+    {
+        if (!success)
+            QMessageBox::warning(this, "Moolticute", tr("Import failed: %1").arg(errstr));
+        else
+            QMessageBox::information(this, "Moolticute", tr("Credentials imported"));
+        return;
+    }
+
+    //Logins added without a password are listed, they have to be fixed by hand
+    QMessageBox box(QMessageBox::Warning, "Moolticute",
+                    success? tr("%1 credentials were not imported.").arg(failures.size()):
+                             tr("Import failed: %1\n%2 credentials were not imported.").arg(errstr).arg(failures.size()),
+                    QMessageBox::Ok, this);
+    box.setDetailedText(failures.join("\n"));
+    box.exec();
 }
 
 void MainWindow::on_pushButtonIntegrity_clicked()
@@ -23,6 +23,7 @@
 #include "WSClient.h"
 #include <QtAwesome.h>
 #include "WindowLog.h"
+#include "LogBuffer.h"
 
 namespace Ui {
 class MainWindow;
@@ -36,12 +37,15 @@ public:
     explicit MainWindow(WSClient *client, QWidget *parent = 0);
     ~MainWindow();
 
-    void daemonLogAppend(const QByteArray &logdata);
+    //Formatted log line of the daemon, without colors
+    void daemonLogAppend(QtMsgType type, const QByteArray &line);
+    bool isLogWindowOpened() const { return dialogLog != nullptr; }
 
     bool isHttpDebugChecked();
 
 signals:
     void windowCloseRequested();
+    void logWindowOpenedChanged(bool opened);
 
 private slots:
     void enableCredentialsManagement(bool enable);
@@ -59,6 +63,11 @@ private slots:
 
     void loadingProgress(int total, int current);
 
+    void imageProgress(int total, int current);
+    void imageExported(bool success, const QString &errstr, const QString &file);
+    void imageImported(bool success, const QString &errstr);
+    void credentialsImported(bool success, const QString &errstr, const QStringList &failures);
+
     void on_pushButtonViewLogs_clicked();
     void on_pushButtonAutoStart_clicked();
 
@@ -66,6 +75,7 @@ private slots:
 
     void on_pushButtonExportFile_clicked();
     void on_pushButtonImportFile_clicked();
+    void on_pushButtonImportCsv_clicked();
     void on_pushButtonIntegrity_clicked();
 
     //Settings page
@@ -74,6 +84,9 @@ private slots:
 
 private:
     void setUIDRequestInstructionsWithId(const QString &id = "XXXX");
+    bool askImageType(const QString &label, QString &type);
+    void showImageProgress(const QString &label);
+    void hideImageProgress();
 
     virtual void closeEvent(QCloseEvent *event);
 
@@ -85,7 +98,10 @@ private:
     WSClient *wsClient;
 
     WindowLog *dialogLog = nullptr;
-    QByteArray logBuffer;
+    LogBuffer logBuffer;
+
+    QProgressDialog *imageProgressDialog = nullptr;
+    QString imageFileName;
 
     QMovie* gb_spinner;
 };
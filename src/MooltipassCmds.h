@@ -29,6 +29,7 @@
 // Max lengths
 #define MP_MAX_SERVICE_LENGTH   121
 #define MP_MAX_LOGIN_LENGTH     63
+#define MP_MAX_PASSWORD_LENGTH  32
 
 //Mooltipass commands
 #define MP_EXPORT_FLASH_START    0x8A
@@ -25,11 +25,13 @@ OutputLog::OutputLog(QWidget *parent):
     setMouseTracking(true);
     setUndoRedoEnabled(false);
 
-    m_scrollTimer.setInterval(10);
-    m_scrollTimer.setSingleShot(true);
-    connect(&m_scrollTimer, &QTimer::timeout,
-            this, &OutputLog::scrollToBottom);
-    m_lastMessage.start();
+    setMaximumBlockCount(m_maxLineCount);
+
+    //Lines received during a frame are inserted at once
+    m_flushTimer.setInterval(16);
+    m_flushTimer.setSingleShot(true);
+    connect(&m_flushTimer, &QTimer::timeout,
+            this, &OutputLog::flushPending);
 
     cursor = textCursor();
 
@@ -109,41 +111,49 @@ int OutputLog::maxLineCount() const
 
 void OutputLog::appendMessage(const QString &output, const QTextCharFormat &format)
 {
-    const QString out = normalizeNewlines(output);
-    setMaximumBlockCount(m_maxLineCount);
-    const bool atBottom = isScrollbarAtBottom() || m_scrollTimer.isActive();
+    //Consecutive text with the same format is merged
+    if (!m_pending.isEmpty() && m_pending.last().format == format)
+        m_pending.last().text.append(output);
+    else
+        m_pending.append(Utils::FormattedText(output, format));
+
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+}
+
+void OutputLog::flushPending()
+{
+    m_flushTimer.stop();
+    if (m_pending.isEmpty())
+        return;
+
+    const QList<Utils::FormattedText> pending = m_pending;
+    m_pending.clear();
+    const bool atBottom = isScrollbarAtBottom();
 
     if (!cursor.atEnd())
         cursor.movePosition(QTextCursor::End);
 
-    foreach (const Utils::FormattedText &output, parseAnsi(doNewlineEnforcement(out), format))
+    //Layout is updated once for the whole batch
+    cursor.beginEditBlock();
+    for (const Utils::FormattedText &output: pending)
     {
+        const QString text = doNewlineEnforcement(normalizeNewlines(output.text));
         int startPos = 0;
         int crPos = -1;
-        while ((crPos = output.text.indexOf(QLatin1Char('\r'), startPos)) >= 0)
+        while ((crPos = text.indexOf(QLatin1Char('\r'), startPos)) >= 0)
         {
-            append(cursor, output.text.mid(startPos, crPos - startPos), output.format);
+            append(cursor, text.mid(startPos, crPos - startPos), output.format);
             startPos = crPos + 1;
             overwriteOutput = true;
         }
-        if (startPos < output.text.count())
-            append(cursor, output.text.mid(startPos), output.format);
+        if (startPos < text.count())
+            append(cursor, text.mid(startPos), output.format);
     }
+    cursor.endEditBlock();
 
     if (atBottom)
-    {
-        if (m_lastMessage.elapsed() < 5)
-        {
-            m_scrollTimer.start();
-        }
-        else
-        {
-            m_scrollTimer.stop();
-            scrollToBottom();
-        }
-    }
-
-    m_lastMessage.start();
+        scrollToBottom();
 }
 
 void OutputLog::append(QTextCursor &cursor, const QString &text, const QTextCharFormat &format)
@@ -164,6 +174,8 @@ bool OutputLog::isScrollbarAtBottom() const
 
 void OutputLog::clear()
 {
+    m_flushTimer.stop();
+    m_pending.clear();
     m_enforceNewline = false;
     QPlainTextEdit::clear();
 }
@@ -191,8 +203,3 @@ QString OutputLog::normalizeNewlines(const QString &text)
     res.replace(QLatin1String("\r\n"), QLatin1String("\n"));
     return res;
 }
-
-QList<Utils::FormattedText> OutputLog::parseAnsi(const QString &text, const QTextCharFormat &format)
-{
-    return escapeCodeHandler.parseText(Utils::FormattedText(text, format));
-}
@@ -30,6 +30,8 @@ public:
     OutputLog(QWidget *parent = 0);
     ~OutputLog();
 
+    //Text is queued and inserted in the document once per frame,
+    //whatever the number of different formats
     void appendMessage(const QString &out, const QTextCharFormat &format = QTextCharFormat());
 
     void clear();
@@ -50,24 +52,22 @@ protected:
 
 private slots:
     void scrollToBottom();
+    void flushPending();
 
 private:
-    QTimer m_scrollTimer;
-    QTime m_lastMessage;
+    QTimer m_flushTimer;
+    QList<Utils::FormattedText> m_pending;
 
     bool m_enforceNewline = false;
     bool m_scrollToBottom = false;
     int m_maxLineCount = 100000;
     QTextCursor cursor;
     bool overwriteOutput = false;
-    Utils::AnsiEscapeCodeHandler escapeCodeHandler;
 
     QString doNewlineEnforcement(const QString &out);
 
     QString normalizeNewlines(const QString &text);
     void append(QTextCursor &cursor, const QString &text, const QTextCharFormat &format);
-
-    QList<Utils::FormattedText> parseAnsi(const QString &text, const QTextCharFormat &format);
 };
 
 #endif // OUTPUTLOG_H
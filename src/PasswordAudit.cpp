@@ -0,0 +1,201 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "PasswordAudit.h"
+#include "PasswordStrength.h"
+#include "WSClient.h"
+#include <QtConcurrent>
+#include <random>
+
+//Same limit as the "Weak" quality of the password generator
+#define AUDIT_WEAK_ENTROPY  55
+#define AUDIT_KEY_SIZE      32
+
+PasswordAudit::PasswordAudit(WSClient *client, QObject *parent):
+    QObject(parent),
+    wsClient(client)
+{
+}
+
+PasswordAudit::~PasswordAudit()
+{
+    stop();
+}
+
+void PasswordAudit::start(const QList<PasswordAuditKey> &credentials)
+{
+    if (running || credentials.isEmpty())
+        return;
+
+    auditId++;
+    requested = credentials;
+    entries.clear();
+    hashes.clear();
+    received = 0;
+    pendingScores = 0;
+    batchDone = false;
+    batchSuccess = false;
+
+    //New key for each audit
+    std::random_device rd;
+    hashKey.resize(AUDIT_KEY_SIZE);
+    for (int i = 0;i < AUDIT_KEY_SIZE;i++)
+        hashKey[i] = static_cast<char>(rd());
+
+    running = true;
+    connect(wsClient, &WSClient::passwordBatchItem, this, &PasswordAudit::onPasswordItem);
+    connect(wsClient, &WSClient::passwordBatchFinished, this, &PasswordAudit::onBatchFinished);
+    connect(wsClient, &WSClient::connectedChanged, this, &PasswordAudit::onConnectedChanged);
+
+    qInfo() << "Starting password audit of" << requested.size() << "credentials";
+    wsClient->requestPasswordsBatch(requested);
+    emit progressChanged(requested.size(), 0);
+}
+
+void PasswordAudit::cancel()
+{
+    if (!running)
+        return;
+
+    //The daemon still ends the batch, remaining passwords are ignored
+    qInfo() << "Password audit cancelled";
+    auditId++;
+    stop();
+}
+
+void PasswordAudit::stop()
+{
+    disconnect(wsClient, &WSClient::passwordBatchItem, this, &PasswordAudit::onPasswordItem);
+    disconnect(wsClient, &WSClient::passwordBatchFinished, this, &PasswordAudit::onBatchFinished);
+    disconnect(wsClient, &WSClient::connectedChanged, this, &PasswordAudit::onConnectedChanged);
+    running = false;
+    hashes.clear();
+    hashKey.fill('\0');
+    hashKey.clear();
+}
+
+bool PasswordAudit::isWeak(const PasswordAuditEntry &entry)
+{
+    return !entry.failed && entry.entropy < AUDIT_WEAK_ENTROPY;
+}
+
+void PasswordAudit::onPasswordItem(int index, const QString &, const QString &, const QString &password, bool success)
+{
+    if (index < 0 || index >= requested.size())
+        return;
+
+    //Report is keyed by the requested service/login, not the ones resolved by the device
+    const PasswordAuditKey &key = requested.at(index);
+    PasswordAuditEntry &entry = entries[key];
+    entry.service = key.first;
+    entry.login = key.second;
+
+    received++;
+    emit progressChanged(requested.size(), received);
+
+    if (!success)
+    {
+        entry.failed = true;
+        entry.errorString = tr("Password could not be read");
+        checkFinished();
+        return;
+    }
+
+    //The worker gets its own copy of the password and clears it when done
+    QByteArray *pw = new QByteArray(password.toUtf8());
+    QByteArray k = hashKey;
+    int id = auditId;
+
+    pendingScores++;
+    QFutureWatcher<Score> *watcher = new QFutureWatcher<Score>(this);
+    connect(watcher, &QFutureWatcher<Score>::finished, this, [this, watcher, index, id]()
+    {
+        watcher->deleteLater();
+        if (id == auditId)
+            scoreFinished(index, watcher->result());
+    });
+
+    //Scored on all cores, the GUI is only waiting for the device here
+    watcher->setFuture(QtConcurrent::run([pw, k]()
+    {
+        Score s;
+        s.entropy = PasswordStrength::entropy(*pw, false);
+        s.hash = QMessageAuthenticationCode::hash(*pw, k, QCryptographicHash::Sha256);
+        pw->fill('\0');
+        delete pw;
+        return s;
+    }));
+}
+
+void PasswordAudit::onBatchFinished(bool success)
+{
+    batchDone = true;
+    batchSuccess = success;
+    checkFinished();
+}
+
+void PasswordAudit::onConnectedChanged(bool connected)
+{
+    if (connected || batchDone)
+        return;
+
+    //The batch result will never come, end the audit once the received
+    //passwords are scored, the others are reported as not checked
+    qWarning() << "Device or daemon disconnected, password audit cancelled";
+    onBatchFinished(false);
+}
+
+void PasswordAudit::scoreFinished(int index, const Score &score)
+{
+    pendingScores--;
+
+    const PasswordAuditKey &key = requested.at(index);
+    entries[key].entropy = score.entropy;
+    hashes[key] = score.hash;
+
+    checkFinished();
+}
+
+void PasswordAudit::checkFinished()
+{
+    if (!running || !batchDone || pendingScores > 0)
+        return;
+
+    //Credentials without answer (failed batch)
+    for (const PasswordAuditKey &key: requested)
+    {
+        if (entries.contains(key))
+            continue;
+        PasswordAuditEntry &entry = entries[key];
+        entry.service = key.first;
+        entry.login = key.second;
+        entry.failed = true;
+        entry.errorString = tr("Password not checked");
+    }
+
+    QHash<QByteArray, int> counts;
+    for (const QByteArray &h: hashes)
+        counts[h]++;
+    for (auto it = hashes.constBegin();it != hashes.constEnd();it++)
+        entries[it.key()].reuseCount = counts.value(it.value()) - 1;
+
+    qInfo() << "Password audit finished," << hashes.size() << "of" << requested.size() << "passwords checked";
+
+    stop();
+    emit finished(batchSuccess);
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef PASSWORDAUDIT_H
+#define PASSWORDAUDIT_H
+
+#include <QtCore>
+
+class WSClient;
+
+class PasswordAuditEntry
+{
+public:
+    QString service;
+    QString login;
+    bool failed = false;
+    QString errorString;
+    double entropy = 0;
+    //Number of other credentials using the same password
+    int reuseCount = 0;
+};
+
+typedef QPair<QString, QString> PasswordAuditKey;
+
+//Check the passwords of all credentials at once.
+//The passwords are asked to the daemon with one batch request (the user still
+//has to approve them on the device) and their strength is estimated in
+//parallel as soon as they arrive. Reused passwords are found by comparing
+//keyed hashes, the key is random and only lives for one audit, and the
+//passwords are cleared once scored.
+class PasswordAudit: public QObject
+{
+    Q_OBJECT
+public:
+    PasswordAudit(WSClient *client, QObject *parent = nullptr);
+    ~PasswordAudit();
+
+    //Credentials are service/login pairs
+    void start(const QList<PasswordAuditKey> &credentials);
+    void cancel();
+    bool isRunning() const { return running; }
+
+    //Result of the last audit, by service and login
+    const QMap<PasswordAuditKey, PasswordAuditEntry> &report() const { return entries; }
+
+    static bool isWeak(const PasswordAuditEntry &entry);
+
+signals:
+    void progressChanged(int total, int current);
+    void finished(bool success);
+
+private slots:
+    void onPasswordItem(int index, const QString &service, const QString &login, const QString &password, bool success);
+    void onBatchFinished(bool success);
+    void onConnectedChanged(bool connected);
+
+private:
+    class Score
+    {
+    public:
+        double entropy = 0;
+        QByteArray hash;
+    };
+
+    void scoreFinished(int index, const Score &score);
+    void checkFinished();
+    void stop();
+
+    WSClient *wsClient;
+
+    bool running = false;
+    //Scores of a cancelled audit are dropped
+    int auditId = 0;
+    bool batchDone = false;
+    bool batchSuccess = false;
+    int pendingScores = 0;
+    int received = 0;
+
+    QList<PasswordAuditKey> requested;
+    QMap<PasswordAuditKey, PasswordAuditEntry> entries;
+    QHash<PasswordAuditKey, QByteArray> hashes;
+    QByteArray hashKey;
+};
+
+#endif // PASSWORDAUDIT_H
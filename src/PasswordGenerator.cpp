@@ -0,0 +1,240 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "PasswordGenerator.h"
+#include "PasswordStrength.h"
+#include <QtConcurrent>
+#include <random>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <wincrypt.h>
+#endif
+
+//Random bytes read from the system at once
+#define RANDOM_POOL_SIZE    256
+
+static const char symbolChars[] = "~!@#$%^&*()-_+={}[]\\|:;<>,.?/";
+
+static QMutex deviceMutex;
+static QByteArray deviceSeed;
+
+static int charClass(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return PasswordGenerator::UpperCase;
+    if (c >= 'a' && c <= 'z')
+        return PasswordGenerator::LowerCase;
+    if (c >= '0' && c <= '9')
+        return PasswordGenerator::Digits;
+    return PasswordGenerator::Symbols;
+}
+
+static int classCount(int classes)
+{
+    int n = 0;
+    for (int c = PasswordGenerator::UpperCase;c <= PasswordGenerator::Symbols;c <<= 1)
+    {
+        if (classes & c)
+            n++;
+    }
+    return n;
+}
+
+static double candidateEntropy(const QByteArray &password)
+{
+    //Not cached, rejected candidates must not be kept
+    return PasswordStrength::entropy(password, false);
+}
+
+PasswordGenerator::PasswordGenerator()
+{
+}
+
+PasswordGenerator::~PasswordGenerator()
+{
+    pool.fill('\0');
+}
+
+const QByteArray &PasswordGenerator::alphabet(int classes)
+{
+    static const QVector<QByteArray> alphabets = []()
+    {
+        QVector<QByteArray> v(AllClasses + 1);
+        for (int c = 0;c <= AllClasses;c++)
+        {
+            QByteArray &a = v[c];
+            if (c & UpperCase)
+                for (char ch = 'A';ch <= 'Z';ch++)
+                    a.append(ch);
+            if (c & LowerCase)
+                for (char ch = 'a';ch <= 'z';ch++)
+                    a.append(ch);
+            if (c & Digits)
+                for (char ch = '0';ch <= '9';ch++)
+                    a.append(ch);
+            if (c & Symbols)
+                a.append(symbolChars);
+        }
+        return v;
+    }();
+
+    return alphabets.at(classes & AllClasses);
+}
+
+QByteArray PasswordGenerator::generate(int classes, int length)
+{
+    const QByteArray &chars = alphabet(classes);
+    if (chars.isEmpty() || length <= 0)
+        return QByteArray();
+
+    //Passwords missing a class are rejected, this keeps the choice uniform
+    //among the valid passwords
+    classes &= AllClasses;
+    bool checkClasses = length >= classCount(classes);
+
+    QByteArray pw(length, '\0');
+    forever
+    {
+        int found = 0;
+        for (int i = 0;i < length;i++)
+        {
+            pw[i] = chars.at(uniform(chars.size()));
+            found |= charClass(pw.at(i));
+        }
+
+        if (!checkClasses || found == classes)
+            return pw;
+    }
+}
+
+QList<QByteArray> PasswordGenerator::generate(int classes, int length, int count)
+{
+    QList<QByteArray> l;
+    for (int i = 0;i < count;i++)
+        l.append(generate(classes, length));
+    return l;
+}
+
+QByteArray PasswordGenerator::generateBest(int classes, int length, int candidates, double *entropy)
+{
+    QList<QByteArray> l = generate(classes, length, qMax(1, candidates));
+    if (l.first().isEmpty())
+        return QByteArray();
+
+    QList<double> scores = QtConcurrent::blockingMapped<QList<double>>(l, candidateEntropy);
+
+    int best = 0;
+    for (int i = 1;i < scores.size();i++)
+    {
+        if (scores.at(i) > scores.at(best))
+            best = i;
+    }
+
+    if (entropy)
+        *entropy = scores.at(best);
+
+    QByteArray pw = l.at(best);
+    for (QByteArray &c: l)
+        c.fill('\0');
+    return pw;
+}
+
+void PasswordGenerator::addDeviceEntropy(const QByteArray &bytes)
+{
+    if (bytes.isEmpty())
+        return;
+
+    QMutexLocker locker(&deviceMutex);
+    QCryptographicHash h(QCryptographicHash::Sha256);
+    h.addData(deviceSeed);
+    h.addData(bytes);
+    deviceSeed = h.result();
+}
+
+quint8 PasswordGenerator::randomByte()
+{
+    if (poolPos >= pool.size())
+        refill();
+    return static_cast<quint8>(pool.at(poolPos++));
+}
+
+int PasswordGenerator::uniform(int n)
+{
+    //Bytes above the largest multiple of n are dropped, so that no value
+    //is more likely than the others
+    int limit = 256 - (256 % n);
+    forever
+    {
+        int b = randomByte();
+        if (b < limit)
+            return b % n;
+    }
+}
+
+void PasswordGenerator::refill()
+{
+    pool.resize(RANDOM_POOL_SIZE);
+    poolPos = 0;
+
+    if (!systemRandom(pool.data(), pool.size()))
+    {
+        qCritical() << "Failed to read system random numbers, using std::random_device";
+        std::random_device rd;
+        for (int i = 0;i < pool.size();i++)
+            pool[i] = static_cast<char>(rd());
+    }
+
+    QByteArray seed;
+    {
+        QMutexLocker locker(&deviceMutex);
+        seed = deviceSeed;
+    }
+    if (seed.isEmpty())
+        return;
+
+    //XOR with a SHA-256 keystream from the device seed
+    for (int i = 0;i < pool.size();)
+    {
+        QCryptographicHash h(QCryptographicHash::Sha256);
+        h.addData(seed);
+        h.addData(reinterpret_cast<const char *>(&blockCounter), sizeof(blockCounter));
+        blockCounter++;
+
+        QByteArray k = h.result();
+        for (int j = 0;j < k.size() && i < pool.size();j++, i++)
+            pool[i] = pool.at(i) ^ k.at(j);
+    }
+}
+
+bool PasswordGenerator::systemRandom(char *buf, int len)
+{
+#if defined(Q_OS_WIN)
+    HCRYPTPROV prov;
+    if (!CryptAcquireContext(&prov, nullptr, nullptr, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT | CRYPT_SILENT))
+        return false;
+    bool ok = CryptGenRandom(prov, len, reinterpret_cast<BYTE *>(buf));
+    CryptReleaseContext(prov, 0);
+    return ok;
+#else
+    QFile f("/dev/urandom");
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return false;
+    return f.read(buf, len) == len;
+#endif
+}
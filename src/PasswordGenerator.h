@@ -0,0 +1,70 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef PASSWORDGENERATOR_H
+#define PASSWORDGENERATOR_H
+
+#include <QtCore>
+
+//Random password generator.
+//Characters are picked uniformly (rejection sampling, no modulo bias) with
+//random bytes from the system CSPRNG. Bytes given by the device random
+//number generator can be mixed in, this never reduces the system entropy.
+class PasswordGenerator
+{
+public:
+    enum CharClass
+    {
+        UpperCase   = 1,
+        LowerCase   = 2,
+        Digits      = 4,
+        Symbols     = 8,
+        AllClasses  = UpperCase | LowerCase | Digits | Symbols
+    };
+
+    PasswordGenerator();
+    ~PasswordGenerator();
+
+    //Password with at least one char of each class when the length allows it.
+    //Returns an empty password when no class is given.
+    QByteArray generate(int classes, int length);
+    QList<QByteArray> generate(int classes, int length, int count);
+
+    //Generate candidates and keep the one with the best zxcvbn entropy.
+    //Candidates are scored in parallel.
+    QByteArray generateBest(int classes, int length, int candidates, double *entropy = nullptr);
+
+    //Characters allowed by a set of classes, built once for each set
+    static const QByteArray &alphabet(int classes);
+
+    //Random bytes from the device, used by all generators
+    static void addDeviceEntropy(const QByteArray &bytes);
+
+private:
+    quint8 randomByte();
+    int uniform(int n);
+    void refill();
+
+    static bool systemRandom(char *buf, int len);
+
+    QByteArray pool;
+    int poolPos = 0;
+    quint64 blockCounter = 0;
+};
+
+#endif // PASSWORDGENERATOR_H
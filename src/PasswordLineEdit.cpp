@@ -25,9 +25,8 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QProgressBar>
-#include <array>
 #include "QtAwesome.h"
-#include "zxcvbn.h"
+#include "PasswordStrength.h"
 
 #define PROGRESS_STYLE \
     "QProgressBar {" \
@@ -145,6 +144,10 @@ PasswordOptionsPopup::PasswordOptionsPopup(QWidget* parent)
     m_strengthBar->setMaximum(200);
     m_strengthBar->setTextVisible(false);
 
+    //Strength is estimated in background, the bar is updated when the result is ready
+    m_strength = new PasswordStrength(this);
+    connect(m_strength, &PasswordStrength::entropyReady, this, &PasswordOptionsPopup::updateStrength);
+
     QVBoxLayout* mainLayout = new QVBoxLayout;
     QHBoxLayout* buttonLayout = new QHBoxLayout;
     QHBoxLayout* sliderLayout = new QHBoxLayout;
@@ -249,85 +252,28 @@ void LockedPasswordLineEdit::setLocked(bool locked) {
 
 void PasswordOptionsPopup::generatePassword() {
 
-    static bool init = false;
-    static std::array<char, 26> upperLetters;
-    static std::array<char, 26> lowerLetters;
-    static std::array<char, 10> digits;
-    static std::array<char, 29> symbols{{ '~', '!', '@', '#', '$', '%', '^', '&', '*',
-            '(', ')', '-', '_', '+', '=', '{', '}', '[', ']', '\\', '|', ':', ';', '<', '>', ',', '.', '?', '/' }};
-
-    if(!init) {
-        //Create list of all possible characters
-
-        char begin = 'A';
-        std::generate(std::begin(upperLetters), std::end(upperLetters), [&begin]() { return begin++;});
-        begin = 'a';
-        std::generate(std::begin(lowerLetters), std::end(lowerLetters), [&begin]() { return begin++;});
-        begin = '0';
-        std::generate(std::begin(digits), std::end(digits), [&begin]() { return begin++;});
-        init = true;
-    }
-
-    //Initialize a mersen twister engine
-    if(m_random_generator == std::mt19937{}) {
-        std::random_device r;
-        std::seed_seq seed{r(), r(), r(), r(), r(), r(), r(), r()};
-        m_random_generator.seed(seed);
-    }
-
-    const bool useUpper   = m_upperCaseCB->isChecked();
-    const bool useLower   = m_lowerCaseCB->isChecked();
-    const bool useDigits  = m_digitsCB->isChecked();
-    const bool useSymbols = m_symbolsCB->isChecked();
-    const int length = m_lengthSlider->value();
-
-    //compute the size of the character pool based on the user input
-
-    int poolSize = 0;
-    if(useUpper)
-        poolSize += upperLetters.size();
-    if(useLower)
-        poolSize += lowerLetters.size();
-    if(useDigits)
-        poolSize += digits.size();
-    if(useSymbols)
-        poolSize += symbols.size();
-
-    if(poolSize == 0  || length <= 0)
+    int classes = 0;
+    if(m_upperCaseCB->isChecked())
+        classes |= PasswordGenerator::UpperCase;
+    if(m_lowerCaseCB->isChecked())
+        classes |= PasswordGenerator::LowerCase;
+    if(m_digitsCB->isChecked())
+        classes |= PasswordGenerator::Digits;
+    if(m_symbolsCB->isChecked())
+        classes |= PasswordGenerator::Symbols;
+
+    QByteArray result = m_generator.generate(classes, m_lengthSlider->value());
+    if(result.isEmpty())
         return;
 
-    std::vector<char> pool(poolSize);
-
-    //Fill the pool
-    auto it = std::begin(pool);
-    if(useUpper)
-        it = std::copy(std::begin(upperLetters), std::end(upperLetters), it);
-    if(useLower)
-        it = std::copy(std::begin(lowerLetters), std::end(lowerLetters), it);
-    if(useDigits)
-        it = std::copy(std::begin(digits), std::end(digits), it);
-    if(useSymbols)
-        it = std::copy(std::begin(symbols), std::end(symbols), it);
-
-
-    // Suffling the pool one doesn't hurts and offer a second level of randomization
-    std::shuffle(std::begin(pool), std::end(pool), m_random_generator);
-
-    QByteArray result;
-    result.resize(length);
-
-    // Create a distribution based on the pool size
-    std::uniform_int_distribution<char> distribution(0, poolSize-1);
-
-    //Fill the password with random characters
-    for(int i = 0; i < length; i++) {
-        result[i] = pool.at(distribution(m_random_generator));
-    }
-
     //Done
     m_passwordLabel->setText(result);
 
-    double entropy = ZxcvbnMatch(result, 0, 0);
+    m_strength->estimate(result);
+}
+
+void PasswordOptionsPopup::updateStrength(double entropy)
+{
     m_entropy->setText(tr("Entropy: %1 bit").arg(QString::number(entropy, 'f', 2)));
     if (entropy > m_strengthBar->maximum())
         entropy = m_strengthBar->maximum();
@@ -20,13 +20,14 @@
 #define PASSWORDLINEEDIT_H
 
 #include <QLineEdit>
-#include <random>
+#include "PasswordGenerator.h"
 
 class QPushButton;
 class QSlider;
 class QCheckBox;
 class QLabel;
 class QProgressBar;
+class PasswordStrength;
 
 class PasswordOptionsPopup : public QFrame {
     Q_OBJECT
@@ -40,6 +41,7 @@ private Q_SLOTS:
     void generatePassword();
     void updatePasswordLength(int);
     void emitPassword();
+    void updateStrength(double entropy);
 
 protected:
     void showEvent(QShowEvent* e) override;
@@ -51,8 +53,9 @@ private:
     QLabel *m_passwordLabel, * m_sliderLengthLabel;
     QProgressBar *m_strengthBar;
     QLabel *m_quality, *m_entropy;
+    PasswordStrength *m_strength;
 
-    std::mt19937 m_random_generator;
+    PasswordGenerator m_generator;
 };
 
 
@@ -0,0 +1,187 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "PasswordStrength.h"
+#include "zxcvbn.h"
+#include <QtConcurrent>
+
+#define ZXCVBN_DICT_FILE    "zxcvbn.dict"
+//Number of results kept in the session cache
+#define ENTROPY_CACHE_SIZE  10000
+
+static QMutex dictMutex;
+static QFile *dictFile = nullptr;
+
+static QMutex cacheMutex;
+static QCache<QByteArray, double> entropyCache(ENTROPY_CACHE_SIZE);
+
+PasswordStrength::PasswordStrength(QObject *parent):
+    QObject(parent)
+{
+    watcher = new QFutureWatcher<double>(this);
+    connect(watcher, &QFutureWatcher<double>::finished, this, &PasswordStrength::estimationFinished);
+}
+
+void PasswordStrength::estimate(const QByteArray &password)
+{
+    double e;
+    if (cachedEntropy(cacheKey(password), e))
+    {
+        //a running estimation is now stale
+        runningIsStale = watcher->isRunning();
+        hasPending = false;
+        pendingPassword.clear();
+        emit entropyReady(e);
+        return;
+    }
+
+    if (watcher->isRunning())
+    {
+        //Replace any older pending request
+        pendingPassword = password;
+        hasPending = true;
+        return;
+    }
+
+    start(password);
+}
+
+void PasswordStrength::start(const QByteArray &password)
+{
+    runningIsStale = false;
+    watcher->setFuture(QtConcurrent::run(workerPool(), [password]()
+    {
+        return PasswordStrength::entropy(password);
+    }));
+}
+
+void PasswordStrength::estimationFinished()
+{
+    //Result is stale, start the last requested password
+    if (hasPending)
+    {
+        QByteArray password = pendingPassword;
+        hasPending = false;
+        pendingPassword.clear();
+        estimate(password);
+        return;
+    }
+
+    if (!runningIsStale && watcher->future().resultCount() > 0)
+        emit entropyReady(watcher->result());
+}
+
+double PasswordStrength::entropy(const QByteArray &password, bool cached)
+{
+    if (!cached)
+    {
+        loadDictionary();
+        return ZxcvbnMatch(password.constData(), nullptr, nullptr);
+    }
+
+    QByteArray key = cacheKey(password);
+    double e;
+    if (cachedEntropy(key, e))
+        return e;
+
+    loadDictionary();
+    e = ZxcvbnMatch(password.constData(), nullptr, nullptr);
+
+    QMutexLocker locker(&cacheMutex);
+    entropyCache.insert(key, new double(e));
+
+    return e;
+}
+
+QThreadPool *PasswordStrength::workerPool()
+{
+    //Keep some cores for the GUI
+    static QThreadPool *pool = nullptr;
+    if (!pool)
+    {
+        pool = new QThreadPool(qApp);
+        pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+    }
+    return pool;
+}
+
+QByteArray PasswordStrength::cacheKey(const QByteArray &password)
+{
+    //Do not keep passwords in clear in the cache
+    return QCryptographicHash::hash(password, QCryptographicHash::Sha256);
+}
+
+bool PasswordStrength::cachedEntropy(const QByteArray &key, double &entropy)
+{
+    QMutexLocker locker(&cacheMutex);
+    double *e = entropyCache.object(key);
+    if (!e)
+        return false;
+    entropy = *e;
+    return true;
+}
+
+void PasswordStrength::loadDictionary()
+{
+    QMutexLocker locker(&dictMutex);
+
+    //Only try once, without dictionary zxcvbn still runs the other matchers
+    if (dictFile)
+        return;
+    dictFile = new QFile();
+
+    for (const QString &path: dictionaryPaths())
+    {
+        if (!QFile::exists(path))
+            continue;
+
+        dictFile->setFileName(path);
+        if (!dictFile->open(QIODevice::ReadOnly))
+        {
+            qWarning() << "Failed to open" << path << dictFile->errorString();
+            continue;
+        }
+
+        //Pages are loaded by the OS when zxcvbn reads them, and the mapping
+        //stays valid until the application exits
+        uchar *data = dictFile->map(0, dictFile->size());
+        if (data && ZxcvbnInitMem(data, dictFile->size()))
+        {
+            qDebug() << "zxcvbn dictionary loaded from" << path;
+            return;
+        }
+
+        qWarning() << "Invalid zxcvbn dictionary:" << path;
+        dictFile->close();
+    }
+
+    qWarning() << "No zxcvbn dictionary found, password strength will be less accurate";
+}
+
+QStringList PasswordStrength::dictionaryPaths()
+{
+    QString appDir = QCoreApplication::applicationDirPath();
+    QStringList paths = { appDir + "/" ZXCVBN_DICT_FILE,
+                          appDir + "/../" ZXCVBN_DICT_FILE };
+#if defined(Q_OS_MAC)
+    paths << appDir + "/../Resources/" ZXCVBN_DICT_FILE;
+#elif defined(MC_INSTALL_PREFIX)
+    paths << QStringLiteral(MC_INSTALL_PREFIX "/share/moolticute/" ZXCVBN_DICT_FILE);
+#endif
+    return paths;
+}
@@ -0,0 +1,67 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef PASSWORDSTRENGTH_H
+#define PASSWORDSTRENGTH_H
+
+#include <QtCore>
+
+//Password strength estimation with zxcvbn.
+//The zxcvbn dictionary is not built in the executable, it is a file generated
+//at build time which is memory mapped on the first estimation.
+//
+//Estimations are run on a worker pool shared by all instances. Each instance
+//only runs one estimation at a time, and only the last requested password is
+//estimated next, older requests are dropped. Results are cached for the
+//session, by password hash.
+class PasswordStrength: public QObject
+{
+    Q_OBJECT
+public:
+    PasswordStrength(QObject *parent = nullptr);
+
+    //Estimate in background, entropyReady is emitted for the last request only
+    void estimate(const QByteArray &password);
+
+    //Entropy of the password in bits, computed in the calling thread.
+    //Without cache, no hash of the password is kept after the call.
+    static double entropy(const QByteArray &password, bool cached = true);
+
+signals:
+    void entropyReady(double entropy);
+
+private slots:
+    void estimationFinished();
+
+private:
+    QFutureWatcher<double> *watcher;
+    QByteArray pendingPassword;
+    bool hasPending = false;
+    bool runningIsStale = false;
+
+    void start(const QByteArray &password);
+
+    static QThreadPool *workerPool();
+    static QByteArray cacheKey(const QByteArray &password);
+    static bool cachedEntropy(const QByteArray &key, double &entropy);
+
+    static void loadDictionary();
+    static QStringList dictionaryPaths();
+};
+
+#endif // PASSWORDSTRENGTH_H
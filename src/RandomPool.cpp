@@ -0,0 +1,116 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "RandomPool.h"
+
+#define DRBG_HASH       QCryptographicHash::Sha256
+#define DRBG_OUTLEN     32
+
+int RandomPool::lowWatermark = 64;
+int RandomPool::highWatermark = 256;
+
+RandomPool::RandomPool()
+{
+}
+
+RandomPool::~RandomPool()
+{
+    clear();
+}
+
+void RandomPool::setWatermarks(int low, int high)
+{
+    if (low < 0 || high < low)
+    {
+        qWarning() << "Invalid random pool watermarks" << low << high;
+        return;
+    }
+    lowWatermark = low;
+    highWatermark = high;
+}
+
+void RandomPool::clear()
+{
+    K.fill('\0');
+    V.fill('\0');
+    pool.fill('\0');
+    K.clear();
+    V.clear();
+    pool.clear();
+    seeded = false;
+}
+
+void RandomPool::addEntropy(const QByteArray &bytes)
+{
+    if (bytes.isEmpty())
+        return;
+
+    if (!seeded)
+    {
+        //Instantiate, the nonce only makes the state unique
+        K = QByteArray(DRBG_OUTLEN, '\x00');
+        V = QByteArray(DRBG_OUTLEN, '\x01');
+        QByteArray nonce;
+        qint64 t = QDateTime::currentMSecsSinceEpoch();
+        qint64 pid = QCoreApplication::applicationPid();
+        nonce.append(reinterpret_cast<const char *>(&t), sizeof(t));
+        nonce.append(reinterpret_cast<const char *>(&pid), sizeof(pid));
+        update(bytes + nonce);
+        seeded = true;
+    }
+    else
+        update(bytes);
+
+    pool.append(generate(bytes.size()));
+}
+
+bool RandomPool::take(int len, QByteArray &out)
+{
+    if (len <= 0 || pool.size() < len)
+        return false;
+
+    //Served bytes are removed from the pool, they are never given twice
+    out = pool.right(len);
+    pool.chop(len);
+    return true;
+}
+
+void RandomPool::update(const QByteArray &provided)
+{
+    K = QMessageAuthenticationCode::hash(V + '\x00' + provided, K, DRBG_HASH);
+    V = QMessageAuthenticationCode::hash(V, K, DRBG_HASH);
+    if (provided.isEmpty())
+        return;
+    K = QMessageAuthenticationCode::hash(V + '\x01' + provided, K, DRBG_HASH);
+    V = QMessageAuthenticationCode::hash(V, K, DRBG_HASH);
+}
+
+QByteArray RandomPool::generate(int len)
+{
+    QByteArray out;
+    while (out.size() < len)
+    {
+        V = QMessageAuthenticationCode::hash(V, K, DRBG_HASH);
+        out.append(V);
+    }
+    out.truncate(len);
+
+    //Backtracking resistance
+    update(QByteArray());
+    return out;
+}
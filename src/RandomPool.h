@@ -0,0 +1,62 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef RANDOMPOOL_H
+#define RANDOMPOOL_H
+
+#include <QtCore>
+
+//Pool of random bytes coming from the device.
+//Device bytes are not served as is, they (re)seed a HMAC-DRBG (SHA-256, NIST
+//SP 800-90A) and the pool is filled with the DRBG output. The pool never gets
+//more bytes than were received from the device.
+class RandomPool
+{
+public:
+    RandomPool();
+    ~RandomPool();
+
+    //Reseed with bytes from the device, the same number of bytes is added to the pool
+    void addEntropy(const QByteArray &bytes);
+
+    //Take len bytes from the pool, fails if there are not enough of them
+    bool take(int len, QByteArray &out);
+
+    int size() const { return pool.size(); }
+    void clear();
+
+    //Pool needs to be filled again
+    bool isLow() const { return pool.size() < lowWatermark; }
+    //Number of bytes to fetch to fill the pool up to the high watermark
+    int missing() const { return qMax(0, highWatermark - pool.size()); }
+
+    static void setWatermarks(int low, int high);
+
+private:
+    void update(const QByteArray &provided);
+    QByteArray generate(int len);
+
+    QByteArray K, V;
+    bool seeded = false;
+    QByteArray pool;
+
+    static int lowWatermark;
+    static int highWatermark;
+};
+
+#endif // RANDOMPOOL_H
@@ -0,0 +1,210 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "ServiceMatcher.h"
+#include <QHostAddress>
+
+//Public suffixes with more than one label. This is only a subset of the
+//public suffix list, covering the most used ones.
+static const QSet<QString> multiLabelSuffixes = {
+    "co.uk", "org.uk", "ac.uk", "gov.uk", "me.uk", "ltd.uk", "plc.uk",
+    "com.au", "net.au", "org.au", "edu.au", "gov.au",
+    "co.nz", "org.nz", "net.nz",
+    "co.jp", "ne.jp", "or.jp", "ac.jp", "go.jp",
+    "co.kr", "or.kr",
+    "co.in", "net.in", "org.in", "gov.in",
+    "co.za", "org.za",
+    "co.il", "org.il",
+    "com.br", "net.br", "org.br", "gov.br",
+    "com.cn", "net.cn", "org.cn", "gov.cn",
+    "com.hk", "com.tw", "com.sg", "com.my",
+    "com.mx", "com.ar", "com.co", "com.tr",
+    "com.pl", "net.pl", "org.pl",
+    "co.at", "or.at",
+    "github.io", "gitlab.io", "blogspot.com", "herokuapp.com", "appspot.com",
+    "azurewebsites.net", "cloudfront.net",
+};
+
+ServiceMatcher::ServiceMatcher()
+{
+    clear();
+}
+
+void ServiceMatcher::clear()
+{
+    nodes.clear();
+    nodes.append(Node());
+}
+
+void ServiceMatcher::addService(const QString &service)
+{
+    QString host = hostFromUrl(service);
+    if (host.isEmpty())
+        return;
+
+    QStringList labels = host.split('.', QString::SkipEmptyParts);
+
+    int n = 0;
+    for (int i = labels.size() - 1;i >= 0;i--)
+    {
+        int next = nodes[n].children.value(labels.at(i), -1);
+        if (next < 0)
+        {
+            next = nodes.size();
+            nodes.append(Node());
+            nodes[n].children[labels.at(i)] = next;
+        }
+        n = next;
+    }
+
+    if (nodes[n].service.isEmpty())
+        nodes[n].service = service;
+}
+
+QString ServiceMatcher::match(const QString &url, MatchType *type) const
+{
+    if (type)
+        *type = MatchNone;
+
+    QString host = hostFromUrl(url);
+    if (host.isEmpty())
+        return QString();
+
+    QStringList labels = host.split('.', QString::SkipEmptyParts);
+
+    //Ip addresses are only matched exactly
+    bool isIp = !QHostAddress(host).isNull();
+    int minDepth = isIp?labels.size():registrableDomain(host).count('.') + 1;
+
+    //Walk the trie from the TLD and remember the deepest known service
+    int n = 0, depth = 0;
+    QString parent;
+    for (int i = labels.size() - 1;i >= 0;i--)
+    {
+        int next = nodes[n].children.value(labels.at(i), -1);
+        if (next < 0)
+            break;
+        n = next;
+        depth++;
+
+        if (depth >= minDepth && !nodes[n].service.isEmpty())
+            parent = nodes[n].service;
+    }
+
+    if (!parent.isEmpty())
+    {
+        if (type)
+            *type = (depth == labels.size() && nodes[n].service == parent)?MatchExact:MatchParent;
+        return parent;
+    }
+
+    //Never match across registrable domains: paypal.evil must not
+    //select the credentials of paypal.com
+    if (depth >= minDepth)
+    {
+        QString child = findClosestChild(n);
+        if (!child.isEmpty())
+        {
+            if (type)
+                *type = MatchChild;
+            return child;
+        }
+    }
+
+    return QString();
+}
+
+QString ServiceMatcher::findClosestChild(int from) const
+{
+    //Breadth first, so the subdomain with the less labels wins
+    QQueue<int> queue;
+    queue.enqueue(from);
+    while (!queue.isEmpty())
+    {
+        const Node &node = nodes[queue.dequeue()];
+
+        //Sort children to always return the same service
+        QStringList keys = node.children.keys();
+        std::sort(keys.begin(), keys.end());
+        for (const QString &k: keys)
+        {
+            int c = node.children.value(k);
+            if (!nodes[c].service.isEmpty())
+                return nodes[c].service;
+            queue.enqueue(c);
+        }
+    }
+
+    return QString();
+}
+
+QString ServiceMatcher::matchTypeString(MatchType type)
+{
+    switch (type)
+    {
+    case MatchExact: return "exact";
+    case MatchParent: return "parent";
+    case MatchChild: return "child";
+    default: break;
+    }
+    return "none";
+}
+
+QString ServiceMatcher::hostFromUrl(const QString &url)
+{
+    QString host = url.trimmed().toLower();
+
+    int i = host.indexOf("://");
+    if (i >= 0)
+        host = host.mid(i + 3);
+
+    i = host.indexOf(QRegularExpression("[/?#]"));
+    if (i >= 0)
+        host.truncate(i);
+
+    i = host.lastIndexOf('@');
+    if (i >= 0)
+        host = host.mid(i + 1);
+
+    //remove port, but keep ipv6 addresses
+    if (host.startsWith('['))
+    {
+        i = host.indexOf(']');
+        if (i >= 0)
+            host = host.mid(1, i - 1);
+    }
+    else if (host.count(':') == 1)
+        host.truncate(host.indexOf(':'));
+
+    while (host.endsWith('.'))
+        host.chop(1);
+
+    return host;
+}
+
+QString ServiceMatcher::registrableDomain(const QString &host)
+{
+    QStringList labels = host.split('.', QString::SkipEmptyParts);
+    if (labels.size() <= 2)
+        return labels.join('.');
+
+    QString suffix = labels.mid(labels.size() - 2).join('.');
+    int count = multiLabelSuffixes.contains(suffix)?3:2;
+
+    return labels.mid(labels.size() - count).join('.');
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#ifndef SERVICEMATCHER_H
+#define SERVICEMATCHER_H
+
+#include <QtCore>
+
+/*
+ * Find the best known service for an url or a hostname.
+ *
+ * Services are stored in a trie of their reversed domain labels
+ * (mail.google.com is stored as com -> google -> mail), so a lookup only
+ * walks the labels of the host, whatever the number of known services.
+ *
+ * Candidates are checked in this order:
+ *  - the exact host
+ *  - the closest parent domain (google.com for accounts.google.com)
+ *  - the closest subdomain of the host (accounts.google.com for google.com)
+ * Matches never go above the registrable domain (eTLD+1), so a service is
+ * never returned for a host on another domain or TLD (paypal.com for paypal.evil).
+ */
+class ServiceMatcher
+{
+public:
+    ServiceMatcher();
+
+    enum MatchType
+    {
+        MatchNone = 0,
+        MatchExact,
+        MatchParent,
+        MatchChild,
+    };
+
+    void clear();
+    void addService(const QString &service);
+
+    //Returns the best known service or an empty string
+    QString match(const QString &url, MatchType *type = nullptr) const;
+
+    static QString matchTypeString(MatchType type);
+
+    //Lower case host of an url, without scheme, credentials, port and path
+    static QString hostFromUrl(const QString &url);
+    //google.co.uk for accounts.google.co.uk
+    static QString registrableDomain(const QString &host);
+
+private:
+    class Node
+    {
+    public:
+        QHash<QString, int> children;
+        QString service; //Name of the service as stored in the device
+    };
+
+    //Trie nodes, index 0 is the root
+    QVector<Node> nodes;
+
+    QString findClosestChild(int from) const;
+};
+
+#endif // SERVICEMATCHER_H
@@ -63,7 +63,11 @@ void WSClient::closeWebsocket()
 
 void WSClient::sendJsonData(const QJsonObject &data)
 {
-    QJsonDocument jdoc(data);
+    QJsonObject o = data;
+    if (!deviceId.isEmpty() && !o.contains("device"))
+        o["device"] = deviceId;
+
+    QJsonDocument jdoc(o);
 //    qDebug().noquote() << jdoc.toJson();
     wsocket->sendTextMessage(jdoc.toJson());
 }
@@ -71,6 +75,7 @@ void WSClient::sendJsonData(const QJsonObject &data)
 void WSClient::onWsConnected()
 {
     qDebug() << "Websocket connected";
+    initialListReceived = false;
     connect(wsocket, &QWebSocket::textMessageReceived, this, &WSClient::onTextMessageReceived);
     Q_EMIT wsConnected();
 }
@@ -124,6 +129,28 @@ void WSClient::onTextMessageReceived(const QString &message)
 
     qDebug().noquote() << "New message: " << rootobj;
 
+    if (rootobj["msg"] == "device_list")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        QStringList ids;
+        for (const QJsonValue &v: o["devices"].toArray())
+            ids.append(v.toObject()["device"].toString());
+
+        //Keep using the same device as long as it is connected
+        if (deviceId.isEmpty() || !ids.contains(deviceId))
+        {
+            deviceId = o["default_device"].toString();
+            if (!deviceId.isEmpty() && initialListReceived)
+                sendJsonData({{ "msg", "get_device_status" }});
+        }
+        initialListReceived = true;
+        return;
+    }
+
+    //Ignore messages from other devices
+    if (rootobj.contains("device") && rootobj["device"].toString() != deviceId)
+        return;
+
     if (rootobj["msg"] == "mp_connected")
     {
         set_connected(true);
@@ -160,6 +187,17 @@ void WSClient::onTextMessageReceived(const QString &message)
         bool success = !o.contains("failed") || !o.value("failed").toBool();
         emit passwordUnlocked(o["service"].toString(), o["login"].toString(), o["password"].toString(), success);
     }
+    else if (rootobj["msg"] == "credential_batch_item")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        bool success = !o.contains("failed") || !o.value("failed").toBool();
+        emit passwordBatchItem(o["index"].toInt(), o["service"].toString(), o["login"].toString(), o["password"].toString(), success);
+    }
+    else if (rootobj["msg"] == "get_credentials_batch")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        emit passwordBatchFinished(!o.contains("failed") || !o.value("failed").toBool());
+    }
     else if (rootobj["msg"] == "version_changed")
     {
         QJsonObject o = rootobj["data"].toObject();
@@ -198,6 +236,15 @@ void WSClient::onTextMessageReceived(const QString &message)
         QJsonObject o = rootobj["data"].toObject();
         set_uid((qint64)o["uid"].toDouble());
     }
+    else if (rootobj["msg"] == "get_random_numbers")
+    {
+        //Failures are sent as an object instead of the array
+        QByteArray nums;
+        for (const QJsonValue &v: rootobj["data"].toArray())
+            nums.append(static_cast<char>(v.toInt()));
+        if (!nums.isEmpty())
+            emit randomNumbersReceived(nums);
+    }
     else if (rootobj["msg"] == "get_data_node")
     {
         QJsonObject o = rootobj["data"].toObject();
@@ -211,6 +258,32 @@ void WSClient::onTextMessageReceived(const QString &message)
         bool success = !o.contains("failed") || !o.value("failed").toBool();
         emit dataFileSent(o["service"].toString(), success);
     }
+    else if (rootobj["msg"] == "export_image")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        bool success = !o.contains("failed") || !o.value("failed").toBool();
+        emit imageExported(success, o["error_message"].toString(), o["file"].toString());
+    }
+    else if (rootobj["msg"] == "import_image")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        bool success = !o.contains("failed") || !o.value("failed").toBool();
+        emit imageImported(success, o["error_message"].toString());
+    }
+    else if (rootobj["msg"] == "import_credentials")
+    {
+        QJsonObject o = rootobj["data"].toObject();
+        bool success = !o.contains("failed") || !o.value("failed").toBool();
+        QStringList failures;
+        for (const QJsonValue &v: o["results"].toArray())
+        {
+            QJsonObject r = v.toObject();
+            if (r["failed"].toBool())
+                failures.append(QStringLiteral("%1 / %2: %3").arg(r["service"].toString())
+                                .arg(r["login"].toString()).arg(r["error_message"].toString()));
+        }
+        emit credentialsImported(success, o["error_message"].toString(), failures);
+    }
 }
 
 void WSClient::udateParameters(const QJsonObject &data)
@@ -310,6 +383,43 @@ void WSClient::requestPassword(const QString & service, const QString & login)
                             { "data", d }});
 }
 
+void WSClient::requestPasswordsBatch(const QList<QPair<QString, QString>> &credentials)
+{
+    QJsonArray requests;
+    for (const auto &c: credentials)
+    {
+        requests.append(QJsonObject{{ "service", c.first },
+                                    { "login", c.second },
+                                    { "fields", QJsonArray{ "password" } }});
+    }
+    sendJsonData({{ "msg", "get_credentials_batch" },
+                  { "data", QJsonObject{{ "requests", requests }} }});
+}
+
+void WSClient::requestRandomNumbers()
+{
+    sendJsonData({{ "msg", "get_random_numbers" }});
+}
+
+void WSClient::exportImage(const QString &type)
+{
+    sendJsonData({{ "msg", "export_image" },
+                  { "data", QJsonObject{{ "type", type }} }});
+}
+
+void WSClient::importImage(const QString &type, const QString &file)
+{
+    sendJsonData({{ "msg", "import_image" },
+                  { "data", QJsonObject{{ "type", type },
+                                        { "file", file }} }});
+}
+
+void WSClient::importCredentials(const QJsonArray &credentials)
+{
+    sendJsonData({{ "msg", "import_credentials" },
+                  { "data", QJsonObject{{ "credentials", credentials }} }});
+}
+
 void WSClient::requestDataFile(const QString &service)
 {
     QJsonObject d = {{ "service", service }};
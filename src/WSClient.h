@@ -84,6 +84,21 @@ public:
                        const QString & password, const QString & description = {});
 
     void requestPassword(const QString & service, const QString & login);
+    //Ask the passwords of several credentials in one request, each one is
+    //returned with passwordBatchItem (index in the list) as soon as it is approved
+    void requestPasswordsBatch(const QList<QPair<QString, QString>> &credentials);
+
+    //32 bytes from the device random number generator
+    void requestRandomNumbers();
+
+    //Dump or restore the device flash or EEPROM ("flash" or "eeprom").
+    //The daemon writes the exported image and sends back its path
+    void exportImage(const QString &type);
+    void importImage(const QString &type, const QString &file);
+
+    //Import credentials (service, login, password and optional description)
+    //in one memory management mode session
+    void importCredentials(const QJsonArray &credentials);
 
     void requestDataFile(const QString &service);
     void sendDataFile(const QString &service, const QByteArray &data);
@@ -93,12 +108,18 @@ signals:
     void wsDisconnected();
     void memoryDataChanged();
     void passwordUnlocked(const QString & service, const QString & login, const QString & password, bool success);
+    void passwordBatchItem(int index, const QString & service, const QString & login, const QString & password, bool success);
+    void passwordBatchFinished(bool success);
     void credentialsUpdated(const QString & service, const QString & login, const QString & description, bool success);
     void showAppRequested();
     void progressChanged(int total, int current);
     void memcheckFinished(bool success);
     void dataFileRequested(const QString &service, const QByteArray &data, bool success);
     void dataFileSent(const QString &service, bool success);
+    void randomNumbersReceived(const QByteArray &nums);
+    void imageExported(bool success, const QString &errstr, const QString &file);
+    void imageImported(bool success, const QString &errstr);
+    void credentialsImported(bool success, const QString &errstr, const QStringList &failures);
 
 public slots:
     void sendJsonData(const QJsonObject &data);
@@ -117,6 +138,12 @@ private:
     QWebSocket *wsocket = nullptr;
 
     QJsonObject memData;
+
+    //Device selected on the daemon side, the GUI only works with one device
+    QString deviceId;
+
+    //The daemon pushes the status of all devices along with the first device list
+    bool initialListReceived = false;
 };
 
 #endif // WSCLIENT_H
@@ -43,8 +43,8 @@ bool WSServer::initialize()
     connect(MPManager::Instance(), SIGNAL(mpConnected(MPDevice*)), this, SLOT(mpAdded(MPDevice*)));
     connect(MPManager::Instance(), SIGNAL(mpDisconnected(MPDevice*)), this, SLOT(mpRemoved(MPDevice*)));
 
-    if (MPManager::Instance()->getDeviceCount() > 0)
-        mpAdded(MPManager::Instance()->getDevice(0));
+    for (MPDevice *dev: MPManager::Instance()->getDevices())
+        mpAdded(dev);
 
     return true;
 }
@@ -61,7 +61,6 @@ void WSServer::onNewConnection()
 
     connect(wsocket, &QWebSocket::disconnected, this, &WSServer::socketDisconnected);
     WSServerCon *c = new WSServerCon(wsocket);
-    c->resetDevice(device);
     c->sendInitialStatus();
     //let clients send broadcast messages
     connect(c, &WSServerCon::notifyAllClients, this, &WSServer::notifyClients);
@@ -86,43 +85,116 @@ void WSServer::socketDisconnected()
 
 void WSServer::notifyClients(const QJsonObject &obj)
 {
+    broadcast(obj);
+}
+
+void WSServer::broadcast(const QJsonObject &obj)
+{
+    //The serialized string is implicitly shared by all clients.
+    //QWebSocket converts it to UTF-8 again for each client, but text frames are
+    //kept: all clients (GUI, browser extensions) only handle JSON as text messages.
+    QString msgType = obj["msg"].toString();
+    QString text;
+
     for (auto it = wsClients.begin();it != wsClients.end();it++)
     {
-        it.value()->sendJsonMessage(obj);
+        if (!it.value()->isSubscribed(msgType))
+            continue;
+        if (text.isEmpty())
+            text = QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+        it.value()->sendTextMessage(text);
     }
 }
 
 void WSServer::mpAdded(MPDevice *dev)
 {
-    if (device == dev)
+    if (devices.contains(dev))
         return;
 
-    //tell clients that current mp is not connected anymore
-    //and use new connected mp instead
-    if (device && device != dev)
-        mpRemoved(device);
+    qDebug() << "Mooltipass connected: " << MPManager::Instance()->getDeviceId(dev);
+    devices.append(dev);
+    connectDevice(dev);
 
-    qDebug() << "Mooltipass connected";
-    device = dev;
-
-    for (auto it = wsClients.begin();it != wsClients.end();it++)
-    {
-        it.value()->resetDevice(device);
-    }
+    broadcast(WSServerCon::deviceJson(dev, {{ "msg", "mp_connected" }}));
+    broadcast(WSServerCon::deviceListJson(devices));
 }
 
 void WSServer::mpRemoved(MPDevice *dev)
 {
-    if (device == dev)
-    {
-        qDebug() << "Mooltipass disconnected";
-        device = nullptr;
+    if (!devices.contains(dev))
+        return;
 
-        for (auto it = wsClients.begin();it != wsClients.end();it++)
-        {
-            it.value()->resetDevice(device);
-        }
-    }
+    qDebug() << "Mooltipass disconnected: " << MPManager::Instance()->getDeviceId(dev);
+
+    //Tell the clients before the device is gone
+    broadcast(WSServerCon::deviceJson(dev, {{ "msg", "mp_disconnected" }}));
+
+    disconnect(dev, nullptr, this, nullptr);
+    devices.removeAll(dev);
+    clearLoginCaches(dev);
+
+    broadcast(WSServerCon::deviceListJson(devices));
+}
+
+MPDevice *WSServer::findDevice(const QString &id) const
+{
+    //Only devices already announced to the clients can be selected
+    MPDevice *dev = MPManager::Instance()->findDevice(id);
+    return devices.contains(dev)?dev:nullptr;
+}
+
+void WSServer::clearLoginCaches(MPDevice *dev, const QString &service)
+{
+    for (WSServerCon *c: wsClients)
+        c->clearLoginCache(dev, service);
+}
+
+void WSServer::connectDevice(MPDevice *dev)
+{
+    //Device changes are broadcasted to all clients, the message is only built once
+    auto param = [=](const QString &p) { broadcast(WSServerCon::paramJson(dev, p)); };
+
+    connect(dev, &MPDevice::statusChanged, this, [=]()
+    {
+        clearLoginCaches(dev);
+        broadcast(WSServerCon::statusJson(dev));
+    });
+    connect(dev, &MPDevice::credentialChanged, this, [=](const QString &service) { clearLoginCaches(dev, service); });
+
+    connect(dev, &MPDevice::keyboardLayoutChanged, this, [=]() { param("keyboard_layout"); });
+    connect(dev, &MPDevice::lockTimeoutEnabledChanged, this, [=]() { param("lock_timeout_enabled"); });
+    connect(dev, &MPDevice::lockTimeoutChanged, this, [=]() { param("lock_timeout"); });
+    connect(dev, &MPDevice::screensaverChanged, this, [=]() { param("screensaver"); });
+    connect(dev, &MPDevice::userRequestCancelChanged, this, [=]() { param("user_request_cancel"); });
+    connect(dev, &MPDevice::userInteractionTimeoutChanged, this, [=]() { param("user_interaction_timeout"); });
+    connect(dev, &MPDevice::flashScreenChanged, this, [=]() { param("flash_screen"); });
+    connect(dev, &MPDevice::offlineModeChanged, this, [=]() { param("offline_mode"); });
+    connect(dev, &MPDevice::tutorialEnabledChanged, this, [=]() { param("tutorial_enabled"); });
+    connect(dev, &MPDevice::memMgmtModeChanged, this, [=]()
+    {
+        //database may have been changed
+        clearLoginCaches(dev);
+        broadcast(WSServerCon::memMgmtModeJson(dev));
+        broadcast(WSServerCon::memMgmtDataJson(dev));
+    });
+    connect(dev, &MPDevice::flashMbSizeChanged, this, [=]() { broadcast(WSServerCon::versionJson(dev)); });
+    connect(dev, &MPDevice::hwVersionChanged, this, [=]() { broadcast(WSServerCon::versionJson(dev)); });
+    connect(dev, &MPDevice::serialNumberChanged, this, [=]() { broadcast(WSServerCon::versionJson(dev)); });
+    connect(dev, &MPDevice::screenBrightnessChanged, this, [=]() { param("screen_brightness"); });
+    connect(dev, &MPDevice::knockEnabledChanged, this, [=]() { param("knock_enabled"); });
+    connect(dev, &MPDevice::knockSensitivityChanged, this, [=]() { param("knock_sensitivity"); });
+    connect(dev, &MPDevice::randomStartingPinChanged, this, [=]() { param("random_starting_pin"); });
+    connect(dev, &MPDevice::hashDisplayChanged, this, [=]() { param("hash_display"); });
+    connect(dev, &MPDevice::lockUnlockModeChanged, this, [=]() { param("lock_unlock_mode"); });
+
+    connect(dev, &MPDevice::keyAfterLoginSendEnableChanged, this, [=]() { param("key_after_login_enabled"); });
+    connect(dev, &MPDevice::keyAfterLoginSendChanged, this, [=]() { param("key_after_login"); });
+    connect(dev, &MPDevice::keyAfterPassSendEnableChanged, this, [=]() { param("key_after_pass_enabled"); });
+    connect(dev, &MPDevice::keyAfterPassSendChanged, this, [=]() { param("key_after_pass"); });
+    connect(dev, &MPDevice::delayAfterKeyEntryEnableChanged, this, [=]() { param("delay_after_key_enabled"); });
+    connect(dev, &MPDevice::delayAfterKeyEntryChanged, this, [=]() { param("delay_after_key"); });
+
+    connect(dev, &MPDevice::uidChanged, this, [=]() { broadcast(WSServerCon::deviceUidJson(dev)); });
 }
 
 bool WSServer::checkClientExists(WSServerCon *wscon)
@@ -44,6 +44,12 @@ public:
     bool checkClientExists(WSServerCon *wscon);
     bool checkClientExists(QWebSocket *ws);
 
+    const QList<MPDevice *> &getDevices() const { return devices; }
+    MPDevice *findDevice(const QString &id) const;
+
+    //Serialize a message once and send it to all subscribed clients
+    void broadcast(const QJsonObject &obj);
+
 private slots:
     void onNewConnection();
     void socketDisconnected();
@@ -54,14 +60,19 @@ private slots:
 
 private:
     WSServer();
+
+    void connectDevice(MPDevice *dev);
+    //login caches of the clients are per connection, invalidate them all
+    void clearLoginCaches(MPDevice *dev, const QString &service = QString());
+
     QWebSocketServer *wsServer = nullptr;
     QHash<QWebSocket *, WSServerCon *> wsClients;
     QHash<WSServerCon *, QWebSocket *> wsClientsReverse; //reverse map for fast lookup
 
-    //Current MP
-    //For now only one MP is supported. maybe add multi support
-    // one day (but it's not really useful anyway)
-    MPDevice *device = nullptr;
+    //All connected MPs, in connection order. Clients select a device
+    //with the "device" field of their messages, the first one is used
+    //when no device is specified
+    QList<MPDevice *> devices;
 };
 
 #endif // WSSERVER_H
@@ -19,12 +19,22 @@
 #include "WSServerCon.h"
 #include "WSServer.h"
 #include "version.h"
+#include <QStandardPaths>
+
+//Minimum delay between two progress messages of the same client
+#define PROGRESS_INTERVAL_MS    100
+//Progress messages are held back while that much data waits to be written
+#define PROGRESS_MAX_PENDING    (64 * 1024)
 
 WSServerCon::WSServerCon(QWebSocket *conn):
     wsClient(conn),
     clientUid(Common::createUid(QStringLiteral("ws-")))
 {
     connect(wsClient, &QWebSocket::textMessageReceived, this, &WSServerCon::processMessage);
+
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(PROGRESS_INTERVAL_MS);
+    connect(progressTimer, &QTimer::timeout, this, &WSServerCon::flushProgress);
 }
 
 WSServerCon::~WSServerCon()
@@ -38,6 +48,11 @@ void WSServerCon::sendJsonMessage(const QJsonObject &data)
     wsClient->sendTextMessage(jdoc.toJson(QJsonDocument::JsonFormat::Compact));
 }
 
+void WSServerCon::sendTextMessage(const QString &text)
+{
+    wsClient->sendTextMessage(text);
+}
+
 void WSServerCon::processMessage(const QString &message)
 {
     QJsonParseError err;
@@ -53,31 +68,38 @@ void WSServerCon::processMessage(const QString &message)
 
     QJsonObject root = jdoc.object();
 
+    //device selected by the client, or the default one
+    MPDevice *mpdevice = getDevice(root);
+
+    //identifies the progress of this request until its result is sent
+    const QString pkey = progressKey(root);
+
     if (root["msg"] == "param_set")
     {
-        processParametersSet(root["data"].toObject());
+        processParametersSet(mpdevice, root["data"].toObject());
     }
     else if (root["msg"] == "start_memorymgmt")
     {
         //send command to start MMM
         if (mpdevice)
             mpdevice->startMemMgmtMode(
+                        [=](bool success, QString errstr)
+            {
+                Q_UNUSED(success);
+                Q_UNUSED(errstr);
+                if (!WSServer::Instance()->checkClientExists(this))
+                    return;
+
+                //the result is broadcasted with the mem mgmt mode, pending progress is useless now
+                dropProgress(pkey);
+            },
                         //progress callback handling
                         [=](int total, int current)
             {
                 if (!WSServer::Instance()->checkClientExists(this))
                     return;
 
-                if (current > total)
-                    current = total;
-
-                QJsonObject ores;
-                QJsonObject oroot = root;
-                ores["progress_total"] = total;
-                ores["progress_current"] = current;
-                oroot["data"] = ores;
-                oroot["msg"] = "progress";
-                sendJsonMessage(oroot);
+                queueProgress(pkey, root, total, current);
             });
         else
             sendFailedJson(root, "No device connected");
@@ -100,6 +122,9 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
+            //the result is sent, pending progress for this request is useless now
+            dropProgress(pkey);
+
             QJsonObject oroot = root;
             oroot["msg"] = "memcheck";
 
@@ -120,16 +145,7 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
-            if (current > total)
-                current = total;
-
-            QJsonObject ores;
-            QJsonObject oroot = root;
-            ores["progress_total"] = total;
-            ores["progress_current"] = current;
-            oroot["data"] = ores;
-            oroot["msg"] = "progress";
-            sendJsonMessage(oroot);
+            queueProgress(pkey, root, total, current);
         });
     }
     else if (root["msg"] == "ask_password" ||
@@ -147,8 +163,39 @@ void WSServerCon::processMessage(const QString &message)
             return;
         }
 
-        mpdevice->getCredential(o["service"].toString(), o["login"].toString(), o["fallback_service"].toString(),
-                reqid,
+        int fields = credentialFields(mpdevice, o);
+
+        //Let the daemon find the best known service for this url
+        QString reqService = o["service"].toString();
+        if (o["match_service"].toBool())
+        {
+            QString m = mpdevice->matchService(reqService);
+            if (!m.isEmpty())
+                reqService = m;
+        }
+
+        //Only the login is requested and the device already gave it to this client
+        bool loginOnly = !(fields & (CredentialPassword | CredentialDescription));
+        if (loginOnly &&
+            mpdevice->get_status() == Common::Unlocked &&
+            loginCache.value(mpdevice).contains(reqService))
+        {
+            QString cachedLogin = loginCache.value(mpdevice).value(reqService);
+            if (o["login"].toString().isEmpty() || o["login"].toString() == cachedLogin)
+            {
+                qInfo() << "Login for service" << reqService << "found in cache";
+                QJsonObject ores;
+                QJsonObject oroot = root;
+                ores["service"] = reqService;
+                ores["login"] = cachedLogin;
+                oroot["data"] = ores;
+                sendJsonMessage(oroot);
+                return;
+            }
+        }
+
+        mpdevice->getCredential(reqService, o["login"].toString(), o["fallback_service"].toString(),
+                reqid, fields,
                 [=](bool success, QString errstr, const QString &service, const QString &login, const QString &pass, const QString &desc)
         {
             if (!WSServer::Instance()->checkClientExists(this))
@@ -160,17 +207,175 @@ void WSServerCon::processMessage(const QString &message)
                 return;
             }
 
+            if (service == reqService && !login.isEmpty())
+                loginCache[mpdevice][reqService] = login;
+
             QJsonObject ores;
             QJsonObject oroot = root;
             ores["service"] = service;
             ores["login"] = login;
-            ores["password"] = pass;
-            if (mpdevice && mpdevice->isFw12()) //only add description for fw > 1.2
+            if (fields & CredentialPassword)
+                ores["password"] = pass;
+            if (fields & CredentialDescription)
                 ores["description"] = desc;
             oroot["data"] = ores;
             sendJsonMessage(oroot);
         });
     }
+    else if (root["msg"] == "get_credentials_batch")
+    {
+        QJsonObject o = root["data"].toObject();
+
+        QString reqid;
+        if (o.contains("request_id"))
+            reqid = QStringLiteral("%1-%2").arg(clientUid).arg(getRequestId(o["request_id"]));
+
+        if (!mpdevice)
+        {
+            sendFailedJson(root, "No device connected");
+            return;
+        }
+
+        QList<MPCredentialRequest> requests;
+        for (const QJsonValue &v: o["requests"].toArray())
+        {
+            QJsonObject r = v.toObject();
+            MPCredentialRequest req;
+            req.service = r["service"].toString();
+            if (r["match_service"].toBool())
+            {
+                QString m = mpdevice->matchService(req.service);
+                if (!m.isEmpty())
+                    req.service = m;
+            }
+            req.login = r["login"].toString();
+            req.fallback_service = r["fallback_service"].toString();
+            req.fields = credentialFields(mpdevice, r);
+            requests.append(req);
+        }
+
+        if (requests.isEmpty())
+        {
+            sendFailedJson(root, "requests is empty");
+            return;
+        }
+
+        QSharedPointer<int> failedCount(new int(0));
+
+        mpdevice->getCredentialsBatch(requests, reqid,
+                [=](int index, bool success, QString errstr, const QString &service, const QString &login, const QString &pass, const QString &desc)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            //Each credential is sent as soon as it is available
+            QJsonObject ores;
+            QJsonObject oroot = root;
+            oroot["msg"] = "credential_batch_item";
+            if (o.contains("request_id"))
+                ores["request_id"] = o["request_id"];
+            ores["index"] = index;
+            if (success)
+            {
+                ores["service"] = service;
+                ores["login"] = login;
+                if (requests.at(index).fields & CredentialPassword)
+                    ores["password"] = pass;
+                if (requests.at(index).fields & CredentialDescription)
+                    ores["description"] = desc;
+            }
+            else
+            {
+                (*failedCount)++;
+                ores["service"] = requests.at(index).service;
+                ores["failed"] = true;
+                ores["error_message"] = errstr;
+            }
+            oroot["data"] = ores;
+            sendJsonMessage(oroot);
+        },
+                [=](bool success, QString errstr)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            if (!success)
+            {
+                sendFailedJson(root, errstr);
+                return;
+            }
+
+            QJsonObject ores;
+            QJsonObject oroot = root;
+            if (o.contains("request_id"))
+                ores["request_id"] = o["request_id"];
+            ores["count"] = requests.size();
+            ores["failed_count"] = *failedCount;
+            oroot["data"] = ores;
+            sendJsonMessage(oroot);
+        });
+    }
+    else if (root["msg"] == "match_service")
+    {
+        QJsonObject o = root["data"].toObject();
+
+        if (!mpdevice)
+        {
+            sendFailedJson(root, "No device connected");
+            return;
+        }
+
+        ServiceMatcher::MatchType type;
+        QString service = mpdevice->matchService(o["url"].toString(), &type);
+        if (service.isEmpty())
+        {
+            if (!mpdevice->hasServiceIndex())
+                sendFailedJson(root, "service list not loaded, enter and exit memory management mode first");
+            else
+                sendFailedJson(root, "no matching service found");
+            return;
+        }
+
+        QJsonObject ores = o;
+        QJsonObject oroot = root;
+        ores["service"] = service;
+        ores["match"] = ServiceMatcher::matchTypeString(type);
+        oroot["data"] = ores;
+        sendJsonMessage(oroot);
+    }
+    else if (root["msg"] == "service_exists")
+    {
+        QJsonObject o = root["data"].toObject();
+
+        QString reqid;
+        if (o.contains("request_id"))
+            reqid = QStringLiteral("%1-%2").arg(clientUid).arg(getRequestId(o["request_id"]));
+
+        if (!mpdevice)
+        {
+            sendFailedJson(root, "No device connected");
+            return;
+        }
+
+        mpdevice->serviceExists(o["service"].toString(), o["data_node"].toBool(), reqid,
+                [=](bool success, QString errstr, bool exists)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            if (!success)
+            {
+                sendFailedJson(root, errstr);
+                return;
+            }
+
+            QJsonObject ores = o;
+            QJsonObject oroot = root;
+            ores["exists"] = exists;
+            oroot["data"] = ores;
+            sendJsonMessage(oroot);
+        });
+    }
     else if (root["msg"] == "set_credential")
     {
         QJsonObject o = root["data"].toObject();
@@ -269,6 +474,8 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
+            dropProgress(pkey);
+
             if (!success)
             {
                 sendFailedJson(root, errstr);
@@ -288,16 +495,7 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
-            if (current > total)
-                current = total;
-
-            QJsonObject ores;
-            QJsonObject oroot = root;
-            ores["progress_total"] = total;
-            ores["progress_current"] = current;
-            oroot["data"] = ores;
-            oroot["msg"] = "progress"; //change msg to avoid breaking of client waiting of the response
-            sendJsonMessage(oroot);
+            queueProgress(pkey, root, total, current);
         });
     }
     else if (root["msg"] == "set_data_node")
@@ -325,6 +523,8 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
+            dropProgress(pkey);
+
             if (!success)
             {
                 sendFailedJson(root, errstr);
@@ -342,18 +542,255 @@ void WSServerCon::processMessage(const QString &message)
             if (!WSServer::Instance()->checkClientExists(this))
                 return;
 
-            if (current > total)
-                current = total;
+            queueProgress(pkey, root, total, current);
+        });
+    }
+    else if (root["msg"] == "export_image")
+    {
+        QJsonObject o = root["data"].toObject();
+
+        MPImageFile::ImageType type;
+        if (!MPImageFile::typeFromName(o["type"].toString(), type))
+        {
+            sendFailedJson(root, "unknown image type");
+            return;
+        }
+
+        if (!mpdevice)
+            return;
+
+        //Images are written in the daemon images dir, clients copy the file
+        QString dir = Common::imagesDir();
+        QDir().mkpath(dir);
+        QString path = QStringLiteral("%1/%2-%3.mpimg").arg(dir)
+                .arg(MPImageFile::typeName(type))
+                .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+
+        mpdevice->exportImage(type, path,
+                [=](bool success, QString errstr)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            dropProgress(pkey);
+
+            if (!success)
+            {
+                sendFailedJson(root, errstr);
+                return;
+            }
 
             QJsonObject ores;
+            ores["type"] = MPImageFile::typeName(type);
+            ores["file"] = path;
             QJsonObject oroot = root;
-            ores["progress_total"] = total;
-            ores["progress_current"] = current;
             oroot["data"] = ores;
-            oroot["msg"] = "progress"; //change msg to avoid breaking of client waiting of the response
             sendJsonMessage(oroot);
+        },
+        //progress callback handling
+        [=](int total, int current)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            queueProgress(pkey, root, total, current);
         });
     }
+    else if (root["msg"] == "export_snapshot")
+    {
+        //Snapshot of the database loaded by the memory management mode
+        QJsonObject o = root["data"].toObject();
+
+        if (!mpdevice)
+            return;
+
+        //Service names, logins and descriptions are not encrypted by the card
+        QString passphrase = o["passphrase"].toString();
+        if (passphrase.isEmpty())
+        {
+            sendFailedJson(root, "a passphrase is required to encrypt the snapshot");
+            return;
+        }
+
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/snapshots";
+        QDir().mkpath(dir);
+        QString path = QStringLiteral("%1/snapshot-%2.mcdb").arg(dir)
+                .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+
+        QString errstr;
+        if (!mpdevice->exportSnapshot(path, passphrase, errstr))
+        {
+            sendFailedJson(root, errstr);
+            return;
+        }
+
+        QJsonObject ores;
+        ores["file"] = path;
+        QJsonObject oroot = root;
+        oroot["data"] = ores;
+        sendJsonMessage(oroot);
+    }
+    else if (root["msg"] == "import_image")
+    {
+        QJsonObject o = root["data"].toObject();
+
+        MPImageFile::ImageType type;
+        if (!MPImageFile::typeFromName(o["type"].toString(), type))
+        {
+            sendFailedJson(root, "unknown image type");
+            return;
+        }
+
+        if (!mpdevice)
+            return;
+
+        //Only a file name in the daemon images dir is accepted, clients copy the image there
+        QString name = o["file"].toString();
+        if (name.isEmpty() || QFileInfo(name).fileName() != name ||
+            name == "." || name == "..")
+        {
+            sendFailedJson(root, "invalid image file name");
+            return;
+        }
+        QString path = QDir(Common::imagesDir()).filePath(name);
+        if (!QFileInfo(path).isFile())
+        {
+            sendFailedJson(root, "image file not found in the images dir");
+            return;
+        }
+
+        mpdevice->importImage(type, path,
+                [=](bool success, QString errstr)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            dropProgress(pkey);
+
+            if (!success)
+            {
+                sendFailedJson(root, errstr);
+                return;
+            }
+
+            QJsonObject ores;
+            ores["type"] = MPImageFile::typeName(type);
+            QJsonObject oroot = root;
+            oroot["data"] = ores;
+            sendJsonMessage(oroot);
+        },
+        //progress callback handling
+        [=](int total, int current)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            queueProgress(pkey, root, total, current);
+        });
+    }
+    else if (root["msg"] == "import_credentials")
+    {
+        //Import a list of credentials in one memory management mode session
+        QJsonObject o = root["data"].toObject();
+
+        if (!mpdevice)
+        {
+            sendFailedJson(root, "No device connected");
+            return;
+        }
+
+        QList<MPCredentialImport> credentials;
+        for (const QJsonValue &v: o["credentials"].toArray())
+        {
+            QJsonObject c = v.toObject();
+            MPCredentialImport cred;
+            cred.service = c["service"].toString();
+            cred.login = c["login"].toString();
+            cred.password = c["password"].toString();
+            if (c.contains("description"))
+            {
+                //An empty description clears it, a missing one is kept
+                QString desc = c["description"].toString();
+                cred.description = desc.isNull()? QString(""): desc;
+            }
+            credentials.append(cred);
+        }
+
+        int count = credentials.size();
+
+        //One result per credential, in the order of the request
+        QSharedPointer<QJsonArray> results(new QJsonArray());
+        for (int i = 0;i < count;i++)
+            results->append(QJsonObject{{ "service", credentials.at(i).service },
+                                        { "login", credentials.at(i).login }});
+        QSharedPointer<int> failedCount(new int(0));
+
+        mpdevice->importCredentials(credentials,
+                [=](int index, bool success, QString errstr)
+        {
+            QJsonObject ores = results->at(index).toObject();
+            if (!success)
+            {
+                (*failedCount)++;
+                ores["failed"] = true;
+                ores["error_message"] = errstr;
+            }
+            (*results)[index] = ores;
+        },
+                [=](bool success, QString errstr)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            dropProgress(pkey);
+
+            //Rejected before any credential was processed
+            if (!success && *failedCount == 0)
+            {
+                sendFailedJson(root, errstr);
+                return;
+            }
+
+            QJsonObject ores;
+            if (!success)
+            {
+                ores["failed"] = true;
+                ores["error_message"] = errstr;
+            }
+            ores["count"] = count;
+            ores["failed_count"] = *failedCount;
+            ores["results"] = *results;
+            QJsonObject oroot = root;
+            oroot["data"] = ores;
+            sendJsonMessage(oroot);
+        },
+        //progress callback handling
+        [=](int total, int current)
+        {
+            if (!WSServer::Instance()->checkClientExists(this))
+                return;
+
+            queueProgress(pkey, root, total, current);
+        });
+    }
+    else if (root["msg"] == "subscribe")
+    {
+        //Only receive the listed broadcast messages, an empty list means all of them
+        QJsonObject o = root["data"].toObject();
+        subscribedEvents.clear();
+        for (const QJsonValue &v: o["events"].toArray())
+            subscribedEvents.insert(v.toString());
+    }
+    else if (root["msg"] == "get_device_status")
+    {
+        //resend the full state of the selected device
+        if (!mpdevice)
+        {
+            sendFailedJson(root, "No device connected");
+            return;
+        }
+        sendDeviceStatus(mpdevice);
+    }
     else if (root["msg"] == "show_app")
     {
         //broadcast the message to all clients
@@ -371,313 +808,281 @@ void WSServerCon::processMessage(const QString &message)
     }
 }
 
-void WSServerCon::sendFailedJson(QJsonObject obj, QString errstr)
+QString WSServerCon::progressKey(const QJsonObject &root)
 {
-    QJsonObject odata;
-    odata["failed"] = true;
-    if (!errstr.isEmpty())
-        odata["error_message"] = errstr;
-    obj["data"] = odata;
-    sendJsonMessage(obj);
+    QJsonObject o = root["data"].toObject();
+
+    //Requests without request_id can run concurrently, give each one its own key
+    if (!o.contains("request_id"))
+        return QStringLiteral("%1#%2").arg(root["msg"].toString()).arg(++progressCounter);
+
+    return QStringLiteral("%1-%2").arg(root["msg"].toString()).arg(getRequestId(o["request_id"]));
 }
 
-void WSServerCon::resetDevice(MPDevice *dev)
+void WSServerCon::queueProgress(const QString &key, const QJsonObject &root, int total, int current)
 {
-    mpdevice = dev;
+    if (current > total)
+        current = total;
 
-    if (!mpdevice)
-    {
-        sendJsonMessage({{ "msg", "mp_disconnected" }});
-        return;
-    }
+    //Only update the values here, json is created when the progress is sent
+    PendingProgress &p = pendingProgress[key];
+    p.root = root;
+    p.total = total;
+    p.current = current;
 
-    sendJsonMessage({{ "msg", "mp_connected" }});
-
-    //Whenever mp status changes, send state update to client
-    connect(mpdevice, &MPDevice::statusChanged, this, &WSServerCon::statusChanged);
-
-    connect(mpdevice, SIGNAL(keyboardLayoutChanged(int)), this, SLOT(sendKeyboardLayout()));
-    connect(mpdevice, SIGNAL(lockTimeoutEnabledChanged(bool)), this, SLOT(sendLockTimeoutEnabled()));
-    connect(mpdevice, SIGNAL(lockTimeoutChanged(int)), this, SLOT(sendLockTimeout()));
-    connect(mpdevice, SIGNAL(screensaverChanged(bool)), this, SLOT(sendScreensaver()));
-    connect(mpdevice, SIGNAL(userRequestCancelChanged(bool)), this, SLOT(sendUserRequestCancel()));
-    connect(mpdevice, SIGNAL(userInteractionTimeoutChanged(int)), this, SLOT(sendUserInteractionTimeout()));
-    connect(mpdevice, SIGNAL(flashScreenChanged(bool)), this, SLOT(sendFlashScreen()));
-    connect(mpdevice, SIGNAL(offlineModeChanged(bool)), this, SLOT(sendOfflineMode()));
-    connect(mpdevice, SIGNAL(tutorialEnabledChanged(bool)), this, SLOT(sendTutorialEnabled()));
-    connect(mpdevice, SIGNAL(memMgmtModeChanged(bool)), this, SLOT(sendMemMgmtMode()));
-    connect(mpdevice, SIGNAL(flashMbSizeChanged(int)), this, SLOT(sendVersion()));
-    connect(mpdevice, SIGNAL(hwVersionChanged(QString)), this, SLOT(sendVersion()));
-    connect(mpdevice, SIGNAL(serialNumberChanged(quint32)), this, SLOT(sendVersion()));
-    connect(mpdevice, SIGNAL(screenBrightnessChanged(int)), this, SLOT(sendScreenBrightness()));
-    connect(mpdevice, SIGNAL(knockEnabledChanged(bool)), this, SLOT(sendKnockEnabled()));
-    connect(mpdevice, SIGNAL(knockSensitivityChanged(int)), this, SLOT(sendKnockSensitivity()));
-    connect(mpdevice, SIGNAL(randomStartingPinChanged(bool)), this, SLOT(sendRandomStartingPin()));
-    connect(mpdevice, SIGNAL(hashDisplayChanged(bool)), this, SLOT(sendHashDisplayEnabled()));
-    connect(mpdevice, SIGNAL(lockUnlockModeChanged(int)), this, SLOT(sendLockUnlockMode()));
-
-    connect(mpdevice, SIGNAL(keyAfterLoginSendEnableChanged(bool)), this, SLOT(sendKeyAfterLoginSendEnable()));
-    connect(mpdevice, SIGNAL(keyAfterLoginSendChanged(int)), this, SLOT(sendKeyAfterLoginSend()));
-    connect(mpdevice, SIGNAL(keyAfterPassSendEnableChanged(bool)), this, SLOT(sendKeyAfterPassSendEnable()));
-    connect(mpdevice, SIGNAL(keyAfterPassSendChanged(int)), this, SLOT(sendKeyAfterPassSend()));
-    connect(mpdevice, SIGNAL(delayAfterKeyEntryEnableChanged(bool)), this, SLOT(sendDelayAfterKeyEntryEnable()));
-    connect(mpdevice, SIGNAL(delayAfterKeyEntryChanged(int)), this, SLOT(sendDelayAfterKeyEntry()));
-
-    connect(mpdevice, SIGNAL(uidChanged(qint64)), this, SLOT(sendDeviceUID()));
+    if (!progressTimer->isActive())
+        progressTimer->start();
 }
 
-void WSServerCon::statusChanged()
+void WSServerCon::dropProgress(const QString &key)
 {
-    qDebug() << "Update client status changed: " << this;
-    if (!mpdevice)
-        return;
-    sendJsonMessage({{ "msg", "status_changed" },
-                     { "data", Common::MPStatusString[mpdevice->get_status()] }});
+    pendingProgress.remove(key);
 }
 
-void WSServerCon::sendInitialStatus()
+void WSServerCon::flushProgress()
 {
-    //Sends initial status to any new connected client
-    //is any mp connected? and if true send mp state too
-
-    if (!mpdevice)
-        sendJsonMessage({{ "msg", "mp_disconnected" }});
-    else
+    if (pendingProgress.isEmpty())
     {
-        sendJsonMessage({{ "msg", "mp_connected" }});
-        sendJsonMessage({{ "msg", "status_changed" },
-                         { "data", Common::MPStatusString[mpdevice->get_status()] }});
-        sendKeyboardLayout();
-        sendLockTimeoutEnabled();
-        sendLockTimeout();
-        sendScreensaver();
-        sendUserRequestCancel();
-        sendUserInteractionTimeout();
-        sendFlashScreen();
-        sendOfflineMode();
-        sendTutorialEnabled();
-        sendMemMgmtMode();
-        sendVersion();
-        sendScreenBrightness();
-        sendKnockEnabled();
-        sendKnockSensitivity();
-        sendRandomStartingPin();
-        sendHashDisplayEnabled();
-        sendLockUnlockMode();
-        sendKeyAfterLoginSendEnable();
-        sendKeyAfterLoginSend();
-        sendKeyAfterPassSendEnable();
-        sendKeyAfterPassSend();
-        sendDelayAfterKeyEntryEnable();
-        sendDelayAfterKeyEntry();
+        progressTimer->stop();
+        return;
     }
-}
 
-void WSServerCon::sendKeyboardLayout()
-{
-    if (!mpdevice)
+    //Slow client, wait for the socket to drain. Values keep being updated
+    //in the meantime so only the latest progress is sent.
+    if (wsClient->bytesToWrite() > PROGRESS_MAX_PENDING)
         return;
-    QJsonObject data = {{ "parameter", "keyboard_layout" },
-                        { "value", mpdevice->get_keyboardLayout() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
 
-void WSServerCon::sendLockTimeoutEnabled()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "lock_timeout_enabled" },
-                        { "value", mpdevice->get_lockTimeoutEnabled() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    for (auto it = pendingProgress.begin();it != pendingProgress.end();it++)
+    {
+        QJsonObject ores;
+        QJsonObject oroot = it.value().root;
+        ores["progress_total"] = it.value().total;
+        ores["progress_current"] = it.value().current;
+        oroot["data"] = ores;
+        oroot["msg"] = "progress"; //change msg to avoid breaking of client waiting of the response
+        sendJsonMessage(oroot);
+    }
+    pendingProgress.clear();
 }
 
-void WSServerCon::sendLockTimeout()
+int WSServerCon::credentialFields(MPDevice *dev, const QJsonObject &o)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "lock_timeout" },
-                        { "value", mpdevice->get_lockTimeout() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    //login is always needed, by default password and description are also sent
+    int fields = CredentialLogin;
+    if (o.contains("fields"))
+    {
+        for (const QJsonValue &v: o["fields"].toArray())
+        {
+            if (v.toString() == "password")
+                fields |= CredentialPassword;
+            else if (v.toString() == "description")
+                fields |= CredentialDescription;
+        }
+    }
+    else
+        fields = CredentialAllFields;
 
-void WSServerCon::sendScreensaver()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "screensaver" },
-                        { "value", mpdevice->get_screensaver() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    //only query description for fw > 1.2
+    if (!dev->isFw12())
+        fields &= ~CredentialDescription;
 
-void WSServerCon::sendUserRequestCancel()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "user_request_cancel" },
-                        { "value", mpdevice->get_userRequestCancel() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    return fields;
 }
 
-void WSServerCon::sendUserInteractionTimeout()
+void WSServerCon::sendFailedJson(QJsonObject obj, QString errstr)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "user_interaction_timeout" },
-                        { "value", mpdevice->get_userInteractionTimeout() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    QJsonObject odata;
+    odata["failed"] = true;
+    if (!errstr.isEmpty())
+        odata["error_message"] = errstr;
+    obj["data"] = odata;
+    sendJsonMessage(obj);
 }
 
-void WSServerCon::sendFlashScreen()
+MPDevice *WSServerCon::getDevice(const QJsonObject &root)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "flash_screen" },
-                        { "value", mpdevice->get_flashScreen() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    const QList<MPDevice *> &devs = WSServer::Instance()->getDevices();
 
-void WSServerCon::sendOfflineMode()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "offline_mode" },
-                        { "value", mpdevice->get_offlineMode() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    //No device selector, use the first connected device
+    if (!root.contains("device"))
+        return devs.isEmpty()?nullptr:devs.first();
 
-void WSServerCon::sendTutorialEnabled()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "tutorial_enabled" },
-                        { "value", mpdevice->get_tutorialEnabled() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    return WSServer::Instance()->findDevice(root["device"].toString());
 }
 
-void WSServerCon::sendScreenBrightness()
+bool WSServerCon::isSubscribed(const QString &msgType) const
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "screen_brightness" },
-                        { "value", mpdevice->get_screenBrightness() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    //Connection state is always sent, clients can't select a device without it
+    if (msgType == "mp_connected" ||
+        msgType == "mp_disconnected" ||
+        msgType == "device_list")
+        return true;
+
+    return subscribedEvents.isEmpty() || subscribedEvents.contains(msgType);
 }
 
-void WSServerCon::sendKnockEnabled()
+void WSServerCon::clearLoginCache(MPDevice *dev, const QString &service)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "knock_enabled" },
-                        { "value", mpdevice->get_knockEnabled() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    if (service.isEmpty())
+        loginCache.remove(dev);
+    else if (loginCache.contains(dev))
+        loginCache[dev].remove(service);
 }
 
-void WSServerCon::sendKnockSensitivity()
+void WSServerCon::sendInitialStatus()
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "knock_sensitivity" },
-                        { "value", mpdevice->get_knockSensitivity() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    //Sends initial status to any new connected client
+    //the list of connected mp and the state of all of them
+    const QList<MPDevice *> &devs = WSServer::Instance()->getDevices();
 
+    sendJsonMessage(deviceListJson(devs));
 
-void WSServerCon::sendRandomStartingPin()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "random_starting_pin" },
-                        { "value", mpdevice->get_randomStartingPin() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
-}
+    if (devs.isEmpty())
+        sendJsonMessage({{ "msg", "mp_disconnected" }});
 
-void WSServerCon::sendHashDisplayEnabled()
-{
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "hash_display" },
-                        { "value", mpdevice->get_hashDisplay() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    for (MPDevice *dev: devs)
+        sendDeviceStatus(dev);
 }
 
-void WSServerCon::sendLockUnlockMode()
+void WSServerCon::sendDeviceStatus(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "lock_unlock_mode" },
-                        { "value", mpdevice->get_lockUnlockMode() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    sendJsonMessage(deviceJson(dev, {{ "msg", "mp_connected" }}));
+    sendJsonMessage(statusJson(dev));
+    for (const QString &param: deviceParams)
+        sendJsonMessage(paramJson(dev, param));
+    sendJsonMessage(memMgmtModeJson(dev));
+    sendJsonMessage(memMgmtDataJson(dev));
+    sendJsonMessage(versionJson(dev));
 }
 
-void WSServerCon::sendKeyAfterLoginSendEnable()
+QString WSServerCon::deviceId(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "key_after_login_enabled" },
-                        { "value", mpdevice->get_keyAfterLoginSendEnable() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    return MPManager::Instance()->getDeviceId(dev);
 }
 
-void WSServerCon::sendKeyAfterLoginSend()
+QJsonObject WSServerCon::deviceJson(MPDevice *dev, QJsonObject obj)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "key_after_login" },
-                        { "value", mpdevice->get_keyAfterLoginSend() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    obj["device"] = deviceId(dev);
+    return obj;
 }
 
-void WSServerCon::sendKeyAfterPassSendEnable()
+QJsonObject WSServerCon::deviceListJson(const QList<MPDevice *> &devs)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "key_after_pass_enabled" },
-                        { "value", mpdevice->get_keyAfterPassSendEnable() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    QJsonArray arr;
+    for (MPDevice *dev: devs)
+    {
+        QJsonObject d = {{ "device", deviceId(dev) },
+                         { "hw_version", dev->get_hwVersion() },
+                         { "status", Common::MPStatusString[dev->get_status()] }};
+        if (dev->isMini())
+            d["hw_serial"] = (qint64)dev->get_serialNumber();
+        arr.append(d);
+    }
+
+    QJsonObject data = {{ "devices", arr }};
+    if (!devs.isEmpty())
+        data["default_device"] = deviceId(devs.first());
+
+    return {{ "msg", "device_list" }, { "data", data }};
 }
 
-void WSServerCon::sendKeyAfterPassSend()
+QJsonObject WSServerCon::statusJson(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "key_after_pass" },
-                        { "value", mpdevice->get_keyAfterPassSend() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    return deviceJson(dev, {{ "msg", "status_changed" },
+                            { "data", Common::MPStatusString[dev->get_status()] }});
 }
 
-void WSServerCon::sendDelayAfterKeyEntryEnable()
+const QStringList WSServerCon::deviceParams = {
+    "keyboard_layout",
+    "lock_timeout_enabled",
+    "lock_timeout",
+    "screensaver",
+    "user_request_cancel",
+    "user_interaction_timeout",
+    "flash_screen",
+    "offline_mode",
+    "tutorial_enabled",
+    "screen_brightness",
+    "knock_enabled",
+    "knock_sensitivity",
+    "random_starting_pin",
+    "hash_display",
+    "lock_unlock_mode",
+    "key_after_login_enabled",
+    "key_after_login",
+    "key_after_pass_enabled",
+    "key_after_pass",
+    "delay_after_key_enabled",
+    "delay_after_key",
+};
+
+QJsonObject WSServerCon::paramJson(MPDevice *dev, const QString &param)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "delay_after_key_enabled" },
-                        { "value", mpdevice->get_delayAfterKeyEntryEnable() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    QJsonValue value;
+    if (param == "keyboard_layout")
+        value = dev->get_keyboardLayout();
+    else if (param == "lock_timeout_enabled")
+        value = dev->get_lockTimeoutEnabled();
+    else if (param == "lock_timeout")
+        value = dev->get_lockTimeout();
+    else if (param == "screensaver")
+        value = dev->get_screensaver();
+    else if (param == "user_request_cancel")
+        value = dev->get_userRequestCancel();
+    else if (param == "user_interaction_timeout")
+        value = dev->get_userInteractionTimeout();
+    else if (param == "flash_screen")
+        value = dev->get_flashScreen();
+    else if (param == "offline_mode")
+        value = dev->get_offlineMode();
+    else if (param == "tutorial_enabled")
+        value = dev->get_tutorialEnabled();
+    else if (param == "screen_brightness")
+        value = dev->get_screenBrightness();
+    else if (param == "knock_enabled")
+        value = dev->get_knockEnabled();
+    else if (param == "knock_sensitivity")
+        value = dev->get_knockSensitivity();
+    else if (param == "random_starting_pin")
+        value = dev->get_randomStartingPin();
+    else if (param == "hash_display")
+        value = dev->get_hashDisplay();
+    else if (param == "lock_unlock_mode")
+        value = dev->get_lockUnlockMode();
+    else if (param == "key_after_login_enabled")
+        value = dev->get_keyAfterLoginSendEnable();
+    else if (param == "key_after_login")
+        value = dev->get_keyAfterLoginSend();
+    else if (param == "key_after_pass_enabled")
+        value = dev->get_keyAfterPassSendEnable();
+    else if (param == "key_after_pass")
+        value = dev->get_keyAfterPassSend();
+    else if (param == "delay_after_key_enabled")
+        value = dev->get_delayAfterKeyEntryEnable();
+    else if (param == "delay_after_key")
+        value = dev->get_delayAfterKeyEntry();
+
+    QJsonObject data = {{ "parameter", param },
+                        { "value", value }};
+    return deviceJson(dev, {{ "msg", "param_changed" }, { "data", data }});
 }
 
-void WSServerCon::sendDelayAfterKeyEntry()
+QJsonObject WSServerCon::memMgmtModeJson(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "parameter", "delay_after_key" },
-                        { "value", mpdevice->get_delayAfterKeyEntry() }};
-    sendJsonMessage({{ "msg", "param_changed" }, { "data", data }});
+    return deviceJson(dev, {{ "msg", "memorymgmt_changed" },
+                            { "data", dev->get_memMgmtMode() }});
 }
 
-void WSServerCon::sendMemMgmtMode()
+QJsonObject WSServerCon::memMgmtDataJson(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    sendJsonMessage({{ "msg", "memorymgmt_changed" },
-                     { "data", mpdevice->get_memMgmtMode() }});
-
     QJsonArray logins;
-    foreach (MPNode *n, mpdevice->getLoginNodes())
+    foreach (MPNode *n, dev->getLoginNodes())
     {
         logins.append(n->toJson());
     }
 
     QJsonArray datas;
-    foreach (MPNode *n, mpdevice->getDataNodes())
+    foreach (MPNode *n, dev->getDataNodes())
     {
         datas.append(n->toJson());
     }
@@ -686,33 +1091,29 @@ void WSServerCon::sendMemMgmtMode()
     jdata["login_nodes"] = logins;
     jdata["data_nodes"] = datas;
 
-    sendJsonMessage({{ "msg", "memorymgmt_data" },
-                     { "data", jdata }});
+    return deviceJson(dev, {{ "msg", "memorymgmt_data" },
+                            { "data", jdata }});
 }
 
-void WSServerCon::sendVersion()
+QJsonObject WSServerCon::versionJson(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    QJsonObject data = {{ "hw_version", mpdevice->get_hwVersion() },
-                        { "flash_size", mpdevice->get_flashMbSize() }};
-    if (mpdevice->isMini())
+    QJsonObject data = {{ "hw_version", dev->get_hwVersion() },
+                        { "flash_size", dev->get_flashMbSize() }};
+    if (dev->isMini())
     {
-        data["hw_serial"] = (qint64)mpdevice->get_serialNumber();
+        data["hw_serial"] = (qint64)dev->get_serialNumber();
     }
-    sendJsonMessage({{ "msg", "version_changed" }, { "data", data }});
+    return deviceJson(dev, {{ "msg", "version_changed" }, { "data", data }});
 }
 
-void WSServerCon::sendDeviceUID()
+QJsonObject WSServerCon::deviceUidJson(MPDevice *dev)
 {
-    if (!mpdevice)
-        return;
-    sendJsonMessage({{ "msg", "device_uid" },
-                     { "data", QJsonObject{ {"uid", mpdevice->get_uid()} } }
-                    });
+    return deviceJson(dev, {{ "msg", "device_uid" },
+                            { "data", QJsonObject{ {"uid", dev->get_uid()} } }
+                           });
 }
 
-void WSServerCon::processParametersSet(const QJsonObject &data)
+void WSServerCon::processParametersSet(MPDevice *mpdevice, const QJsonObject &data)
 {
     if (!mpdevice)
         return;
@@ -34,51 +34,73 @@ public:
     virtual ~WSServerCon();
 
     void sendJsonMessage(const QJsonObject &data);
-    void resetDevice(MPDevice *dev);
+    //send an already serialized message, used for broadcasts
+    void sendTextMessage(const QString &text);
     void sendInitialStatus();
 
+    //true if the client wants to receive broadcasted messages of this type
+    bool isSubscribed(const QString &msgType) const;
+
+    //Forget the logins cached for a device, or only for one of its services
+    void clearLoginCache(MPDevice *dev, const QString &service = QString());
+
+    //Device messages. They are built here and shared with the broadcasts
+    //done by WSServer when a device property changes
+    static QString deviceId(MPDevice *dev);
+    static QJsonObject deviceJson(MPDevice *dev, QJsonObject obj);
+    static QJsonObject deviceListJson(const QList<MPDevice *> &devs);
+    static QJsonObject statusJson(MPDevice *dev);
+    static QJsonObject paramJson(MPDevice *dev, const QString &param);
+    static QJsonObject memMgmtModeJson(MPDevice *dev);
+    static QJsonObject memMgmtDataJson(MPDevice *dev);
+    static QJsonObject versionJson(MPDevice *dev);
+    static QJsonObject deviceUidJson(MPDevice *dev);
+
+    //All parameters sent with param_changed
+    static const QStringList deviceParams;
+
 signals:
     void notifyAllClients(const QJsonObject &obj);
 
 private slots:
     void processMessage(const QString &msg);
-
-    void statusChanged();
-
-    //parameters slots that sends json to websocket
-    void sendKeyboardLayout();
-    void sendLockTimeoutEnabled();
-    void sendLockTimeout();
-    void sendScreensaver();
-    void sendUserRequestCancel();
-    void sendUserInteractionTimeout();
-    void sendFlashScreen();
-    void sendOfflineMode();
-    void sendTutorialEnabled();
-    void sendMemMgmtMode();
-    void sendVersion();
-    void sendScreenBrightness();
-    void sendKnockEnabled();
-    void sendKnockSensitivity();
-    void sendRandomStartingPin();
-    void sendHashDisplayEnabled();
-    void sendLockUnlockMode();
-    void sendKeyAfterLoginSendEnable();
-    void sendKeyAfterLoginSend();
-    void sendKeyAfterPassSendEnable();
-    void sendKeyAfterPassSend();
-    void sendDelayAfterKeyEntryEnable();
-    void sendDelayAfterKeyEntry();
-    void sendDeviceUID();
+    void flushProgress();
 
 private:
     QWebSocket *wsClient;
 
-    MPDevice *mpdevice = nullptr;
-
     QString clientUid;
 
-    void processParametersSet(const QJsonObject &data);
+    //Broadcasted message types the client subscribed to. Empty means all.
+    QSet<QString> subscribedEvents;
+
+    //Logins already approved by the user for this client, by device and requested
+    //service. Used to answer login only requests without a device round trip.
+    //Cleared on any status change (lock, card removal) and when the database changes.
+    QHash<MPDevice *, QHash<QString, QString>> loginCache;
+
+    //Progress of running requests. Only the last value of each request
+    //is kept and sent periodically, when the socket is not congested
+    class PendingProgress
+    {
+    public:
+        QJsonObject root;
+        int total = 0;
+        int current = 0;
+    };
+    QHash<QString, PendingProgress> pendingProgress;
+    QTimer *progressTimer = nullptr;
+    quint64 progressCounter = 0;
+
+    QString progressKey(const QJsonObject &root);
+    void queueProgress(const QString &key, const QJsonObject &root, int total, int current);
+    void dropProgress(const QString &key);
+
+    MPDevice *getDevice(const QJsonObject &root);
+    void sendDeviceStatus(MPDevice *dev);
+
+    void processParametersSet(MPDevice *mpdevice, const QJsonObject &data);
+    int credentialFields(MPDevice *dev, const QJsonObject &o);
     void sendFailedJson(QJsonObject obj, QString errstr = QString());
     QString getRequestId(const QJsonValue &v);
 };
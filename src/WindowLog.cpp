@@ -25,6 +25,13 @@ WindowLog::WindowLog(QWidget *parent) :
 {
     setAttribute(Qt::WA_DeleteOnClose, true); //delete the dialog on close
     ui->setupUi(this);
+
+    //Same colors as the levels in the daemon terminal output
+    levelFormats[QtDebugMsg].setForeground(QColor(Qt::darkCyan));
+    levelFormats[QtInfoMsg].setForeground(QColor(Qt::darkGreen));
+    levelFormats[QtWarningMsg].setForeground(QColor(Qt::darkYellow));
+    levelFormats[QtCriticalMsg].setForeground(QColor(Qt::red));
+    levelFormats[QtFatalMsg].setForeground(QColor(Qt::darkRed));
 }
 
 WindowLog::~WindowLog()
@@ -32,9 +39,26 @@ WindowLog::~WindowLog()
     delete ui;
 }
 
-void WindowLog::appendData(const QByteArray &logdata)
+void WindowLog::appendRecord(QtMsgType type, const QByteArray &line)
+{
+    QTextCharFormat format;
+    if (type >= 0 && type <= QtInfoMsg)
+        format = levelFormats[type];
+    ui->plainTextEdit->appendMessage(QString::fromUtf8(line), format);
+}
+
+void WindowLog::appendBuffered(const QByteArray &logdata)
 {
-    ui->plainTextEdit->appendMessage(QString::fromUtf8(logdata));
+    int pos = 0;
+    while (pos < logdata.size())
+    {
+        int nl = logdata.indexOf('\n', pos);
+        if (nl < 0)
+            nl = logdata.size() - 1;
+        if (nl > pos)
+            appendRecord(static_cast<QtMsgType>(logdata.at(pos)), logdata.mid(pos + 1, nl - pos));
+        pos = nl + 1;
+    }
 }
 
 void WindowLog::on_pushButtonClose_clicked()
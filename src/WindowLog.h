@@ -34,7 +34,10 @@ public:
     explicit WindowLog(QWidget *parent = 0);
     ~WindowLog();
 
-    void appendData(const QByteArray &logdata);
+    //A formatted log line, colored according to its level
+    void appendRecord(QtMsgType type, const QByteArray &line);
+    //Lines kept while the window was closed, each one starts with its level byte
+    void appendBuffered(const QByteArray &logdata);
 
 private slots:
     void on_pushButtonClose_clicked();
@@ -43,6 +46,8 @@ private slots:
 
 private:
     Ui::WindowLog *ui;
+
+    QTextCharFormat levelFormats[QtInfoMsg + 1];
 };
 
 #endif // WINDOWLOG_H
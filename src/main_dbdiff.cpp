@@ -0,0 +1,64 @@
+/******************************************************************************
+ **  Copyright (c) Raoul Hecky. All Rights Reserved.
+ **
+ **  Moolticute is free software; you can redistribute it and/or modify
+ **  it under the terms of the GNU General Public License as published by
+ **  the Free Software Foundation; either version 3 of the License, or
+ **  (at your option) any later version.
+ **
+ **  Moolticute is distributed in the hope that it will be useful,
+ **  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ **  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ **  GNU General Public License for more details.
+ **
+ **  You should have received a copy of the GNU General Public License
+ **  along with Foobar; if not, write to the Free Software
+ **  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ **
+ ******************************************************************************/
+#include "DbDiff.h"
+#include <stdio.h>
+
+//Exit codes: 0 snapshots are identical, 1 they differ, 2 error
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("moolticute-dbdiff");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compare two Moolticute database snapshots");
+    parser.addHelpOption();
+    QCommandLineOption passphraseOption(QStringList() << "p" << "passphrase",
+                                        "Passphrase used when the snapshots were exported",
+                                        "passphrase");
+    QCommandLineOption compactOption(QStringList() << "c" << "compact",
+                                     "Print compact JSON");
+    parser.addOption(passphraseOption);
+    parser.addOption(compactOption);
+    parser.addPositionalArgument("old", "Old snapshot file");
+    parser.addPositionalArgument("new", "New snapshot file");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2)
+    {
+        fprintf(stderr, "Two snapshot files are required\n");
+        parser.showHelp(2);
+    }
+
+    DbDiff d;
+    QString err;
+    if (!d.load(args.at(0), args.at(1), parser.value(passphraseOption), err))
+    {
+        fprintf(stderr, "%s\n", qPrintable(err));
+        return 2;
+    }
+
+    QJsonDocument doc(d.diff());
+    QByteArray out = doc.toJson(parser.isSet(compactOption)? QJsonDocument::Compact: QJsonDocument::Indented);
+    fwrite(out.constData(), 1, out.size(), stdout);
+    if (!out.endsWith('\n'))
+        fputc('\n', stdout);
+
+    return d.isIdentical()? 0: 1;
+}
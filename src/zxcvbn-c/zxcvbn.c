@@ -311,6 +311,23 @@ static uint8_t        *EndCountLge;
 static uint8_t        *EndCountSml;
 static char           *CharSet;
 
+/* Set when the dictionary data is owned by the caller (see ZxcvbnInitMem) */
+static int             DictExternal;
+
+/* Position in CharSet plus one of each character, 0 if the character is not used */
+static unsigned short  CharSetIdx[256];
+
+/**********************************************************************************
+ * Fill the CharSetIdx lookup table from the loaded CharSet.
+ */
+static void BuildCharSetIndex(void)
+{
+    unsigned int i;
+    memset(CharSetIdx, 0, sizeof CharSetIdx);
+    for(i = 0; i < SizeCharSet; ++i)
+        CharSetIdx[(uint8_t)CharSet[i]] = i + 1;
+}
+
 /**********************************************************************************
  * Calculate the CRC-64 of passed data.
  * Parameters:
@@ -436,18 +453,83 @@ int ZxcvbnInit(const char *Filename)
         EndCountSml = EndCountLge + NumLargeCounts;
         CharSet = (char *)EndCountSml + NumSmallCounts;
         CharSet[SizeCharSet] = 0;
+        BuildCharSetIndex();
         return 1;
     }
     return 0;
 }
+/**********************************************************************************
+ * Use dictionary data already in memory, in the same format as the file read by
+ * ZxcvbnInit(). The data is not copied, so it can be a memory mapped file. It
+ * must stay valid and unchanged until ZxcvbnUnInit() is called.
+ * Parameters:
+ *  Data        Pointer to the dictionary data, aligned on an unsigned int.
+ *  Size        Size of the data in bytes.
+ * Returns 1 on success, 0 on error
+ */
+int ZxcvbnInitMem(const void *Data, unsigned int Size)
+{
+    const unsigned int *Hdr = (const unsigned int *)Data;
+    uint64_t Crc = CHK_INIT;
+    unsigned int DictSize;
+
+    if (DictNodes)
+        return 1;
+    if (!Data || (Size < 10*sizeof(unsigned int)) || ((uintptr_t)Data % sizeof(unsigned int)))
+        return 0;
+    if (Hdr[0] != MAGIC)
+        return 0;
+
+    NumNodes          = Hdr[1];
+    NumChildLocs      = Hdr[2];
+    NumRanks          = Hdr[3];
+    NumWordEnd        = Hdr[4];
+    NumChildMaps      = Hdr[5];
+    SizeChildMapEntry = Hdr[6];
+    NumLargeCounts    = Hdr[7];
+    NumSmallCounts    = Hdr[8];
+    SizeCharSet       = Hdr[9];
+
+    /* Validate the header data */
+    if ((NumNodes >= (1<<17)) || (NumChildLocs >= (1<<BITS_CHILD_MAP_INDEX)) ||
+        (NumChildMaps >= (1<<BITS_CHILD_PATT_INDEX)) || ((SizeChildMapEntry*8) < SizeCharSet) ||
+        (NumLargeCounts >= (1<<9)) || (NumSmallCounts != NumNodes))
+        return 0;
+
+    DictSize = NumNodes*sizeof(*DictNodes) + NumChildLocs*sizeof(*ChildLocs) + NumRanks*sizeof(*Ranks) +
+               NumWordEnd + NumChildMaps*SizeChildMapEntry + NumLargeCounts + NumSmallCounts + SizeCharSet;
+    if ((DictSize >= MAX_DICT_FILE_SIZE) || (Size < 10*sizeof(unsigned int) + DictSize))
+        return 0;
+
+    /* Check crc, header is included */
+    Crc = CalcCrc64(Crc, Hdr, 10*sizeof(unsigned int) + DictSize);
+    if (memcmp(&Crc, WordCheck, sizeof Crc))
+        return 0;
+
+    /* Set pointers to the data. CharSet is only accessed by index so no need */
+    /* for a terminating null (the data may be read only) */
+    DictNodes = (unsigned int *)(Hdr + 10);
+    ChildLocs = DictNodes + NumNodes;
+    Ranks = (unsigned short *)(ChildLocs + NumChildLocs);
+    WordEndBits = (unsigned char *)(Ranks + NumRanks);
+    ChildMap = (unsigned char*)(WordEndBits + NumWordEnd);
+    EndCountLge = ChildMap + NumChildMaps*SizeChildMapEntry;
+    EndCountSml = EndCountLge + NumLargeCounts;
+    CharSet = (char *)EndCountSml + NumSmallCounts;
+    BuildCharSetIndex();
+    DictExternal = 1;
+    return 1;
+}
+
 /**********************************************************************************
  * Free the data allocated by ZxcvbnInit().
  */
 void ZxcvbnUnInit()
 {
-    if (DictNodes)
+    if (DictNodes && !DictExternal)
         FreeFn(DictNodes);
     DictNodes = 0;
+    DictExternal = 0;
 }
 
 #else
@@ -467,6 +549,53 @@ static const uint8_t L33TChr[] = "abcegilostxz";
 static const uint8_t L33TCnv[] = "!i $s %x (c +t 0o 1il2z 3e 4a 5s 6g 7lt8b 9g <c @a [c {c |il";
 #define LEET_NORM_MAP_SIZE 3
 
+/* Lookup tables for the above strings, indexed by ASCII char. They give the position plus */
+/* one of the char in L33TChr, or of its triple in L33TCnv, and 0 when the char is not     */
+/* present. They replace a binary search per password char and must match the strings.   */
+static const uint8_t L33TChrIdx[128] =
+{
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  1,  2,  3,  0,  4,  0,  5,  0,  6,  0,  0,  7,  0,  0,  8,
+     0,  0,  0,  9, 10,  0,  0,  0, 11,  0, 12,  0,  0,  0,  0,  0
+};
+static const uint8_t L33TCnvIdx[128] =
+{
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  1,  0,  0,  2,  3,  0,  0,  4,  0,  0,  5,  0,  0,  0,  0,
+     6,  7,  8,  9, 10, 11, 12, 13, 14, 15,  0,  0, 16,  0,  0,  0,
+    17,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 18,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 19, 20,  0,  0,  0
+};
+
+/* Number of bits set in a byte, to get the position of a child from a node's child map */
+static const uint8_t BitCount[256] =
+{
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
+};
+
 /* Struct holding additional data on the word match */
 typedef struct
 {
@@ -487,42 +616,53 @@ typedef struct
     int     Begin;
     int     Caps;
     int     Lower;
-    int     NumPossChrs;
     uint8_t Leeted[sizeof L33TChr];
     uint8_t UnLeet[sizeof L33TChr];
     uint8_t LeetCnv[sizeof L33TCnv / LEET_NORM_MAP_SIZE + 1];
  /*   uint8_t LeetChr[3]; */
     uint8_t First;
-    uint8_t PossChars[48];
 } DictWork_t;
 
 /**********************************************************************************
- * Given a map entry create a string of all possible characters for following to
- * a child node
+ * Find the child of a trie node that follows on with the given character.
+ * Parameters:
+ *  c       The (lowercase) character
+ *  Map     The child map entry of the node, a bitmap over the chars of CharSet
+ * Returns the position of the child among the children of the node, which is the
+ * number of map bits set before the one of the char, or -1 if there is no child.
  */
-static int ListPossibleChars(uint8_t *List, const uint8_t *Map)
+static int ChildIndex(uint8_t c, const uint8_t *Map)
 {
-    unsigned int i, j, k;
-    int Len = 0;
-    for(k = i = 0; i < SizeChildMapEntry; ++i, ++Map)
-    {
-        if (!*Map)
-        {
-            k += 8;
-            continue;
-        }
-        for(j = 0; j < 8; ++j)
-        {
-            if (*Map & (1<<j))
-            {
-                *List++ = CharSet[k];
-                ++Len;
-            }
-            ++k;
-        }
-    }
-    *List=0;
-    return Len;
+    unsigned int i, k, Bit;
+    int n;
+#ifdef USE_DICT_FILE
+    k = CharSetIdx[c];
+    if (!k)
+        return -1;
+    --k;
+#else
+    const uint8_t *p = CharBinSearch(c, (const uint8_t *)CharSet, sizeof CharSet - 1, 1);
+    if (!p)
+        return -1;
+    k = p - (const uint8_t *)CharSet;
+#endif
+    Bit = 1 << (k & 7);
+    k >>= 3;
+    if (!(Map[k] & Bit))
+        return -1;
+    for(n = 0, i = 0; i < k; ++i)
+        n += BitCount[Map[i]];
+    return n + BitCount[Map[k] & (Bit - 1)];
+}
+
+/**********************************************************************************
+ * Get the leet,normal,normal triple of L33TCnv for a char, or null if it is not a leet.
+ */
+static const uint8_t *LeetConversion(uint8_t c)
+{
+    if ((c >= sizeof L33TCnvIdx) || !L33TCnvIdx[c])
+        return 0;
+    return L33TCnv + (L33TCnvIdx[c] - 1) * LEET_NORM_MAP_SIZE;
 }
 
 /**********************************************************************************
@@ -530,10 +670,9 @@ static int ListPossibleChars(uint8_t *List, const uint8_t *Map)
  */
 static void AddLeetChr(uint8_t c, int IsLeet, uint8_t *Leeted, uint8_t *UnLeet)
 {
-    const uint8_t *p = CharBinSearch(c, L33TChr, sizeof L33TChr - 1, 1);
-    if (p)
+    if ((c < sizeof L33TChrIdx) && L33TChrIdx[c])
     {
-        int i = p - L33TChr;
+        int i = L33TChrIdx[c] - 1;
         if (IsLeet > 0)
         {
             Leeted[i] += 1;
@@ -630,8 +769,6 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
     int Caps = Wrk->Caps;
     int Lower = Wrk->Lower;
     unsigned int NodeLoc = Wrk->StartLoc;
-    uint8_t *PossChars = Wrk->PossChars;
-    int NumPossChrs = Wrk->NumPossChrs;
     const uint8_t *Pwd = Passwd;
     uint32_t NodeData = DictNodes[NodeLoc];
     Passwd += Start;
@@ -640,6 +777,8 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
         uint8_t c;
         int w, x, y, z;
         const uint8_t *q;
+        /* Set of possible chars at current point in word */
+        const uint8_t *Bmap = ChildMap + (NodeData & ((1<<BITS_CHILD_PATT_INDEX)-1)) * SizeChildMapEntry;
         z = 0;
         if (!Len && Wrk->First)
         {
@@ -647,11 +786,7 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
         }
         else
         {
-            /* Get char and set of possible chars at current point in word. */
-            const uint8_t *Bmap;
             c = *Passwd;
-            Bmap = ChildMap + (NodeData & ((1<<BITS_CHILD_PATT_INDEX)-1)) * SizeChildMapEntry;
-            NumPossChrs = ListPossibleChars(PossChars, Bmap);
 
             /* Make it lowercase and update lowercase, uppercase counts */
             if (isupper(c))
@@ -664,7 +799,7 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
                 ++Lower;
             }
             /* See if current char is a leet and can be converted  */
-            q = CharBinSearch(c, L33TCnv, sizeof L33TCnv / LEET_NORM_MAP_SIZE, LEET_NORM_MAP_SIZE);
+            q = LeetConversion(c);
             if (q)
             {
                 /* Found, see if used before */
@@ -680,8 +815,7 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
                 }
                 for(j = 0; (*q > ' ') && (j < LEET_NORM_MAP_SIZE); ++j, ++q)
                 {
-                    const uint8_t *r = CharBinSearch(*q, PossChars, NumPossChrs, 1);
-                    if (r)
+                    if (ChildIndex(*q, Bmap) >= 0)
                     {
                         /* valid conversion from leet */
                         DictWork_t w;
@@ -691,13 +825,11 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
                         w.PwdLength += Len;
                         w.Caps = Caps;
                         w.Lower = Lower;
-                        w.First = *r;
-                        w.NumPossChrs = NumPossChrs;
-                        memcpy(w.PossChars, PossChars, sizeof w.PossChars);
+                        w.First = *q;
                         if (j)
                         {
-                            w.LeetCnv[i] = *r;
-                            AddLeetChr(*r, -1, w.Leeted, w.UnLeet);
+                            w.LeetCnv[i] = *q;
+                            AddLeetChr(*q, -1, w.Leeted, w.UnLeet);
                         }
                         DoDictMatch(Pwd, Passwd - Pwd, MaxLen - Len, &w, Result, Extra, Lev+1);
                     }
@@ -705,23 +837,16 @@ static void DoDictMatch(const uint8_t *Passwd, int Start, int MaxLen, DictWork_t
                 return;
             }
         }
-        q = CharBinSearch(c, PossChars, NumPossChrs, 1);
-        if (q)
-        {
-            /* Found the char as a normal char */
-            if (CharBinSearch(c, L33TChr, sizeof L33TChr - 1, 1))
-            {
-                /* Char matches, but also a normal equivalent to a leet char */
-                AddLeetChr(c, 0,  Wrk->Leeted, Wrk->UnLeet);
-            }
-        }
-        if (!q)
+        x = ChildIndex(c, Bmap);
+        if (x < 0)
         {
             /* No match for char - return */
             return;
         }
+        /* Found the char as a normal char, count it if also a normal equivalent to a leet char */
+        AddLeetChr(c, 0,  Wrk->Leeted, Wrk->UnLeet);
+
         /* Add all the end counts of the child nodes before the one that matches */
-        x = (q - Wrk->PossChars);
         y = (NodeData >> BITS_CHILD_PATT_INDEX) & ((1 << BITS_CHILD_MAP_INDEX) - 1);
         NodeLoc = ChildLocs[x+y];
         for(w=0; w<x; ++w)
@@ -812,7 +937,7 @@ static void UserMatch(ZxcMatch_t **Result, const char *Words[], const uint8_t *P
                 ++Lowers;
             }
             /* See if current char is a leet and can be converted  */
-            q = CharBinSearch(c, L33TCnv, sizeof L33TCnv / LEET_NORM_MAP_SIZE, LEET_NORM_MAP_SIZE);
+            q = LeetConversion(c);
             if (q)
             {
                 /* Found, see if used before */
@@ -849,12 +974,8 @@ static void UserMatch(ZxcMatch_t **Result, const char *Words[], const uint8_t *P
             }
             else if (c == d)
             {
-                /* Found the char as a normal char */
-                if (CharBinSearch(c, L33TChr, sizeof L33TChr - 1, 1))
-                {
-                    /* Char matches, but also a normal equivalent to a leet char */
-                    AddLeetChr(c, 0,  Extra.Leeted, Extra.UnLeet);
-                }
+                /* Found the char as a normal char, count it if also a normal equivalent to a leet char */
+                AddLeetChr(c, 0,  Extra.Leeted, Extra.UnLeet);
             }
             else
             {
@@ -902,6 +1023,11 @@ static void DictionaryMatch(ZxcMatch_t **Result, const uint8_t *Passwd, int Star
     DictWork_t Wrk;
     DictMatchInfo_t Extra;
 
+#ifdef USE_DICT_FILE
+    /* Dictionary not loaded, only the other matchers are used */
+    if (!DictNodes)
+        return;
+#endif
     memset(&Extra, 0, sizeof Extra);
     memset(&Wrk, 0, sizeof Wrk);
     Wrk.Ordinal = 1;
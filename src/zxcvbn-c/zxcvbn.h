@@ -98,6 +98,12 @@ extern "C" {
  */
 int ZxcvbnInit(const char *);
 
+/**********************************************************************************
+ * Use the dictionnary data from memory (e.g. a memory mapped dictionnary file)
+ * without copying it. Returns 1 if OK, 0 if error.
+ */
+int ZxcvbnInitMem(const void *Data, unsigned int Size);
+
 /**********************************************************************************
  * Free the dictionnary data after use. Called once at program shutdown.
  */